@@ -73,15 +73,30 @@ limitations under the License. */
 
 #ifndef PJON_h
   #define PJON_h
-  #include <Arduino.h>
+  #if defined(ARDUINO)
+    #include <Arduino.h>
+  #else
+    #include "interfaces/LINUX/PJON_LINUX_Interface.h"
+  #endif
   #include <PJONDefines.h>
-  #include "strategies/EthernetTCP/EthernetTCP.h"
-  #include "strategies/LocalUDP/LocalUDP.h"
-  #include "strategies/OverSampling/OverSampling.h"
-  #include "strategies/SoftwareBitBang/SoftwareBitBang.h"
-  #include "strategies/ThroughSerial/ThroughSerial.h"
-
-  template<typename Strategy = SoftwareBitBang>
+  #if defined(ARDUINO)
+    #include "strategies/EthernetTCP/EthernetTCP.h"
+    #include "strategies/LocalUDP/LocalUDP.h"
+    #include "strategies/OverSampling/OverSampling.h"
+    #include "strategies/SoftwareBitBang/SoftwareBitBang.h"
+    #include "strategies/ThroughSerial/ThroughSerial.h"
+    #define PJON_DEFAULT_STRATEGY SoftwareBitBang
+  #else
+    #if defined(__linux__)
+      #include "strategies/EthernetTCP/EthernetTCP.h"
+      #include "strategies/LocalUDP/LocalUDP.h"
+      #include "strategies/ThroughSerial/ThroughSerial.h"
+    #endif
+    #define PJON_DEFAULT_STRATEGY VirtualBus
+  #endif
+  #include "strategies/VirtualBus/VirtualBus.h"
+
+  template<typename Strategy = PJON_DEFAULT_STRATEGY>
   class PJON {
     public:
       Strategy strategy;
@@ -119,16 +134,22 @@ limitations under the License. */
         set_default();
       };
 
+      virtual ~PJON() { }; // receive() is virtual
+
 
       /* Begin function to be called in setup: */
 
       void begin() {
         randomSeed(analogRead(A0));
+        // A random first session id lets the receivers detect a restart
+        _session_id = random(0x10000);
         delay(random(0, INITIAL_DELAY));
       };
 
 
-      /* Compose packet in PJON format: */
+      /* Compose packet in PJON format. If DATA_COMP_BIT is set the content
+         is compressed, if it does not get shorter (or it is a segment) it
+         is sent as it is and DATA_COMP_BIT is cleared: */
 
       uint16_t compose_packet(
         const uint8_t id,
@@ -136,31 +157,111 @@ limitations under the License. */
         char *destination,
         const char *source,
         uint16_t length,
-        uint16_t header = NOT_ASSIGNED
+        uint16_t header = NOT_ASSIGNED,
+        const uint8_t *segment = NULL
       ) const {
-        if(header == NOT_ASSIGNED) header = get_header();
-        if((header & ACK_REQUEST_BIT) && id == BROADCAST) header &= ~(ACK_REQUEST_BIT);
-        if(header > 255) header |= EXTEND_HEADER_BIT;
-        if(length > 255) header |= (EXTEND_LENGTH_BIT | CRC_BIT);
-        uint16_t new_length = length + packet_overhead(header);
-        bool extended_header = header & EXTEND_HEADER_BIT;
-        bool extended_length = header & EXTEND_LENGTH_BIT;
-
-        if(new_length > 255 && !extended_length) {
-          header |= (EXTEND_LENGTH_BIT | CRC_BIT);
-          new_length = (uint16_t)(length + packet_overhead(header));
-        }
+        uint16_t requested = header;
+        uint16_t new_length = compose_header_length(id, header, length);
 
-        if(new_length >= PACKET_MAX_LENGTH) {
+        if(frame_length(header, new_length) >= PACKET_MAX_LENGTH) {
           _error(CONTENT_TOO_LONG, new_length);
           return 0;
         }
 
+        bool compressed = false;
+        if(header & DATA_COMP_BIT) {
+        #if PJON_COMPRESSION > 0
+          uint8_t offset = packet_overhead(header) - (header & CRC_BIT ? 4 : 1);
+          uint16_t compressed_length = (header & SEGMENTATION_BIT) ? 0 : lz_compress(
+            (const uint8_t *)source, length, (uint8_t *)destination + offset,
+            length - 1, _dictionary, _dictionary_length
+          );
+          if(compressed_length) { // Shorter, the header may get shorter too
+            header = requested;
+            new_length = compose_header_length(id, header, compressed_length);
+            uint8_t compressed_offset = packet_overhead(header) - (header & CRC_BIT ? 4 : 1);
+            if(compressed_offset != offset)
+              memmove(destination + compressed_offset, destination + offset, compressed_length);
+            compressed = true;
+          }
+        #endif
+          if(!compressed) {
+            header = requested & ~DATA_COMP_BIT;
+            if(!(header & 0xFF00)) header &= ~EXTEND_HEADER_BIT;
+            new_length = compose_header_length(id, header, length);
+          }
+        }
+
+        uint8_t meta_length = compose_header(id, b_id, (uint8_t *)destination, header, new_length);
+        if(segment && (header & SEGMENTATION_BIT))
+          memcpy(segment_info((uint8_t *)destination), segment, 5);
+        if(!compressed) memcpy(destination + meta_length, source, length);
+        compose_crc((uint8_t *)destination, new_length);
+        return new_length;
+      };
+
+
+      /* Write the CRC at the end of a composed packet, followed by the
+         parity bytes if PARITY_BIT is set (see frame_length): */
+
+      void compose_crc(uint8_t *packet, uint16_t length) const {
+        if(packet[1] & CRC_BIT) {
+          uint32_t CRC = compute_crc_32(packet, length - 4);
+          packet[length - 4] = (uint32_t)(CRC) >> 24;
+          packet[length - 3] = (uint32_t)(CRC) >> 16;
+          packet[length - 2] = (uint32_t)(CRC) >>  8;
+          packet[length - 1] = (uint32_t)(CRC);
+        } else packet[length - 1] = compute_crc_8(packet, length - 1);
+        if(packet_header(packet) & PARITY_BIT) fec_encode(packet, length, packet + length);
+      };
+
+
+      /* True if the CRC at the end of a packet is correct: */
+
+      bool check_crc(const uint8_t *packet, uint16_t length) const {
+        if(packet[1] & CRC_BIT)
+          return compute_crc_32(packet, length - 4) == (
+            (uint32_t)packet[length - 4] << 24 |
+            (uint32_t)packet[length - 3] << 16 |
+            (uint32_t)packet[length - 2] <<  8 |
+            (uint32_t)packet[length - 1]
+          );
+        return !compute_crc_8(packet, length);
+      };
+
+
+      /* Bytes transmitted for a packet of length bytes: if PARITY_BIT is set
+         the parity bytes correcting it follow the packet (see
+         utils/ErrorCorrection.h), they are not counted in its length: */
+
+      uint16_t frame_length(uint16_t header, uint16_t length) const {
+        return length + ((header & PARITY_BIT) ? fec_parity_length(length) : 0);
+      };
+
+
+      /* Write the packet's id, header, length, bus ids, the context index if
+         HEADER_BYTE_3_BIT is set and the space for the session id if
+         SESSION_BIT is set, for the segment info if SEGMENTATION_BIT is set
+         and for the sequence ids if ACK_MODE_BIT is set (all that precedes
+         the content). Returns the number of bytes written: */
+
+      uint8_t compose_header(
+        const uint8_t id,
+        const uint8_t *b_id,
+        uint8_t *destination,
+        uint16_t header,
+        uint16_t new_length
+      ) const {
+        uint8_t extended_header =
+          (header & EXTEND_HEADER_BIT) ? ((header & HEADER_BYTE_3_BIT) ? 2 : 1) : 0;
+        bool extended_length = header & EXTEND_LENGTH_BIT;
         destination[0] = id;
 
         if(extended_header) {
           destination[1] = (uint16_t)header;
           destination[2] = (uint16_t)header >> 8;
+          // The third header byte is used only by the context
+          if(extended_header == 2) destination[3] = CONTEXT_BIT;
         } else destination[1] = header;
 
         if(extended_length) {
@@ -169,24 +270,50 @@ limitations under the License. */
         } else destination[2 + extended_header] = new_length;
 
         if(header & MODE_BIT) {
-          copy_bus_id((uint8_t*) &destination[3 + extended_header + extended_length], b_id);
+          copy_bus_id(&destination[3 + extended_header + extended_length], b_id);
           if(header & SENDER_INFO_BIT) {
-            copy_bus_id((uint8_t*) &destination[7 + extended_header + extended_length], bus_id);
+            copy_bus_id(&destination[7 + extended_header + extended_length], bus_id);
             destination[11 + extended_header + extended_length] = _device_id;
           }
         } else if(header & SENDER_INFO_BIT)
           destination[3 + extended_header + extended_length] = _device_id;
 
-        memcpy(destination + (new_length - length - (header & CRC_BIT ? 4 : 1)), source, length);
+        uint8_t meta_length = packet_overhead(header) - (header & CRC_BIT ? 4 : 1);
+        uint8_t reserved = (header & SESSION_BIT ? 2 : 0) +
+          (header & SEGMENTATION_BIT ? 5 : 0) + (header & ACK_MODE_BIT ? 4 : 0);
+        // The context index is written when sent (see compress_context)
+        memset(destination + meta_length - reserved - (extended_header == 2), 0,
+          reserved + (extended_header == 2));
+        return meta_length;
+      };
+
 
-        if(header & CRC_BIT) {
-          uint32_t CRC = compute_crc_32((uint8_t *)destination, new_length - 4);
-          destination[new_length - 4] = (uint32_t)(CRC) >> 24;
-          destination[new_length - 3] = (uint32_t)(CRC) >> 16;
-          destination[new_length - 2] = (uint32_t)(CRC) >>  8;
-          destination[new_length - 1] = (uint32_t)(CRC);
-        } else destination[new_length - 1] = compute_crc_8((uint8_t *)destination, new_length - 1);
+      /* Complete the header configuration for a content of the given length
+         and return the length of the resulting packet: */
 
+      uint16_t compose_header_length(const uint8_t id, uint16_t &header, uint16_t length) const {
+        if(header == NOT_ASSIGNED) header = get_header();
+        if((header & ACK_REQUEST_BIT) && id == BROADCAST)
+          header &= ~(ACK_REQUEST_BIT | ACK_MODE_BIT);
+        // Sequence ids already identify the packets sent again
+        if(header & ACK_MODE_BIT) header &= ~SESSION_BIT;
+        // A context is confirmed by the synchronous acknowledge in shared mode
+        if(
+          !HEADER_CONTEXTS ||
+          (header & (HEADER_BYTE_3_BIT | MODE_BIT | ACK_REQUEST_BIT | ACK_MODE_BIT)) !=
+          (HEADER_BYTE_3_BIT | MODE_BIT | ACK_REQUEST_BIT)
+        ) header &= ~HEADER_BYTE_3_BIT;
+        // Asynchronous acknowledge, reassembly, sessions and contexts need to know the sender
+        if(header & (ACK_MODE_BIT | SEGMENTATION_BIT | SESSION_BIT | HEADER_BYTE_3_BIT))
+          header |= SENDER_INFO_BIT;
+        if(header > 255) header |= EXTEND_HEADER_BIT;
+        if(length > 255) header |= (EXTEND_LENGTH_BIT | CRC_BIT);
+        uint16_t new_length = length + packet_overhead(header);
+
+        if(new_length > 255 && !(header & EXTEND_LENGTH_BIT)) {
+          header |= (EXTEND_LENGTH_BIT | CRC_BIT);
+          new_length = (uint16_t)(length + packet_overhead(header));
+        }
         return new_length;
       };
 
@@ -206,21 +333,103 @@ limitations under the License. */
         const char *packet,
         uint16_t length,
         uint32_t timing,
-        uint16_t header = NOT_ASSIGNED
+        uint16_t header = NOT_ASSIGNED,
+        const uint8_t *segment = NULL
       ) {
-         for(uint8_t i = 0; i < MAX_PACKETS; i++)
-          if(packets[i].state == 0) {
-            if(!(length = compose_packet(id, b_id, packets[i].content, packet, length, header)))
-              return FAIL;
-            packets[i].length = length;
-            packets[i].state = TO_BE_SENT;
-            packets[i].registration = micros();
-            packets[i].timing = timing;
-            return i;
-          }
+        if(!_free_count) {
+          _error(PACKETS_BUFFER_FULL, MAX_PACKETS);
+          return FAIL;
+        }
+        PJON_Packet_Index i = free_slot();
+        if(header == NOT_ASSIGNED) header = send_header();
+      #if PACKET_POOL_LENGTH > 0
+        uint16_t pool_header = header;
+        uint16_t pool_length = compose_header_length(id, pool_header, length);
+        pool_length = frame_length(pool_header, pool_length);
+        if(pool_length >= PACKET_MAX_LENGTH) {
+          _error(CONTENT_TOO_LONG, pool_length);
+          return FAIL;
+        }
+        if(!(packets[i].content = _pool.allocate(pool_length))) {
+          _error(PACKET_POOL_FULL, pool_length);
+          return FAIL;
+        }
+      #endif
+        if(!(length = compose_packet(id, b_id, packets[i].content, packet, length, header, segment))) {
+        #if PACKET_POOL_LENGTH > 0
+          _pool.free(packets[i].content, pool_length);
+          packets[i].content = NULL;
+        #endif
+          return FAIL;
+        }
+      #if PACKET_POOL_LENGTH > 0
+        // A compressed content may need less than the length allocated
+        _pool.shrink(
+          packets[i].content,
+          pool_length,
+          frame_length(packet_header((uint8_t *)packets[i].content), length)
+        );
+      #endif
+        if(packet_header((uint8_t *)packets[i].content) & SESSION_BIT)
+          set_session((uint8_t *)packets[i].content, length, _session_id++);
+        return add_packet(i, length, timing);
+      };
 
-        _error(PACKETS_BUFFER_FULL, MAX_PACKETS);
-        return FAIL;
+
+      /* Add to the send list a packet already composed, for example received
+         from another bus by a router (see PJONRouter.h). It is sent as it is
+         (its parity bytes are computed again if PARITY_BIT is set), if it has
+         ACK_MODE_BIT set it is acknowledged to its sender: */
+
+      uint16_t forward(const uint8_t *packet, uint16_t length, uint32_t timing = 0) {
+        if(!_free_count) {
+          _error(PACKETS_BUFFER_FULL, MAX_PACKETS);
+          return FAIL;
+        }
+        uint16_t frame = frame_length(packet_header(packet), length);
+        if(frame >= PACKET_MAX_LENGTH) {
+          _error(CONTENT_TOO_LONG, length);
+          return FAIL;
+        }
+        PJON_Packet_Index i = free_slot();
+      #if PACKET_POOL_LENGTH > 0
+        if(!(packets[i].content = _pool.allocate(frame))) {
+          _error(PACKET_POOL_FULL, frame);
+          return FAIL;
+        }
+      #endif
+        memcpy(packets[i].content, packet, length);
+        if(frame > length) fec_encode(packet, length, (uint8_t *)packets[i].content + length);
+        return add_packet(i, length, timing);
+      };
+
+
+      /* Get the first free slot of the send list (there must be one): */
+
+      PJON_Packet_Index free_slot() const {
+      #if PJON_SEND_HEAP > 0
+        return _free_slots[_free_first];
+      #else
+        PJON_Packet_Index i = 0;
+        while(packets[i].state) i++;
+        return i;
+      #endif
+      };
+
+
+      /* Take the first free slot of the send list for a packet composed in it: */
+
+      uint16_t add_packet(PJON_Packet_Index i, uint16_t length, uint32_t timing) {
+      #if PJON_SEND_HEAP > 0
+        _free_first = (_free_first + 1 == MAX_PACKETS) ? 0 : _free_first + 1;
+      #endif
+        _free_count--;
+        packets[i].length = length;
+        packets[i].state = TO_BE_SENT;
+        packets[i].registration = micros();
+        packets[i].timing = timing;
+        schedule(i);
+        return i;
       };
 
 
@@ -230,7 +439,27 @@ limitations under the License. */
         return (_shared ? MODE_BIT : 0) |
                (_sender_info ? SENDER_INFO_BIT : 0) |
                (_acknowledge ? ACK_REQUEST_BIT : 0) |
-               (_crc_32 ? CRC_BIT : 0);
+               (_crc_32 ? CRC_BIT : 0) |
+               (_parity ? PARITY_BIT : 0);
+      };
+
+
+      /* Get the header of the packets sent if not specified, including the
+         asynchronous acknowledge, the session id, the compression or the
+         header compression if configured: */
+
+      uint16_t send_header() const {
+        uint16_t header = get_header();
+      #if HEADER_CONTEXTS > 0
+        if(_header_compression) header |= HEADER_BYTE_3_BIT;
+      #endif
+      #if PJON_COMPRESSION > 0
+        if(_compression) header |= DATA_COMP_BIT;
+      #endif
+      #if ASYNC_ACK_PEERS > 0
+        if(_async_acknowledge && _acknowledge && _mode != SIMPLEX) return header | ACK_MODE_BIT;
+      #endif
+        return header | (_session ? SESSION_BIT : 0);
       };
 
 
@@ -238,9 +467,10 @@ limitations under the License. */
          Don't pass any parameter to count all packets
          Pass a device id to count all it's related packets */
 
-      uint8_t get_packets_count(uint8_t device_id = NOT_ASSIGNED) const {
-        uint8_t packets_count = 0;
-        for(uint8_t i = 0; i < MAX_PACKETS; i++) {
+      uint16_t get_packets_count(uint8_t device_id = NOT_ASSIGNED) const {
+        if(device_id == NOT_ASSIGNED) return MAX_PACKETS - _free_count;
+        uint16_t packets_count = 0;
+        for(PJON_Packet_Index i = 0; i < MAX_PACKETS; i++) {
           if(packets[i].state == 0) continue;
           if(device_id == NOT_ASSIGNED || packets[i].content[0] == device_id) packets_count++;
         }
@@ -248,6 +478,86 @@ limitations under the License. */
       };
 
 
+    #if PJON_JITTER_STATS > 0
+
+      /* Get the timing statistics of packets sent repeatedly: */
+
+      const PJON_Jitter &get_jitter() const {
+        return _jitter;
+      };
+
+
+      /* Reset the timing statistics of packets sent repeatedly: */
+
+      void reset_jitter() {
+        _jitter = PJON_Jitter();
+      };
+
+    #endif
+
+
+    #if PJON_RECEPTION_STATS > 0
+
+      /* Get the count of the bytes and packets received and of those directed
+         to other devices and skipped: */
+
+      const PJON_Reception &get_reception() const {
+        return _reception;
+      };
+
+
+      /* Reset the reception statistics: */
+
+      void reset_reception() {
+        _reception = PJON_Reception();
+      };
+
+    #endif
+
+    #if PJON_STATS_DEVICES > 0
+
+      /* Copy the link statistics of the devices packets are sent to or
+         received from in destination (at most max entries), returns the
+         number of entries copied: */
+
+      uint8_t get_stats(PJON_Device_Stats *destination, uint8_t max) const {
+        uint8_t count = 0;
+        for(uint8_t d = 0; d < PJON_STATS_DEVICES && count < max; d++)
+          if(_stats[d].used) destination[count++] = _stats[d];
+        return count;
+      };
+
+
+      /* Get the link statistics of a device (NULL if not present), pass its
+         bus id in shared mode: */
+
+      const PJON_Device_Stats *get_device_stats(uint8_t id, const uint8_t *b_id = NULL) const {
+        if(!b_id) b_id = localhost;
+        for(uint8_t d = 0; d < PJON_STATS_DEVICES; d++)
+          if(_stats[d].used && _stats[d].id == id && bus_id_equality(_stats[d].bus_id, b_id))
+            return &_stats[d];
+        return NULL;
+      };
+
+
+      /* Reset the link statistics: */
+
+      void reset_stats() {
+        for(uint8_t d = 0; d < PJON_STATS_DEVICES; d++) _stats[d] = PJON_Device_Stats();
+      };
+
+    #endif
+
+    #if PACKET_POOL_LENGTH > 0
+
+      /* Get the packet pool, to check its memory utilization: */
+
+      const PJON_Packet_Pool<PACKET_POOL_LENGTH, PACKET_POOL_BLOCK> &get_packet_pool() const {
+        return _pool;
+      };
+    #endif
+
+
       /* Calculate the packet's overhead: */
 
       uint8_t packet_overhead(uint16_t header = NOT_ASSIGNED) const {
@@ -261,17 +571,38 @@ limitations under the License. */
           ) + (header & EXTEND_LENGTH_BIT  ?  2 : 1)
             + (header & EXTEND_HEADER_BIT  ?  2 : 1)
             + (header & CRC_BIT            ?  4 : 1)
+            + (header & ACK_MODE_BIT       ?  4 : 0)
+            + (header & SEGMENTATION_BIT   ?  5 : 0)
+            + (header & SESSION_BIT        ?  2 : 0)
+            + (header & HEADER_BYTE_3_BIT  ?  2 : 0) // Third header byte and context index
         );
       };
 
 
+      /* Get the header of a packet (2 bytes if EXTEND_HEADER_BIT is set, the
+         third byte is read by the context functions): */
+
+      uint16_t packet_header(const uint8_t *packet) const {
+        return (packet[1] & EXTEND_HEADER_BIT) ? packet[2] << 8 | packet[1] : packet[1];
+      };
+
+
+      /* Get the number of header bytes of a packet, 3 if EXTEND_HEADER_BIT
+         and HEADER_BYTE_3_BIT are set: */
+
+      uint8_t header_length(const uint8_t *packet) const {
+        if(!(packet[1] & EXTEND_HEADER_BIT)) return 1;
+        return (packet[2] & (HEADER_BYTE_3_BIT >> 8)) ? 3 : 2;
+      };
+
+
       /* Fill in a PacketInfo struct by parsing a packet: */
 
       void parse(const uint8_t *packet, PacketInfo &packet_info) const {
         packet_info.receiver_id = packet[0];
-        bool extended_header = packet[1] & EXTEND_HEADER_BIT;
+        uint8_t extended_header = header_length(packet) - 1;
         bool extended_length = packet[1] & EXTEND_LENGTH_BIT;
-        packet_info.header = (extended_header) ? packet[2] << 8 | packet[1] : packet[1];
+        packet_info.header = packet_header(packet);
         if((packet_info.header & MODE_BIT) != 0) {
           copy_bus_id(packet_info.receiver_bus_id, packet + 3 + extended_header + extended_length);
           if((packet_info.header & SENDER_INFO_BIT) != 0) {
@@ -283,86 +614,1130 @@ limitations under the License. */
       };
 
 
-      uint16_t receive() {
-        uint16_t state;
-        uint16_t length = PACKET_MAX_LENGTH;
-        bool CRC = 0;
-        bool extended_header = false;
-        bool extended_length = false;
-        for(uint16_t i = 0; i < length; i++) {
-          data[i] = state = strategy.receive_byte();
-          if(state == FAIL) return FAIL;
+      /* Receive a packet (see receive_packet), noting that the receiver and
+         route handlers are being called so send_packet_blocking does not
+         receive again while they use data. It is virtual so the receptions
+         of PJON (receive(duration) and the back-off of send_packet_blocking)
+         call the receive of PJONSlave and PJONMaster, that deliver the
+         packets to their own receiver: */
+
+      virtual uint16_t receive() {
+        boolean receiving = _receiving;
+        _receiving = true;
+        uint16_t state = receive_packet();
+        _receiving = receiving;
+        return state;
+      };
+
+
+      /* Receive a packet:
+         The CRC is rolled forward while bytes are received, so the synchronous
+         acknowledge can be sent right after the last byte is received. If the
+         strategy delivers whole frames (receive_frame) the packet is received
+         with a single call and checked in one pass. */
+
+      uint16_t receive_packet() {
+      #if ASYNC_ACK_PEERS > 0
+        if(_pending_acknowledges) send_asynchronous_acknowledges();
+      #endif
+        uint16_t length = PACKET_MAX_LENGTH;
+        bool CRC = false;
+        uint16_t state =
+          receive_frame(length, CRC, typename PJON_Supports_Frames<Strategy>::type());
+        if(state != ACK) return state;
+      #if PJON_RECEPTION_STATS > 0
+        _reception.parsed += length;
+        _reception.parsed_packets++;
+      #endif
+        bool accepted = CRC;
+        if(CRC) {
+          parse(data, last_packet_info);
+          record_reception(length);
+          // A context index used by a device of another bus is refused
+          if(!receive_context()) accepted = false;
+        }
+        if(CRC && _router && _route_handler)
+          if(_route_handler(data, length, last_packet_info, _route_pointer)) {
+            if(
+              (data[1] & ACK_REQUEST_BIT) && !(data[1] & ACK_MODE_BIT) &&
+              data[0] != BROADCAST && _mode != SIMPLEX
+            ) strategy.send_response(ACK);
+            return ACK;
+          }
+        bool segment = CRC && (last_packet_info.header & SEGMENTATION_BIT) && !_router;
+        PJON_Session_Peer *session_peer = NULL;
+        uint16_t session = 0;
+        bool duplicate = CRC && duplicate_session(session_peer, session);
+        // Segments that can not be reassembled now are refused and sent again
+        if(segment && !duplicate && !(data[1] & ACK_MODE_BIT)) accepted = accept_segment(length);
+        uint8_t overhead = packet_overhead(last_packet_info.header);
+        uint8_t *payload = data + overhead - (data[1] & CRC_BIT ? 4 : 1);
+        uint16_t payload_length = length - overhead;
+        // Compressed contents are refused if not valid or not supported
+        if(CRC && !duplicate && !_router && (last_packet_info.header & DATA_COMP_BIT)) {
+        #if PJON_COMPRESSION > 0
+          payload_length = lz_decompress(
+            payload, payload_length, _decompressed,
+            PACKET_MAX_LENGTH, _dictionary, _dictionary_length
+          );
+          payload = _decompressed;
+          if(!payload_length) accepted = false;
+        #else
+          accepted = false;
+        #endif
+        }
+
+        if(
+          data[1] & ACK_REQUEST_BIT && !(data[1] & ACK_MODE_BIT) &&
+          data[0] != BROADCAST && _mode != SIMPLEX && !_router
+        ) if(!foreign_packet(data)) strategy.send_response(!accepted ? NAK : ACK);
+
+        if(!CRC) return NAK;
+        if(duplicate) return ACK; // Acknowledged again, not delivered again
+      #if ASYNC_ACK_PEERS > 0
+        PJON_Async_Peer *peer = NULL;
+        uint16_t sequence = 0;
+        if((data[1] & ACK_MODE_BIT) && data[0] != BROADCAST && !_router) {
+          if(!receive_asynchronous(length, peer)) return ACK; // Acknowledge or duplicate
+          sequence = get_sequence(data);
+          if(segment) accepted = accept_segment(length);
+        }
+      #else
+        if((data[1] & ACK_MODE_BIT) && data[0] != BROADCAST && !_router) return NAK;
+      #endif
+        if(!accepted) return NAK;
+
+        if(segment) receive_segment(payload, payload_length);
+        else {
+          last_packet_info.payload_offset = 0;
+          last_packet_info.payload_length = payload_length;
+          _receiver(payload, payload_length, last_packet_info);
+        }
+      #if ASYNC_ACK_PEERS > 0
+        if(peer) receive_sequence(*peer, sequence);
+      #endif
+        if(session_peer) receive_session(*session_peer, session);
+        return ACK;
+      };
+
+
+      /* Receive a packet in data byte by byte. If it is directed to another
+         device its length is read anyway and its remaining bytes are
+         discarded, so they are not parsed as new packets. Returns ACK if a
+         packet is received (CRC is set if it is correct), FAIL if not
+         received or BUSY if directed to another device. A packet having
+         PARITY_BIT is received whole with its parity bytes and corrected
+         before its receiver and its CRC are checked: */
+
+      uint16_t receive_frame(uint16_t &length, bool &CRC, PJON_Bool<false>) {
+        uint16_t state;
+        bool CRC_32 = false;
+        uint8_t CRC_8_state = 0;
+        uint32_t CRC_32_state = 0xFFFFFFFF;
+        uint8_t extended_header = 0;
+        bool extended_length = false;
+        bool foreign = false;
+        bool compressed = false;
+        uint16_t parity = 0;
+        for(uint16_t i = 0; i < length + parity; i++) {
+          data[i] = state = strategy.receive_byte();
+          if(state == FAIL) {
+          #if PJON_RECEPTION_STATS > 0
+            if(foreign) _reception.skipped += i; // A response or a truncated packet
+          #endif
+            return FAIL;
+          }
+
+          if(i == 0)
+            if(data[i] != _device_id && data[i] != BROADCAST && !_router)
+              foreign = true;
+
+          if(i == 1) {
+            extended_length = data[i] & EXTEND_LENGTH_BIT;
+            extended_header = (data[i] & EXTEND_HEADER_BIT) != 0;
+            CRC_32 = data[i] & CRC_BIT;
+            if(CRC_32) CRC_32_state = roll_crc_32(data[0], CRC_32_state);
+          }
+
+          if(i == 2 && extended_header && (data[i] & (HEADER_BYTE_3_BIT >> 8)))
+            extended_header = 2;
+
+          if(i == (2 + extended_header + extended_length)) {
+            length = extended_length ? (data[i - 1] << 8) | data[i] : data[i];
+            if(length < 5) return FAIL;
+            uint16_t header = packet_header(data);
+            if(extended_header == 2) {
+              compressed = data[3] & CONTEXT_ONLY_BIT;
+              if(!context_supported(data)) foreign = true;
+            } else if(((data[1] & MODE_BIT) != _shared) && !_router) foreign = true;
+            parity = frame_length(header, length) - length;
+            if(foreign && !parity) return skip_packet(i + 1, length);
+            if(length + parity > PACKET_MAX_LENGTH)
+              return foreign ? skip_packet(i + 1, length + parity) : FAIL;
+          }
+
+          if(_shared && (data[1] & MODE_BIT) && !_router && !parity && !compressed)
+            if((i > (2 + extended_header + extended_length)))
+              if((i < (7 + extended_header + extended_length)))
+                if(bus_id[i - 3 - extended_header - extended_length] != data[i])
+                  return skip_packet(i + 1, length);
+
+          // A context not received from its sender belongs to another bus
+          if(compressed && !parity && i == (4 + extended_header + extended_length))
+            if(!received_context(data)) return skip_packet(i + 1, length);
+
+          if(!CRC_32) CRC_8_state = roll_crc_8(data[i], CRC_8_state);
+          else if(i < length - 4) CRC_32_state = roll_crc_32(data[i], CRC_32_state);
+        }
+
+        if(parity || compressed) {
+          if(parity) correct(length);
+          if(foreign_packet(data)) return skip_packet(length + parity, length + parity);
+          return receive_compressed(length, CRC);
+        }
+        if(CRC_32)
+          CRC = ~CRC_32_state == (
+            (uint32_t)data[length - 4] << 24 |
+            (uint32_t)data[length - 3] << 16 |
+            (uint32_t)data[length - 2] <<  8 |
+            (uint32_t)data[length - 1]
+          );
+        else CRC = !CRC_8_state;
+        return ACK;
+      };
+
+
+      /* Receive a whole frame in data with a single strategy call, then
+         filter and check it in one pass (see PJON_Supports_Frames): */
+
+      uint16_t receive_frame(uint16_t &length, bool &CRC, PJON_Bool<true>) {
+        uint16_t received = strategy.receive_frame(data, PACKET_MAX_LENGTH);
+        if(received == FAIL || received < 5) return FAIL;
+        uint8_t extended_header = header_length(data) - 1;
+        bool extended_length = data[1] & EXTEND_LENGTH_BIT;
+        length = extended_length ?
+          data[2 + extended_header] << 8 | data[3 + extended_header] :
+          data[2 + extended_header];
+        uint16_t frame = frame_length(packet_header(data), length);
+        // received can be longer than the bytes copied (PACKET_MAX_LENGTH)
+        bool valid = length >= 5 && frame <= PACKET_MAX_LENGTH && frame <= received;
+        if(valid && frame > length) correct(length);
+        if(foreign_packet(data)) return skip_packet(received, received);
+        if(!valid) return FAIL;
+        return receive_compressed(length, CRC);
+      };
+
+
+      /* Check the CRC of the packet received in data. A packet received
+         without the bus ids (CONTEXT_ONLY_BIT) has them restored from its
+         context before, its CRC is computed including them, so if the
+         context is of another device the packet is skipped without
+         response: */
+
+      uint16_t receive_compressed(uint16_t &length, bool &CRC) {
+      #if HEADER_CONTEXTS > 0
+        if(header_length(data) == 3 && (data[3] & CONTEXT_ONLY_BIT)) {
+          const PJON_Context *context = received_context(data);
+          if(!context || length + 8 > PACKET_MAX_LENGTH) return skip_packet(length, length);
+          uint8_t offset = 2 + header_length(data) + ((data[1] & EXTEND_LENGTH_BIT) != 0);
+          memmove(data + offset + 8, data + offset, length - offset);
+          copy_bus_id(data + offset, bus_id);
+          copy_bus_id(data + offset + 4, context->bus_id);
+          data[3] &= ~CONTEXT_ONLY_BIT;
+          write_length(data, length += 8);
+          if(!check_crc(data, length)) return skip_packet(length, length);
+        }
+      #endif
+        CRC = check_crc(data, length);
+        return ACK;
+      };
+
+
+      /* True if the packet in data is directed to another device or bus: */
+
+      bool foreign_packet(const uint8_t *packet) const {
+        if(header_length(packet) == 3) { // Contexts are not routed
+          if(!context_supported(packet) || packet[0] != _device_id) return true;
+          if(packet[3] & CONTEXT_ONLY_BIT) return !received_context(packet);
+        } else {
+          if(_router) return false;
+          if(packet[0] != _device_id && packet[0] != BROADCAST) return true;
+          if((packet[1] & MODE_BIT) != _shared) return true;
+        }
+        return _shared && (packet[1] & MODE_BIT) && !bus_id_equality(
+          packet + 2 + header_length(packet) + ((packet[1] & EXTEND_LENGTH_BIT) != 0), bus_id
+        );
+      };
+
+
+      /* Correct the packet of length bytes in data with the parity bytes
+         following it: */
+
+      void correct(uint16_t length) {
+        int16_t corrected = fec_decode(data, length, data + length);
+      #if PJON_RECEPTION_STATS > 0
+        if(corrected > 0) _reception.corrected += corrected;
+      #else
+        (void)corrected;
+      #endif
+      };
+
+
+      /* Discard the remaining bytes of a packet directed to another device,
+         received bytes of length are already received. Stops if no byte is
+         received, so a corrupted length can not stall the reception: */
+
+      uint16_t skip_packet(uint16_t received, uint16_t length) {
+        while(received < length && strategy.receive_byte() != FAIL) received++;
+      #if PJON_RECEPTION_STATS > 0
+        _reception.skipped += received;
+        _reception.skipped_packets++;
+      #endif
+        return BUSY;
+      };
+
+
+      /* Try to receive a packet repeatedly with a maximum duration, if
+         the strategy can wait for data (wait) it is called when nothing is
+         received, so the CPU is not kept busy: */
+
+      uint16_t receive(uint32_t duration) {
+        uint16_t response;
+        uint32_t time = micros();
+        while((uint32_t)(micros() - time) <= duration) {
+          response = receive();
+          if(response == ACK)
+            return ACK;
+          uint32_t elapsed = micros() - time;
+          if(response == FAIL && elapsed < duration)
+            wait(duration - elapsed, typename PJON_Supports_Wait<Strategy>::type());
+        }
+        return response;
+      };
+
+      void wait(uint32_t duration, PJON_Bool<true>) {
+        strategy.wait(duration);
+      };
+
+      void wait(uint32_t duration, PJON_Bool<false>) { };
+
+
+      /* Asynchronous acknowledge (ACK_MODE_BIT):
+         Packets include 4 bytes before the content: their sequence id, set
+         at their first transmission, and the oldest sequence id sent to the
+         same receiver and not acknowledged (sequence ids are counted for each
+         receiver). Instead of waiting for a response, up to the window of
+         packets per receiver are sent and wait in the send list to be
+         acknowledged. The receiver delivers each sequence id once and
+         responds with a packet with ACK_MODE_BIT set and ACK_REQUEST_BIT not
+         set, including the sequence id it expects (cumulative acknowledge)
+         and as content a 32 bits bitmap of the following ones received
+         (selective acknowledge). Packets not acknowledged within
+         ASYNC_ACK_TIMEOUT are sent again. */
+
+      bool asynchronous(const char *packet) const {
+        if((packet[1] & (ACK_MODE_BIT | ACK_REQUEST_BIT)) != (ACK_MODE_BIT | ACK_REQUEST_BIT))
+          return false;
+        // Packets forwarded by a router are acknowledged to their sender
+        PacketInfo info;
+        parse((const uint8_t *)packet, info);
+        return info.sender_id == _device_id &&
+          (!(info.header & MODE_BIT) || bus_id_equality(info.sender_bus_id, bus_id));
+      };
+
+
+    #if ASYNC_ACK_PEERS > 0
+
+      /* Handle a received packet with ACK_MODE_BIT set, returns true if it
+         has to be delivered (so if it is not an acknowledge or a duplicate),
+         once delivered its sequence id is registered with receive_sequence: */
+
+      bool receive_asynchronous(uint16_t length, PJON_Async_Peer *&peer) {
+        if(!(data[1] & SENDER_INFO_BIT)) return true;
+        const uint8_t *b_id = sender_bus_id();
+        uint16_t sequence = get_sequence(data);
+        if(!(data[1] & ACK_REQUEST_BIT)) {
+          uint8_t overhead = packet_overhead(last_packet_info.header);
+          const uint8_t *content = data + overhead - (data[1] & CRC_BIT ? 4 : 1);
+          uint32_t received = 0;
+          if(length - overhead >= 4)
+            received = (uint32_t)content[0] << 24 | (uint32_t)content[1] << 16 |
+                       (uint32_t)content[2] <<  8 | (uint32_t)content[3];
+          receive_acknowledge(last_packet_info.sender_id, b_id, sequence, received);
+          return false;
+        }
+        peer = get_peer(last_packet_info.sender_id, b_id, true);
+        if(new_sequence(*peer, sequence, get_sequence(data, 2))) return true;
+        // Duplicates are acknowledged again, the previous acknowledge may be lost
+        acknowledge_sequence(*peer);
+        peer = NULL;
+        return false;
+      };
+
+
+      /* Check if a sequence id was not received yet. The sender's oldest
+         sequence id not acknowledged (base) moves the expected sequence id
+         forward, if it is far behind the sender restarted: */
+
+      bool new_sequence(PJON_Async_Peer &peer, uint16_t sequence, uint16_t base) {
+        int16_t advance = base - peer.expected;
+        if(!peer.receiving || advance < -32) {
+          peer.expected = base;
+          peer.received = 0;
+          peer.receiving = true;
+        } else if(advance > 0) {
+          peer.received = (advance < 32) ? peer.received >> advance : 0;
+          peer.expected = base;
+        }
+        uint16_t offset = sequence - peer.expected;
+        return (int16_t)offset >= 0 && offset < 32 && !((peer.received >> offset) & 1);
+      };
+
+
+      /* Register a sequence id received and acknowledge it: */
+
+      void receive_sequence(PJON_Async_Peer &peer, uint16_t sequence) {
+        peer.received |= (uint32_t)1 << (uint16_t)(sequence - peer.expected);
+        while(peer.received & 1) {
+          peer.received >>= 1;
+          peer.expected++;
+        }
+        acknowledge_sequence(peer);
+      };
+
+
+      void acknowledge_sequence(PJON_Async_Peer &peer) {
+        if(_mode == SIMPLEX) return;
+        peer.acknowledge = _pending_acknowledges = true;
+        send_asynchronous_acknowledges();
+      };
+
+
+      /* Handle an acknowledge: packets preceding the expected sequence id or
+         with their bit set in the received bitmap are delivered: */
+
+      void receive_acknowledge(uint8_t id, const uint8_t *b_id, uint16_t expected, uint32_t received) {
+        PJON_Async_Peer *peer = get_peer(id, b_id, false);
+        if(!peer) return;
+        for(uint16_t sequence = peer->oldest; sequence != peer->sequence; sequence++) {
+          PJON_Packet_Index i = window_packet(*peer, sequence);
+          if(i == MAX_PACKETS) continue;
+          int16_t offset = sequence - expected;
+          if(offset < 0 || (offset > 0 && offset <= 32 && ((received >> (offset - 1)) & 1)))
+            update_packet_state(i, ACK);
+        }
+        update_oldest(*peer);
+      #if PJON_SEND_HEAP > 0
+        /* Packets waiting for the window to move forward can be sent, they
+           are scheduled in the order they were dispatched (as due at their
+           registration) so none of them is starved by the following ones */
+        if(!peer->blocked) return;
+        peer->blocked = false;
+        uint32_t now = micros();
+        for(PJON_Packet_Index i = 0; i < MAX_PACKETS; i++)
+          if(
+            packets[i].state == TO_BE_SENT && _queue_position[i] != MAX_PACKETS &&
+            asynchronous(packets[i].content) && sent_to(i, *peer)
+          ) {
+            uint32_t elapsed = now - packets[i].registration;
+            schedule_at(i, now - ((elapsed > MAX_SCHEDULE_INTERVAL) ? MAX_SCHEDULE_INTERVAL : elapsed));
+          }
+      #endif
+      };
+
+
+      /* Send the acknowledges waiting to be sent, if the medium is busy they
+         are sent by the next receive() call: */
+
+      void send_asynchronous_acknowledges() {
+        _pending_acknowledges = false;
+        for(uint8_t p = 0; p < ASYNC_ACK_PEERS; p++) {
+          if(!_peers[p].acknowledge) continue;
+          if(send_asynchronous_acknowledge(_peers[p]) == BUSY) _pending_acknowledges = true;
+          else _peers[p].acknowledge = false;
+        }
+      };
+
+      uint16_t send_asynchronous_acknowledge(const PJON_Async_Peer &peer) {
+        uint8_t packet[30];
+        uint8_t received[4] = {
+          (uint8_t)(peer.received >> 25),
+          (uint8_t)(peer.received >> 17),
+          (uint8_t)(peer.received >>  9),
+          (uint8_t)(peer.received >>  1)
+        };
+        uint16_t header = ACK_MODE_BIT | SENDER_INFO_BIT |
+          (_shared ? MODE_BIT : 0) | (_crc_32 ? CRC_BIT : 0);
+        uint16_t length = compose_header_length(peer.id, header, 4);
+        if(length > sizeof(packet)) return FAIL;
+        memcpy(packet + compose_header(peer.id, peer.bus_id, packet, header, length), received, 4);
+        set_sequence(packet, length, peer.expected, 0);
+        if(!acquire()) return BUSY;
+        strategy.send_string(packet, length);
+        return ACK;
+      };
+
+
+      /* Get the sequence state of a device, if create is true and the device
+         is not known it is added replacing the least recently added: */
+
+      PJON_Async_Peer *get_peer(uint8_t id, const uint8_t *b_id, bool create) {
+        PJON_Async_Peer *peer = NULL;
+        for(uint8_t p = 0; p < ASYNC_ACK_PEERS; p++) {
+          if(_peers[p].id == id && bus_id_equality(_peers[p].bus_id, b_id)) return &_peers[p];
+          if(!peer && _peers[p].id == BROADCAST) peer = &_peers[p];
+        }
+        if(!create) return NULL;
+        if(!peer) {
+          peer = &_peers[_peers_next];
+          _peers_next = (_peers_next + 1 == ASYNC_ACK_PEERS) ? 0 : _peers_next + 1;
+        }
+        *peer = PJON_Async_Peer();
+        peer->id = id;
+        copy_bus_id(peer->bus_id, b_id);
+        // A random first sequence id lets the receiver detect a restart
+        peer->sequence = peer->oldest = random(0x10000);
+        return peer;
+      };
+
+
+      /* Move the window of a device forward to the oldest sequence id sent
+         not acknowledged: */
+
+      void update_oldest(PJON_Async_Peer &peer) {
+        while(peer.oldest != peer.sequence && window_packet(peer, peer.oldest) == MAX_PACKETS) {
+          peer.first = (peer.first + 1 == ASYNC_ACK_WINDOW) ? 0 : peer.first + 1;
+          peer.oldest++;
+        }
+      };
+
+
+      /* Position in the window of a device of a sequence id sent: */
+
+      uint8_t window_position(const PJON_Async_Peer &peer, uint16_t sequence) const {
+        uint16_t position = peer.first + (uint16_t)(sequence - peer.oldest);
+        return (position >= ASYNC_ACK_WINDOW) ? position - ASYNC_ACK_WINDOW : position;
+      };
+
+
+      /* Get the packet waiting for the acknowledge of a sequence id sent to
+         a device, MAX_PACKETS if it was acknowledged, removed or is sent
+         again with another sequence id (the slot may be used by another): */
+
+      PJON_Packet_Index window_packet(const PJON_Async_Peer &peer, uint16_t sequence) const {
+        PJON_Packet_Index i = peer.sent[window_position(peer, sequence)];
+        if(
+          !packets[i].state || packets[i].state == TO_BE_SENT ||
+          !asynchronous(packets[i].content) || !sent_to(i, peer) ||
+          get_sequence((uint8_t *)packets[i].content) != sequence
+        ) return MAX_PACKETS;
+        return i;
+      };
+
+
+      /* Check if the window of packets sent to a device and waiting to be
+         acknowledged has room for another packet: */
+
+      bool in_window(PJON_Async_Peer &peer) {
+        if((uint16_t)(peer.sequence - peer.oldest) < _async_window) return true;
+        update_oldest(peer);
+        return (uint16_t)(peer.sequence - peer.oldest) < _async_window;
+      };
+
+
+      /* Check if a packet is directed to a device: */
+
+      bool sent_to(PJON_Packet_Index i, const PJON_Async_Peer &peer) const {
+        return (uint8_t)packets[i].content[0] == peer.id &&
+          bus_id_equality(receiver_bus_id(packets[i].content), peer.bus_id);
+      };
+
+    #endif
+
+
+      /* Get the bus id of a packet's receiver (localhost if local): */
+
+      const uint8_t *receiver_bus_id(const char *packet) const {
+        if(!(packet[1] & MODE_BIT)) return localhost;
+        return (uint8_t *)packet + 2 + header_length((uint8_t *)packet) +
+          ((packet[1] & EXTEND_LENGTH_BIT) != 0);
+      };
+
+
+      /* Get (offset 0) a packet's sequence id or (offset 2) the oldest
+         sequence id not acknowledged: */
+
+      uint16_t get_sequence(const uint8_t *packet, uint8_t offset = 0) const {
+        const uint8_t *sequence =
+          packet + packet_overhead(packet_header(packet)) - (packet[1] & CRC_BIT ? 4 : 1) - 4 + offset;
+        return sequence[0] << 8 | sequence[1];
+      };
+
+
+      /* Set the sequence ids of a composed packet and update its CRC: */
+
+      void set_sequence(uint8_t *packet, uint16_t length, uint16_t sequence, uint16_t oldest) const {
+        uint8_t *destination =
+          packet + packet_overhead(packet_header(packet)) - (packet[1] & CRC_BIT ? 4 : 1) - 4;
+        destination[0] = sequence >> 8;
+        destination[1] = sequence;
+        destination[2] = oldest >> 8;
+        destination[3] = oldest;
+        compose_crc(packet, length);
+      };
+
+
+      /* Session id (SESSION_BIT):
+         Packets include 2 bytes before the segment info and the sequence
+         ids: a session id incremented by the transmitter for each packet, so
+         a packet sent again because its acknowledge was lost has the same.
+         The receiver remembers the last 32 session ids of SESSION_PEERS
+         senders (the least recently used is replaced): packets already
+         received are acknowledged again but not delivered again. */
+
+      uint8_t *session_info(uint8_t *packet) const {
+        uint16_t header = packet_header(packet);
+        return packet + packet_overhead(header) - (header & CRC_BIT ? 4 : 1) -
+          (header & ACK_MODE_BIT ? 4 : 0) - (header & SEGMENTATION_BIT ? 5 : 0) - 2;
+      };
+
+
+      /* Set the session id of a composed packet and update its CRC: */
+
+      void set_session(uint8_t *packet, uint16_t length, uint16_t session) const {
+        uint8_t *destination = session_info(packet);
+        destination[0] = session >> 8;
+        destination[1] = session;
+        compose_crc(packet, length);
+      };
+
+
+    #if SESSION_PEERS > 0
+
+      /* Check if the packet received was already delivered, if not and it
+         has a session id peer is set to register it with receive_session
+         once delivered: */
+
+      bool duplicate_session(PJON_Session_Peer *&peer, uint16_t &session) {
+        if((last_packet_info.header & (SESSION_BIT | SENDER_INFO_BIT)) != (SESSION_BIT | SENDER_INFO_BIT))
+          return false;
+        const uint8_t *info = session_info(data);
+        session = info[0] << 8 | info[1];
+        peer = get_session_peer(last_packet_info.sender_id, sender_bus_id());
+        uint16_t offset = peer->last - session;
+        if(offset < 32 && ((peer->received >> offset) & 1)) {
+          peer = NULL;
+          return true;
+        }
+        return false;
+      };
+
+
+      /* Register a session id delivered. Session ids far from the last one
+         (the sender restarted) start again the window: */
+
+      void receive_session(PJON_Session_Peer &peer, uint16_t session) {
+        uint16_t offset = peer.last - session;
+        if(offset < 32) peer.received |= (uint32_t)1 << offset;
+        else {
+          uint16_t advance = session - peer.last;
+          peer.received = (advance < 32 && peer.received) ? (peer.received << advance) | 1 : 1;
+          peer.last = session;
+        }
+      };
+
+
+      /* Get the session state of a sender, replacing one not used or the
+         least recently used, so the senders sending often are not replaced
+         by the occasional ones: */
+
+      PJON_Session_Peer *get_session_peer(uint8_t id, const uint8_t *b_id) {
+        PJON_Session_Peer *peer = &_session_peers[0];
+        _session_use++;
+        for(uint8_t p = 0; p < SESSION_PEERS; p++) {
+          PJON_Session_Peer &candidate = _session_peers[p];
+          if(candidate.id == id && bus_id_equality(candidate.bus_id, b_id)) {
+            candidate.use = _session_use;
+            return &candidate;
+          }
+          if(peer->id == BROADCAST) continue;
+          if(
+            candidate.id == BROADCAST ||
+            (uint16_t)(_session_use - candidate.use) > (uint16_t)(_session_use - peer->use)
+          ) peer = &candidate;
+        }
+        *peer = PJON_Session_Peer();
+        peer->id = id;
+        copy_bus_id(peer->bus_id, b_id);
+        peer->use = _session_use;
+        return peer;
+      };
+
+    #else
+
+      /* Duplicates are not detected if SESSION_PEERS is 0: */
+
+      bool duplicate_session(PJON_Session_Peer *&peer, uint16_t &session) { return false; };
+
+      void receive_session(PJON_Session_Peer &peer, uint16_t session) { };
+
+    #endif
+
+
+      /* Header compression (HEADER_BYTE_3_BIT):
+         In shared mode the bus ids and the sender id take 9 bytes of each
+         packet. A packet having the third header byte with CONTEXT_BIT is
+         followed by a context index, proposed by the sender and unique
+         among its receivers. The receiver refuses (NAK) an index it already
+         uses for the same sender id of another bus, the sender proposes
+         another one. When the receiver acknowledges the proposal the next
+         packets are transmitted with CONTEXT_ONLY_BIT and without the bus
+         ids, the receiver identifies them by sender id and context index
+         and restores the bus ids before checking the CRC (it is computed
+         including them). Packets are kept in the send list with the bus
+         ids, so if a packet without them is not acknowledged (the receiver
+         may have forgotten the context) it is sent with them again. A
+         device not supporting contexts reads the third header byte as
+         length and skips the packet, if the proposal is not acknowledged
+         and the packet sent without context is, the receiver is remembered
+         and no other proposal is sent to it. */
+
+      bool context_supported(const uint8_t *packet) const {
+        return HEADER_CONTEXTS && _shared && !_router && packet[0] != BROADCAST &&
+          (packet[1] & (MODE_BIT | SENDER_INFO_BIT)) == (MODE_BIT | SENDER_INFO_BIT) &&
+          (packet[3] & ~(CONTEXT_BIT | CONTEXT_ONLY_BIT)) == 0 && (packet[3] & CONTEXT_BIT);
+      };
+
+
+      /* Get the bus ids of a packet having the third header byte, followed
+         by its sender id and its context index (see compose_header). If
+         the bus ids are not included the sender id and the context index: */
+
+      uint8_t *context_info(const uint8_t *packet) const {
+        return (uint8_t *)packet + 5 + ((packet[1] & EXTEND_LENGTH_BIT) != 0);
+      };
+
+
+      /* Context of the sender of a packet received without the bus ids,
+         NULL if not received: */
+
+      const PJON_Context *received_context(const uint8_t *packet) const {
+      #if HEADER_CONTEXTS > 0
+        const uint8_t *info = context_info(packet); // Sender id and context index
+        for(uint8_t c = 0; c < HEADER_CONTEXTS; c++)
+          if(_received_contexts[c].id == info[0] && _received_contexts[c].index == info[1])
+            return &_received_contexts[c];
+      #endif
+        (void)packet;
+        return NULL;
+      };
+
+
+      /* Remember the context of the packet received in data, replacing the
+         one of the same device or if not present the least recently added.
+         Returns false if its index is used by the same sender id of another
+         bus: */
+
+      bool receive_context() {
+      #if HEADER_CONTEXTS > 0
+        if(!(last_packet_info.header & HEADER_BYTE_3_BIT) || _router) return true;
+        const uint8_t *info = context_info(data);
+        PJON_Context *entry = NULL;
+        for(uint8_t c = 0; c < HEADER_CONTEXTS; c++) {
+          PJON_Context &context = _received_contexts[c];
+          if(context.id == info[8] && context.index == info[9])
+            return bus_id_equality(context.bus_id, info + 4);
+          if(context.id == info[8] && bus_id_equality(context.bus_id, info + 4)) entry = &context;
+          if(!entry && context.id == BROADCAST) entry = &context;
+        }
+        if(!entry) {
+          entry = &_received_contexts[_received_contexts_next];
+          _received_contexts_next =
+            (_received_contexts_next + 1 == HEADER_CONTEXTS) ? 0 : _received_contexts_next + 1;
+        }
+        entry->id = info[8];
+        copy_bus_id(entry->bus_id, info + 4);
+        entry->index = info[9];
+      #endif
+        return true;
+      };
+
+    #if HEADER_CONTEXTS > 0
+
+      /* Context of the receiver of a packet composed by this device with
+         HEADER_BYTE_3_BIT, added if not present replacing the least recently
+         added, NULL if the packet has no context: */
+
+      PJON_Context *sent_context(const uint8_t *packet) {
+        if(header_length(packet) != 3 || packet[0] == BROADCAST) return NULL;
+        const uint8_t *info = context_info(packet);
+        if(info[8] != _device_id || !bus_id_equality(info + 4, bus_id)) return NULL;
+        uint8_t free = HEADER_CONTEXTS;
+        for(uint8_t c = 0; c < HEADER_CONTEXTS; c++) {
+          if(_sent_contexts[c].id == packet[0] && bus_id_equality(_sent_contexts[c].bus_id, info))
+            return &_sent_contexts[c];
+          if(free == HEADER_CONTEXTS && _sent_contexts[c].id == BROADCAST) free = c;
+        }
+        if(free == HEADER_CONTEXTS) {
+          free = _sent_contexts_next;
+          _sent_contexts_next = (_sent_contexts_next + 1 == HEADER_CONTEXTS) ? 0 : _sent_contexts_next + 1;
+        }
+        PJON_Context &context = _sent_contexts[free];
+        context.id = packet[0];
+        copy_bus_id(context.bus_id, info);
+        context.index = free; // Unique among the receivers of this device
+        context.state = CONTEXT_PROPOSED;
+        return &context;
+      };
+
+
+      /* Transform a packet of the send list in the form its receiver's
+         context requires (saving the bytes removed in saved), returns its
+         length: with the bus ids replaced by the context index if confirmed,
+         without context if not supported, as it is if proposed: */
+
+      uint16_t compress_context(
+        uint8_t *packet,
+        uint16_t length,
+        const PJON_Context &context,
+        uint8_t *saved
+      ) const {
+        uint8_t *info = context_info(packet);
+        if(info[9] != context.index) {
+          info[9] = context.index;
+          compose_crc(packet, length);
+        }
+        if(context.state == CONTEXT_CONFIRMED) { // The CRC includes the bus ids
+          memcpy(saved, info, 8);
+          memmove(info, info + 8, length - (info - packet) - 8);
+          packet[3] |= CONTEXT_ONLY_BIT;
+          write_length(packet, length - 8);
+          if(packet_header(packet) & PARITY_BIT) fec_encode(packet, length - 8, packet + length - 8);
+          return length - 8;
+        }
+        if(context.state == CONTEXT_PROPOSED) return length;
+        saved[0] = packet[3];
+        saved[1] = info[9];
+        memmove(info + 9, info + 10, length - (info - packet) - 10);
+        memmove(packet + 3, packet + 4, length - 5);
+        packet[2] &= ~(HEADER_BYTE_3_BIT >> 8);
+        write_length(packet, length - 2);
+        compose_crc(packet, length - 2);
+        return length - 2;
+      };
+
+
+      /* Restore a packet transformed by compress_context in the given
+         state, sent is its length while transmitted: */
+
+      void expand_context(uint8_t *packet, uint16_t sent, uint8_t state, const uint8_t *saved) const {
+        if(state == CONTEXT_PROPOSED) return;
+        if(state == CONTEXT_CONFIRMED) {
+          uint8_t *info = context_info(packet);
+          memmove(info + 8, info, sent - (info - packet));
+          memcpy(info, saved, 8);
+          packet[3] &= ~CONTEXT_ONLY_BIT;
+          write_length(packet, sent + 8);
+          if(packet_header(packet) & PARITY_BIT) fec_encode(packet, sent + 8, packet + sent + 8);
+          return;
+        }
+        memmove(packet + 4, packet + 3, sent - 3);
+        packet[2] |= HEADER_BYTE_3_BIT >> 8;
+        packet[3] = saved[0];
+        uint8_t *info = context_info(packet);
+        memmove(info + 10, info + 9, sent + 1 - (info - packet) - 9);
+        info[9] = saved[1];
+        write_length(packet, sent + 2);
+        compose_crc(packet, sent + 2);
+      };
+
+
+      /* After a transmission attempt update the context of its receiver:
+         a proposal acknowledged is confirmed, refused (NAK) is proposed
+         with another index, not acknowledged is sent once without context
+         to know if the receiver supports contexts. A packet without the bus
+         ids not acknowledged is sent with them again: */
+
+      void update_context(PJON_Context &context, uint8_t state, uint16_t response) {
+        if(state == CONTEXT_PROPOSED) {
+          if(response == ACK) context.state = CONTEXT_CONFIRMED;
+          else if(response == NAK) context.index += HEADER_CONTEXTS;
+          else context.state = CONTEXT_PROBING;
+        } else if(state == CONTEXT_PROBING) {
+          if(response == ACK) context.state = CONTEXT_REFUSED;
+          else if(response != NAK) context.state = CONTEXT_PROPOSED; // Not reachable
+        } else if(state == CONTEXT_CONFIRMED && response != ACK)
+          context.state = CONTEXT_PROPOSED;
+      };
+
+    #endif
+
+
+      /* Write the length of a composed packet: */
+
+      void write_length(uint8_t *packet, uint16_t length) const {
+        uint8_t extended_header = header_length(packet) - 1;
+        if(packet[1] & EXTEND_LENGTH_BIT) {
+          packet[2 + extended_header] = length >> 8;
+          packet[3 + extended_header] = length & 0xFF;
+        } else packet[2 + extended_header] = length;
+      };
+
+
+      /* Segmentation (SEGMENTATION_BIT):
+         Payloads longer than a packet are sent in segments including 5 bytes
+         before the content (and before the sequence ids if ACK_MODE_BIT is
+         set): the transfer id, the payload length and the segment's offset
+         in the payload. The receiver delivers the payload in order, calling
+         the receiver function for each part with payload_offset and
+         payload_length set in PacketInfo, so the payload does not need to
+         fit in memory. Segments received out of order are buffered up to
+         SEGMENTATION_BUFFER_LENGTH bytes, if they do not fit they are
+         refused (NAK or not acknowledged) and sent again. */
+
+      uint8_t *segment_info(uint8_t *packet) const {
+        uint16_t header = packet_header(packet);
+        return packet + packet_overhead(header) - (header & CRC_BIT ? 4 : 1) -
+          (header & ACK_MODE_BIT ? 4 : 0) - 5;
+      };
+
+
+      /* Send a payload longer than PACKET_MAX_LENGTH in segments, adding them
+         to the send list while it has room and calling update() and receive()
+         until they are delivered. With the asynchronous acknowledge more
+         segments are sent without waiting for each response. Returns ACK if
+         all segments are delivered within the timeout, FAIL otherwise:
+
+         bus.send_segmented(44, bus_id, firmware, 4096); */
+
+      uint16_t send_segmented(
+        uint8_t id,
+        const uint8_t *b_id,
+        const char *payload,
+        uint16_t length,
+        uint16_t header = NOT_ASSIGNED,
+        uint32_t timeout = 10000000
+      ) {
+        if(header == NOT_ASSIGNED) header = send_header();
+        header |= SEGMENTATION_BIT;
+        uint16_t segment_header = header;
+        uint16_t overhead =
+          compose_header_length(id, segment_header, PACKET_MAX_LENGTH) - PACKET_MAX_LENGTH;
+        if(overhead + 1 >= PACKET_MAX_LENGTH) {
+          _error(CONTENT_TOO_LONG, overhead);
+          return FAIL;
+        }
+        uint16_t segment_length = PACKET_MAX_LENGTH - 1 - overhead;
+        uint8_t  transfer = _transfer++;
+        uint16_t offset = 0;
+        uint32_t start = micros();
+        _segment_lost = false;
+        do {
+          while(offset < length && _free_count) {
+            uint16_t part = (length - offset < segment_length) ? length - offset : segment_length;
+            uint8_t segment[5] = {
+              transfer,
+              (uint8_t)(length >> 8), (uint8_t)length,
+              (uint8_t)(offset >> 8), (uint8_t)offset
+            };
+            if(dispatch(id, b_id, payload + offset, part, 0, header, segment) == FAIL) break;
+            offset += part;
+          }
+          update();
+          receive();
+          bool pending = false;
+          for(PJON_Packet_Index i = 0; i < MAX_PACKETS; i++)
+            if(packets[i].state && transfer_segment(i, transfer)) {
+              if(packets[i].state != ACK) pending = true;
+              else remove(i); // If auto deletion is disabled
+            }
+          if(_segment_lost) break;
+          if(!pending && offset == length) return ACK;
+        } while((uint32_t)(micros() - start) < timeout);
+        for(PJON_Packet_Index i = 0; i < MAX_PACKETS; i++)
+          if(packets[i].state && transfer_segment(i, transfer)) remove(i);
+        return FAIL;
+      };
+
+      uint16_t send_segmented(
+        uint8_t id,
+        const char *payload,
+        uint16_t length,
+        uint16_t header = NOT_ASSIGNED
+      ) {
+        return send_segmented(id, bus_id, payload, length, header);
+      };
+
+
+      bool transfer_segment(PJON_Packet_Index i, uint8_t transfer) {
+        return (packet_header((uint8_t *)packets[i].content) & SEGMENTATION_BIT) &&
+          segment_info((uint8_t *)packets[i].content)[0] == transfer;
+      };
+
+
+    #if MAX_REASSEMBLIES > 0
+
+      /* Check if a received segment can be handled now: */
+
+      bool accept_segment(uint16_t length) {
+        if(!(last_packet_info.header & SENDER_INFO_BIT)) return false;
+        const uint8_t *info = segment_info(data);
+        uint16_t total = info[1] << 8 | info[2];
+        uint16_t offset = info[3] << 8 | info[4];
+        uint16_t part = length - packet_overhead(last_packet_info.header);
+        if((uint32_t)offset + part > total) return false;
+        PJON_Reassembly *reassembly = get_reassembly(info[0], total);
+        if(!reassembly) return false;
+        uint16_t delivered = 0, buffered = 0;
+        if(same_transfer(*reassembly, info[0], total)) {
+          delivered = reassembly->delivered;
+        #if SEGMENTATION_BUFFER_LENGTH > 0
+          buffered = reassembly->buffered;
+          if(find_segment(*reassembly, offset) < buffered) return true;
+        #endif
+        }
+        return offset <= delivered || buffered + 4 + part <= SEGMENTATION_BUFFER_LENGTH;
+      };
+
+
+      /* Deliver a received segment in order or buffer it (if accepted): */
+
+      void receive_segment(uint8_t *payload, uint16_t length) {
+        const uint8_t *info = segment_info(data);
+        uint16_t total = info[1] << 8 | info[2];
+        uint16_t offset = info[3] << 8 | info[4];
+        PJON_Reassembly *reassembly = get_reassembly(info[0], total);
+        PJON_Reassembly &r = *reassembly;
+        if(!same_transfer(r, info[0], total)) {
+          r = PJON_Reassembly();
+          r.used = true;
+          r.sender_id = last_packet_info.sender_id;
+          copy_bus_id(r.sender_bus_id, sender_bus_id());
+          r.transfer = info[0];
+          r.length = total;
+        }
+        r.time = micros();
+        if(offset > r.delivered) {
+        #if SEGMENTATION_BUFFER_LENGTH > 0
+          if(find_segment(r, offset) < r.buffered) return;
+          r.buffer[r.buffered]     = offset >> 8;
+          r.buffer[r.buffered + 1] = offset;
+          r.buffer[r.buffered + 2] = length >> 8;
+          r.buffer[r.buffered + 3] = length;
+          memcpy(r.buffer + r.buffered + 4, payload, length);
+          r.buffered += 4 + length;
+        #endif
+          return;
+        }
+        if(offset + length > r.delivered)
+          deliver_segment(r, payload + (r.delivered - offset), offset + length - r.delivered);
+      #if SEGMENTATION_BUFFER_LENGTH > 0
+        // Deliver the buffered segments that are now in order
+        for(uint16_t p = 0; p < r.buffered; ) {
+          uint16_t o = r.buffer[p] << 8 | r.buffer[p + 1];
+          uint16_t l = r.buffer[p + 2] << 8 | r.buffer[p + 3];
+          if(o > r.delivered) {
+            p += 4 + l;
+            continue;
+          }
+          if(o + l > r.delivered)
+            deliver_segment(r, r.buffer + p + 4 + (r.delivered - o), o + l - r.delivered);
+          r.buffered -= 4 + l;
+          memmove(r.buffer + p, r.buffer + p + 4 + l, r.buffered - p);
+          p = 0;
+        }
+      #endif
+      };
+
+
+      void deliver_segment(PJON_Reassembly &reassembly, uint8_t *payload, uint16_t length) {
+        last_packet_info.payload_offset = reassembly.delivered;
+        last_packet_info.payload_length = reassembly.length;
+        reassembly.delivered += length;
+        _receiver(payload, length, last_packet_info);
+      };
+
+
+      /* Get the reassembly of a transfer of the last packet's sender or one
+         that can be replaced (not used, complete, expired or of a previous
+         transfer of the same sender), NULL if all are in use: */
+
+      PJON_Reassembly *get_reassembly(uint8_t transfer, uint16_t length) {
+        PJON_Reassembly *available = NULL;
+        for(uint8_t r = 0; r < MAX_REASSEMBLIES; r++) {
+          PJON_Reassembly &reassembly = _reassemblies[r];
+          if(same_transfer(reassembly, transfer, length)) return &reassembly;
+          if(available) continue;
+          if(
+            !reassembly.used ||
+            reassembly.delivered == reassembly.length ||
+            (uint32_t)(micros() - reassembly.time) > SEGMENTATION_TIMEOUT ||
+            (
+              reassembly.sender_id == last_packet_info.sender_id &&
+              bus_id_equality(reassembly.sender_bus_id, sender_bus_id())
+            )
+          ) available = &reassembly;
+        }
+        return available;
+      };
+
+
+      bool same_transfer(const PJON_Reassembly &reassembly, uint8_t transfer, uint16_t length) {
+        return reassembly.used &&
+          reassembly.transfer == transfer &&
+          reassembly.length == length &&
+          reassembly.sender_id == last_packet_info.sender_id &&
+          bus_id_equality(reassembly.sender_bus_id, sender_bus_id());
+      };
 
-          if(i == 0)
-            if(data[i] != _device_id && data[i] != BROADCAST && !_router)
-              return BUSY;
+    #else
 
-          if(i == 1) {
-            if(((data[i] & MODE_BIT) != _shared) && !_router) return BUSY;
-            extended_length = data[i] & EXTEND_LENGTH_BIT;
-            extended_header = data[i] & EXTEND_HEADER_BIT;
-          }
+      /* Segments are refused if MAX_REASSEMBLIES is 0: */
 
-          if((i == (2 + extended_header)) && !extended_length) {
-            length = data[i];
-            if(length < 5 || length > PACKET_MAX_LENGTH) return FAIL;
-          }
+      bool accept_segment(uint16_t length) { return false; };
 
-          if((i == (3 + extended_header)) && extended_length) {
-            length = data[i - 1] << 8 | data[i] & 0xFF;
-            if(length < 5 || length > PACKET_MAX_LENGTH) return FAIL;
-          }
+      void receive_segment(uint8_t *payload, uint16_t length) { };
 
-          if(_shared && (data[1] & MODE_BIT) && !_router)
-            if((i > (2 + extended_header + extended_length)))
-              if((i < (7 + extended_header + extended_length)))
-                if(bus_id[i - 3 - extended_header - extended_length] != data[i])
-                  return BUSY;
-        }
+    #endif
 
-        if(data[1] & CRC_BIT) {
-          uint32_t result = compute_crc_32(data, length - 4);
-          for(uint8_t i = 4; i > 0; i--)
-            if((uint8_t)(result >> (8 * (i - 1))) != (uint8_t)data[length - i]) {
-              CRC = false;
-              break;
-            } else CRC = true;
-        } else CRC = !compute_crc_8(data, length);
 
-        if(data[1] & ACK_REQUEST_BIT && data[0] != BROADCAST && _mode != SIMPLEX && !_router)
-          if(
-            !_shared || (_shared && (data[1] & MODE_BIT) &&
-            bus_id_equality(data + 3 + extended_length + extended_header, bus_id))
-          ) strategy.send_response(!CRC ? NAK : ACK);
+      /* Bus id of the last packet's sender (localhost if local): */
 
-        if(!CRC) return NAK;
-        parse(data, last_packet_info);
-        _receiver(
-          data + (packet_overhead(data[1]) - (data[1] & CRC_BIT ? 4 : 1)),
-          length - packet_overhead(data[1]),
-          last_packet_info
-        );
-        return ACK;
+      const uint8_t *sender_bus_id() const {
+        return (last_packet_info.header & MODE_BIT) ? last_packet_info.sender_bus_id : localhost;
       };
 
+    #if MAX_REASSEMBLIES > 0 && SEGMENTATION_BUFFER_LENGTH > 0
+      /* Position of a buffered segment, buffered if not found: */
 
-      /* Try to receive a packet repeatedly with a maximum duration: */
-
-      uint16_t receive(uint32_t duration) {
-        uint16_t response;
-        uint32_t time = micros();
-        while((uint32_t)(micros() - time) <= duration) {
-          response = receive();
-          if(response == ACK)
-            return ACK;
+      uint16_t find_segment(const PJON_Reassembly &reassembly, uint16_t offset) const {
+        uint16_t p = 0;
+        while(p < reassembly.buffered) {
+          if((reassembly.buffer[p] << 8 | reassembly.buffer[p + 1]) == offset) return p;
+          p += 4 + (reassembly.buffer[p + 2] << 8 | reassembly.buffer[p + 3]);
         }
-        return response;
+        return p;
       };
+    #endif
 
 
       /* Remove a packet from the send list: */
 
       void remove(uint16_t id) {
+        if(id >= MAX_PACKETS || packets[id].state == 0) return;
+        unschedule(id);
+      #if PJON_SEND_HEAP > 0
+        uint16_t last = _free_first + _free_count;
+        _free_slots[(last >= MAX_PACKETS) ? last - MAX_PACKETS : last] = id;
+      #endif
+        _free_count++;
+      #if PACKET_POOL_LENGTH > 0
+        _pool.free(
+          packets[id].content,
+          frame_length(packet_header((uint8_t *)packets[id].content), packets[id].length)
+        );
+        packets[id].content = NULL;
+      #endif
         packets[id].attempts = 0;
         packets[id].length = 0;
         packets[id].registration = 0;
@@ -375,7 +1750,7 @@ limitations under the License. */
          Pass a device id to delete all it's related packets  */
 
       void remove_all_packets(uint8_t device_id = 0) {
-        for(uint8_t i = 0; i < MAX_PACKETS; i++) {
+        for(PJON_Packet_Index i = 0; i < MAX_PACKETS; i++) {
           if(packets[i].state == 0) continue;
           if(!device_id || packets[i].content[0] == device_id) remove(i);
         }
@@ -533,12 +1908,34 @@ limitations under the License. */
 
       uint16_t send_packet(const char *string, uint16_t length) {
         if(!string) return FAIL;
-        if(_mode != SIMPLEX && !strategy.can_start()) return BUSY;
-        strategy.send_string((uint8_t *)string, length);
-        if(string[0] == BROADCAST || !_acknowledge || _mode == SIMPLEX) return ACK;
-        uint16_t response = strategy.receive_response();
-        if(response == ACK || response == NAK || response == FAIL) return response;
-        else return BUSY;
+        const uint8_t *packet = (const uint8_t *)string;
+        if(!acquire()) return record_attempt(packet, 0, BUSY);
+        uint32_t time = stats_time(), rtt = 0;
+        uint16_t sent = length;
+      #if HEADER_CONTEXTS > 0
+        // Transmitted in the form required by the context of the receiver
+        uint8_t saved[8];
+        PJON_Context *context = sent_context(packet);
+        uint8_t context_state = context ? context->state : CONTEXT_PROPOSED;
+        if(context) sent = compress_context((uint8_t *)string, length, *context, saved);
+      #endif
+        strategy.send_string((uint8_t *)string, frame_length(packet_header(packet), sent));
+        uint16_t response = ACK;
+        if(string[0] != BROADCAST && _acknowledge && _mode != SIMPLEX) {
+          if(string[1] & ACK_MODE_BIT) response = WAITING_ACK;
+          else {
+            response = strategy.receive_response();
+            if(response != ACK && response != NAK && response != FAIL) response = BUSY;
+            rtt = stats_time() - time;
+          }
+        }
+      #if HEADER_CONTEXTS > 0
+        if(context) {
+          expand_context((uint8_t *)string, sent, context_state, saved);
+          update_context(*context, context_state, response);
+        }
+      #endif
+        return record_attempt(packet, sent, response, rtt);
       };
 
 
@@ -564,9 +1961,173 @@ limitations under the License. */
       };
 
 
+      /* Send a packet composed by a list of segments, the content is streamed
+         to the strategy segment by segment with no intermediate copy and the
+         CRC is computed over the segments. If the strategy supports streaming
+         the packet length is not limited by PACKET_MAX_LENGTH:
+
+         char info[] = "temperature";
+         PJON_Segment segments[] = {
+           {(uint8_t *)info, 11},
+           {(uint8_t *)samples, 1000}
+         };
+         bus.send_packet(44, bus_id, segments, 2); */
+
+      uint16_t send_packet(
+        uint8_t id,
+        const uint8_t *b_id,
+        const PJON_Segment *segments,
+        uint8_t count,
+        uint16_t header = NOT_ASSIGNED
+      ) {
+        uint32_t length = 0;
+        for(uint8_t s = 0; s < count; s++) length += segments[s].length;
+        // The parity can not be computed while streaming, it is not included
+        if(header == NOT_ASSIGNED) header = get_header();
+        header &= ~(PARITY_BIT | HEADER_BYTE_3_BIT); // Contexts are negotiated by send_packet
+        if(!(header & 0xFF00)) header &= ~EXTEND_HEADER_BIT;
+        uint16_t new_length = compose_header_length(id, header, length);
+        if(length > 0xFFFF || length + packet_overhead(header) > 0xFFFF) {
+          _error(CONTENT_TOO_LONG, 0);
+          return FAIL;
+        }
+        uint8_t meta[HEADER_MAX_LENGTH];
+        uint8_t meta_length = compose_header(id, b_id, meta, header, new_length);
+        uint8_t CRC[4];
+        uint8_t CRC_length = compose_segments_crc(meta, meta_length, segments, count, header, CRC);
+        if(!acquire()) return record_attempt(meta, 0, BUSY);
+        uint32_t time = stats_time();
+        if(!send_segments(
+          meta, meta_length, segments, count, CRC, CRC_length, new_length,
+          typename PJON_Supports_Segments<Strategy>::type()
+        )) return FAIL;
+        if(id == BROADCAST || !(header & ACK_REQUEST_BIT) || _mode == SIMPLEX)
+          return record_attempt(meta, new_length, ACK);
+        uint16_t response = strategy.receive_response();
+        if(response != ACK && response != NAK && response != FAIL) response = BUSY;
+        return record_attempt(meta, new_length, response, stats_time() - time);
+      };
+
+      uint16_t send_packet(
+        uint8_t id,
+        const PJON_Segment *segments,
+        uint8_t count,
+        uint16_t header = NOT_ASSIGNED
+      ) {
+        return send_packet(id, bus_id, segments, count, header);
+      };
+
+
+      /* Compute the CRC of a packet composed by its metainfo and a list of segments: */
+
+      uint8_t compose_segments_crc(
+        const uint8_t *meta,
+        uint8_t meta_length,
+        const PJON_Segment *segments,
+        uint8_t count,
+        uint16_t header,
+        uint8_t *destination
+      ) const {
+        if(header & CRC_BIT) {
+          uint32_t CRC = compute_crc_32(meta, meta_length);
+          for(uint8_t s = 0; s < count; s++)
+            CRC = compute_crc_32(segments[s].data, segments[s].length, CRC);
+          destination[0] = (uint32_t)(CRC) >> 24;
+          destination[1] = (uint32_t)(CRC) >> 16;
+          destination[2] = (uint32_t)(CRC) >>  8;
+          destination[3] = (uint32_t)(CRC);
+          return 4;
+        }
+        uint8_t CRC = compute_crc_8(meta, meta_length);
+        for(uint8_t s = 0; s < count; s++)
+          CRC = compute_crc_8(segments[s].data, segments[s].length, CRC);
+        destination[0] = CRC;
+        return 1;
+      };
+
+
+      /* Stream the segments to a strategy supporting segmented transmission,
+         if it refuses the transmission the packet is composed in data: */
+
+      bool send_segments(
+        const uint8_t *meta,
+        uint8_t meta_length,
+        const PJON_Segment *segments,
+        uint8_t count,
+        const uint8_t *CRC,
+        uint8_t CRC_length,
+        uint16_t length,
+        PJON_Bool<true>
+      ) {
+        if(!strategy.send_string_begin(length))
+          return send_segments(meta, meta_length, segments, count, CRC, CRC_length, length, PJON_Bool<false>());
+        strategy.send_string_segment(meta, meta_length);
+        for(uint8_t s = 0; s < count; s++)
+          strategy.send_string_segment(segments[s].data, segments[s].length);
+        strategy.send_string_segment(CRC, CRC_length);
+        strategy.send_string_end();
+        return true;
+      };
+
+      /* Strategies not supporting segmented transmission receive the packet
+         composed in data, so its length is limited by PACKET_MAX_LENGTH: */
+
+      bool send_segments(
+        const uint8_t *meta,
+        uint8_t meta_length,
+        const PJON_Segment *segments,
+        uint8_t count,
+        const uint8_t *CRC,
+        uint8_t CRC_length,
+        uint16_t length,
+        PJON_Bool<false>
+      ) {
+        if(length > PACKET_MAX_LENGTH) {
+          _error(CONTENT_TOO_LONG, 0);
+          return false;
+        }
+        uint16_t position = meta_length;
+        memcpy(data, meta, meta_length);
+        for(uint8_t s = 0; s < count; s++) {
+          memcpy(data + position, segments[s].data, segments[s].length);
+          position += segments[s].length;
+        }
+        memcpy(data + position, CRC, CRC_length);
+        strategy.send_string(data, length);
+        return true;
+      };
+
+
+      /* Spend up to duration microseconds of back-off receiving, without
+         exceeding it by the time receive() waits for data: if the strategy
+         can wait for data receive() is called only when it arrives, if not
+         once after each attempt (first is true) and then only if duration
+         is longer than the last receive() finding nothing. Returns true if
+         data was used by a reception: */
+
+      bool receive_back_off(uint32_t duration, bool, PJON_Bool<true>) {
+        if(!strategy.wait(duration)) return false;
+        receive();
+        return true;
+      };
+
+      bool receive_back_off(uint32_t duration, bool first, PJON_Bool<false>) {
+        if(!first && duration <= _receive_duration) {
+          delayMicroseconds(duration);
+          return false;
+        }
+        uint32_t time = micros();
+        if(receive() == FAIL) _receive_duration = micros() - time;
+        return true;
+      };
+
+
       /* Send a packet without using the send list. It is called send_packet_blocking
          because it tries to transmit a packet multiple times within an internal cycle
-         until the packet is delivered, or timing limit is reached. */
+         until the packet is delivered, or timing limit is reached. The back-off
+         and collision delay between attempts are spent receiving (see
+         receive_back_off), so packets are received meanwhile (if called by a
+         receiver function the delay is waited instead). */
 
       uint16_t send_packet_blocking(
         uint8_t id,
@@ -576,17 +2137,33 @@ limitations under the License. */
         uint16_t header = NOT_ASSIGNED,
         uint32_t timeout = 3000000
       ) {
-        if(!(length = compose_packet(id, b_id, (char *)data, string, length, header))) return FAIL;
-        uint16_t state = FAIL;
-        uint32_t attempts = 0;
+        uint16_t state = FAIL, packet_length = 0, session = _session_id++;
+        uint32_t attempts = 0, wait = 0;
+        if(header == NOT_ASSIGNED) // Never acknowledged asynchronously
+          header = (send_header() & ~ACK_MODE_BIT) | (_session ? SESSION_BIT : 0);
         uint32_t time = micros(), start = time;
-        while(state != ACK && attempts <= MAX_ATTEMPTS && (uint32_t)(micros() - start) <= timeout) {
-          state = send_packet((char*)data, length);
+        bool first = true;
+        while(attempts <= MAX_ATTEMPTS && (uint32_t)(micros() - start) <= timeout) {
+          uint32_t elapsed = micros() - time;
+          if(elapsed < wait) {
+            if(_receiving) delayMicroseconds(wait - elapsed);
+            else if(receive_back_off(wait - elapsed, first, typename PJON_Supports_Wait<Strategy>::type()))
+              packet_length = 0; // data was used by the reception, compose again
+            first = false;
+            continue;
+          }
+          if(!packet_length) {
+            packet_length = compose_packet(id, b_id, (char *)data, string, length, header);
+            if(!packet_length) return FAIL;
+            if(packet_header(data) & SESSION_BIT) set_session(data, packet_length, session);
+          }
+          state = send_packet((char *)data, packet_length);
           if(state == ACK) return state;
           attempts++;
-          if(state != FAIL) delayMicroseconds(random(0, COLLISION_DELAY));
-          while((uint32_t)(micros() - time) < (attempts * attempts * attempts));
+          wait = attempts * attempts * attempts;
+          if(state != FAIL) wait += random(0, COLLISION_DELAY);
           time = micros();
+          first = true;
         }
         return state;
       };
@@ -618,6 +2195,23 @@ limitations under the License. */
       };
 
 
+    #if ASYNC_ACK_PEERS > 0
+
+      /* Configure asynchronous acknowledge of the packets sent with send()
+         and send_repeatedly(), acknowledge must be requested:
+         TRUE: Up to window packets (at most ASYNC_ACK_WINDOW) for each receiver
+               are sent without waiting for a response and remain in the send
+               list until acknowledged
+         FALSE: Wait for the synchronous acknowledge after each packet */
+
+      void set_asynchronous_acknowledge(boolean state, uint8_t window = ASYNC_ACK_WINDOW) {
+        _async_acknowledge = state;
+        _async_window = (window < 1) ? 1 : (window > ASYNC_ACK_WINDOW) ? ASYNC_ACK_WINDOW : window;
+      };
+
+    #endif
+
+
       /* Configure CRC selected for packet checking:
          TRUE:  CRC32
          FALSE: CRC8 */
@@ -645,7 +2239,19 @@ limitations under the License. */
           packets[i].state = 0;
           packets[i].timing = 0;
           packets[i].attempts = 0;
+        #if PACKET_POOL_LENGTH > 0
+          packets[i].content = NULL;
+        #endif
+        #if PJON_SEND_HEAP > 0
+          _free_slots[i] = i;
+          _queue_position[i] = MAX_PACKETS;
+        #endif
         }
+        _free_count = MAX_PACKETS;
+      #if PJON_SEND_HEAP > 0
+        _free_first = 0;
+        _queue_length = 0;
+      #endif
       };
 
 
@@ -684,6 +2290,79 @@ limitations under the License. */
       };
 
 
+      /* Include a session id in the packets sent (SESSION_BIT), so if the
+         acknowledge is lost and a packet is sent again the receiver does not
+         deliver it twice. It adds 2 bytes (3 with the extended header) and
+         the sender info: */
+
+      void include_session_id(bool state) {
+        _session = state;
+      };
+
+
+      /* Include the parity bytes of the packets sent (PARITY_BIT), so the
+         receivers correct the bytes corrupted by noise instead of refusing
+         the packet. It adds 2 bytes every FEC_BLOCK_LENGTH bytes of the
+         packet (see utils/ErrorCorrection.h) and the extended header: */
+
+      void include_parity(bool state) {
+        _parity = state;
+      };
+
+
+    #if HEADER_CONTEXTS > 0
+
+      /* Compress the header of the packets sent in shared mode (third
+         header byte, see context_supported): after a receiver acknowledges
+         a packet including the bus ids they are replaced by a context index,
+         saving 5 bytes per packet. The synchronous acknowledge is required
+         and routers do not forward contexts, so packets crossing a router
+         are sent without: */
+
+      void set_header_compression(bool state) {
+        _header_compression = state;
+      };
+
+    #endif
+
+
+    #if PJON_BURST > 0
+
+      /* Send the packets ready in the send list back to back: after the
+         medium is acquired by can_start, update() sends the next packets
+         as soon as the previous is acknowledged, without listening again,
+         for up to duration microseconds (0, the default, disables bursts).
+         Each packet is acknowledged on its own, a burst ends if a response
+         is not received. Receivers must be calling receive() to not miss
+         the packets following the first: */
+
+      void set_burst_duration(uint32_t duration) {
+        _burst_duration = duration;
+      };
+
+    #endif
+
+
+    #if PJON_COMPRESSION > 0
+      /* Compress the content of the packets sent (DATA_COMP_BIT, see
+         utils/Compression.h), it is sent as it is if it would not get
+         shorter. The dictionary, if any, must be the same on the receivers
+         and stay valid as long as it is used:
+         const uint8_t keys[] = "{\"temperature\":,\"humidity\":}";
+         bus.set_compression(true, keys, sizeof(keys) - 1); */
+
+      void set_compression(
+        bool state,
+        const uint8_t *dictionary = NULL,
+        uint16_t dictionary_length = 0
+      ) {
+        _compression = state;
+        _dictionary = dictionary;
+        _dictionary_length = dictionary ? dictionary_length : 0;
+      };
+    #endif
+
+
       /* Configure the bus network behaviour.
          TRUE: Enable communication to devices part of other bus ids (on a shared medium).
          FALSE: Isolate communication from external/third-party communication. */
@@ -729,54 +2408,523 @@ limitations under the License. */
       };
 
 
+      /* Set the function called in router mode for each packet received, if
+         it returns true the packet is considered delivered (for example
+         forwarded to another bus) and it is acknowledged on behalf of its
+         receiver, otherwise the receiver function is called (see
+         PJONRouter.h):
+
+         bool route_function(
+           const uint8_t *packet,
+           uint16_t length,
+           const PacketInfo &packet_info,
+           void *custom_pointer
+         ) { ... };
+
+         bus.set_route_handler(route_function, &router); */
+
+      void set_route_handler(route_handler r, void *custom_pointer = NULL) {
+        _route_handler = r;
+        _route_pointer = custom_pointer;
+      };
+
+
       /* Update the state of the send list:
          Check if there are packets to be sent or to be erased if correctly delivered.
-         Returns the actual number of packets to be sent. */
+         Returns the actual number of packets to be sent. It never waits: the
+         back-off of packets and the collision delay are times before which
+         they are not sent, checked by the next calls. */
+
+      uint16_t update() {
+        uint32_t now = micros();
+        if(held_off(now)) return MAX_PACKETS - _free_count;
+        set_bursting(false);
+      #if PJON_SEND_HEAP > 0
+        PJON_Packet_Index ready[MAX_PACKETS];
+        PJON_Packet_Index count = 0;
+        while(_queue_length && (int32_t)(now - _due[_queue[0]]) >= 0) {
+          PJON_Packet_Index i = _queue[0];
+          unschedule(i);
+          if(!packet_ready(i, now)) {
+            schedule(i, now);
+            continue;
+          }
+          record_first_attempt(i, now);
+          ready[count++] = i;
+        }
+        for(PJON_Packet_Index k = 0; k < count; k++) {
+          // Skip packets removed, dispatched again or already sent in a batch
+          if(!packets[ready[k]].state || _queue_position[ready[k]] != MAX_PACKETS) continue;
+          // After a collision the remaining packets are sent when the delay is elapsed
+          if(held_off(micros())) schedule_at(ready[k], _hold_off_end);
+          else update_packet(ready, k, count, typename PJON_Supports_Batch<Strategy>::type());
+        }
+      #else
+        // Each packet ready is handled once, in the order they are due
+        uint8_t handled[(MAX_PACKETS + 7) / 8] = {0};
+        while(true) {
+          now = micros();
+          // After a collision the remaining packets are sent by the next call
+          if(held_off(now)) break;
+          PJON_Packet_Index i = next_ready(handled, now);
+          if(i == MAX_PACKETS) break;
+          handled[i / 8] |= 1 << (i % 8);
+          record_first_attempt(i, now);
+          update_packet(i);
+        }
+      #endif
+        set_bursting(false);
+        return MAX_PACKETS - _free_count;
+      };
 
-      uint8_t update() {
-        uint8_t packets_count = 0;
-        uint32_t back_off;
-        for(uint8_t i = 0; i < MAX_PACKETS; i++) {
-          if(packets[i].state == 0) continue;
-          packets_count++;
-          back_off = packets[i].attempts;
-          back_off = back_off * back_off * back_off;
-          if((uint32_t)(micros() - packets[i].registration) > packets[i].timing + back_off)
-            packets[i].state = send_packet(packets[i].content, packets[i].length);
-          else continue;
-
-          if(packets[i].state == ACK) {
-            if(!packets[i].timing) {
-              if(_auto_delete) {
-                remove(i);
-                packets_count--;
-              }
-            } else {
-              packets[i].attempts = 0;
-              packets[i].registration = micros();
-              packets[i].state = TO_BE_SENT;
-            } continue;
+
+    #if PJON_SEND_HEAP == 0
+
+      /* Get the packet ready and not handled that is the most late, or if
+         more the first scheduled, MAX_PACKETS if none: */
+
+      PJON_Packet_Index next_ready(const uint8_t *handled, uint32_t now) const {
+        PJON_Packet_Index next = MAX_PACKETS;
+        uint32_t next_late = 0;
+        for(PJON_Packet_Index i = 0; i < MAX_PACKETS; i++) {
+          if(!packets[i].state || (handled[i / 8] & (1 << (i % 8))) || !packet_ready(i, now))
+            continue;
+          uint32_t late = now - packets[i].registration - packet_wait(i);
+          if(
+            next == MAX_PACKETS || late > next_late ||
+            (late == next_late && (int16_t)(_order[i] - _order[next]) < 0)
+          ) {
+            next = i;
+            next_late = late;
           }
+        }
+        return next;
+      };
 
-          if(packets[i].state != FAIL)
-            delayMicroseconds(random(0, COLLISION_DELAY));
+    #endif
 
-          packets[i].attempts++;
-          if(packets[i].attempts > MAX_ATTEMPTS) {
-            _error(CONNECTION_LOST, packets[i].content[0]);
-            if(!packets[i].timing) {
-              if(_auto_delete) {
-                remove(i);
-                packets_count--;
-              }
-            } else {
-              packets[i].attempts = 0;
-              packets[i].registration = micros();
-              packets[i].state = TO_BE_SENT;
+
+      /* Record the timing of a packet's first transmission attempt: */
+
+      void record_first_attempt(PJON_Packet_Index i, uint32_t now) {
+        if(packets[i].attempts) return;
+        if(packets[i].timing) record_jitter(now - packets[i].registration - packets[i].timing);
+        record_queue_wait(i, now - packets[i].registration - packets[i].timing);
+      };
+
+
+      /* Check if a packet is ready to be sent, so if its timing and back-off
+         are elapsed since its last transmission attempt: */
+
+      bool packet_ready(PJON_Packet_Index i, uint32_t now) const {
+        return (uint32_t)(now - packets[i].registration) > packet_wait(i);
+      };
+
+
+      /* Time between a packet's registration and its next transmission: */
+
+      uint32_t packet_wait(PJON_Packet_Index i) const {
+        return packets[i].timing + back_off(i) +
+          ((packets[i].state == WAITING_ACK) ? ASYNC_ACK_TIMEOUT : 0);
+      };
+
+
+      /* After a collision (a response other than ACK or FAIL) the medium is
+         not used for a random time up to COLLISION_DELAY, to let the other
+         transmitters retry in a different order. Only its end is kept, it is
+         at most COLLISION_DELAY ahead of the current time: */
+
+      void hold_off() {
+        _hold_off_end = micros() + random(0, COLLISION_DELAY);
+      };
+
+      bool held_off(uint32_t now) const {
+        uint32_t remaining = _hold_off_end - now;
+        return remaining && remaining <= COLLISION_DELAY;
+      };
+
+
+      /* Check if the medium can be used to transmit: during a burst (see
+         set_burst_duration) the medium acquired by the first packet is used
+         without listening again until the burst duration is elapsed: */
+
+      bool acquire() {
+        if(_mode == SIMPLEX) return true;
+      #if PJON_BURST > 0
+        if(_bursting && (uint32_t)(micros() - _burst_start) < _burst_duration) return true;
+        _bursting = false;
+        if(!strategy.can_start()) return false;
+        _burst_start = micros();
+        return true;
+      #else
+        return strategy.can_start();
+      #endif
+      };
+
+
+      /* Keep the medium for the next packet of a burst, only if the exchange
+         ended without a timeout (if PJON_BURST is 0 this call is empty): */
+
+      void set_bursting(bool state) {
+      #if PJON_BURST > 0
+        _bursting = _burst_duration && state;
+      #else
+        (void)state;
+      #endif
+      };
+
+
+      /* Cubic back-off of a packet based on its transmission attempts: */
+
+      uint32_t back_off(PJON_Packet_Index i) const {
+        uint32_t back_off = packets[i].attempts;
+        return back_off * back_off * back_off;
+      };
+
+
+      /* Send a packet of the send list and update its state: */
+
+      void update_packet(PJON_Packet_Index i) {
+      #if ASYNC_ACK_PEERS > 0
+        if(asynchronous(packets[i].content)) {
+          PJON_Async_Peer *peer = get_peer(packets[i].content[0], receiver_bus_id(packets[i].content), true);
+          uint16_t sequence = get_sequence((uint8_t *)packets[i].content);
+          if(packets[i].state == TO_BE_SENT) { // First transmission
+            // Scheduled again as soon as acknowledges move the window forward
+            // (checked again by each update() if PJON_SEND_HEAP is 0)
+            if(!in_window(*peer)) {
+              peer->blocked = true;
+              return schedule_at(i, micros() + ASYNC_ACK_TIMEOUT);
             }
-          } else packets[i].registration = micros();
+            sequence = peer->sequence++;
+            peer->sent[window_position(*peer, sequence)] = i;
+          }
+          set_sequence((uint8_t *)packets[i].content, packets[i].length, sequence, peer->oldest);
         }
-        return packets_count;
+      #endif
+        uint16_t state = send_packet(packets[i].content, packets[i].length);
+        if(state == WAITING_ACK && !asynchronous(packets[i].content)) state = ACK; // Forwarded
+        set_bursting(state == ACK || state == WAITING_ACK);
+        if(state != ACK && state != FAIL && state != WAITING_ACK) hold_off();
+        update_packet_state(i, state);
+      };
+
+    #if PJON_SEND_HEAP > 0
+
+      void update_packet(const PJON_Packet_Index *ready, PJON_Packet_Index k, PJON_Packet_Index, PJON_Bool<false>) {
+        update_packet(ready[k]);
+      };
+
+
+      /* Send in a single frame the ready packets directed to the same receiver
+         of ready[k] and update their state using the acknowledge bitmap
+         returned by the receiver: */
+
+      void update_packet(
+        const PJON_Packet_Index *ready,
+        PJON_Packet_Index k,
+        PJON_Packet_Index ready_count,
+        PJON_Bool<true>
+      ) {
+        PJON_Packet_Index i = ready[k];
+        // Contexts are negotiated one packet at a time
+        if((packets[i].content[1] & ACK_MODE_BIT) || header_length((uint8_t *)packets[i].content) == 3)
+          return update_packet(i);
+        PJON_Packet_Index index[MAX_BATCH_PACKETS];
+        PJON_Segment batch[MAX_BATCH_PACKETS];
+        uint8_t  bitmap[(MAX_BATCH_PACKETS + 7) / 8];
+        uint8_t  count = 0;
+        bool     acknowledge = false;
+        for(PJON_Packet_Index r = k; r < ready_count && count < MAX_BATCH_PACKETS; r++) {
+          PJON_Packet_Index j = ready[r];
+          if(packets[j].state == 0 || _queue_position[j] != MAX_PACKETS) continue;
+          if(packets[j].content[1] & ACK_MODE_BIT) continue;
+          if(header_length((uint8_t *)packets[j].content) == 3) continue;
+          if(!same_receiver(packets[i].content, packets[j].content)) continue;
+          index[count] = j;
+          batch[count].data = (uint8_t *)packets[j].content;
+          batch[count].length = frame_length(
+            packet_header((uint8_t *)packets[j].content), packets[j].length
+          );
+          if(packets[j].content[1] & ACK_REQUEST_BIT) acknowledge = true;
+          count++;
+        }
+
+        if(count <= 1 || !acquire() || !strategy.send_batch(batch, count))
+          return update_packet(i);
+
+        uint32_t time = stats_time();
+        uint16_t response = ACK;
+        if(acknowledge && _mode != SIMPLEX && packets[i].content[0] != BROADCAST)
+          response = strategy.receive_batch_response(bitmap, count);
+        if(response != ACK && response != FAIL) response = BUSY;
+        time = (response == ACK && acknowledge) ? stats_time() - time : 0;
+        set_bursting(response == ACK);
+
+        for(uint8_t b = 0; b < count; b++) {
+          uint16_t state = response;
+          if(response == ACK && (packets[index[b]].content[1] & ACK_REQUEST_BIT))
+            if(!(bitmap[b / 8] & (1 << (b % 8)))) state = NAK;
+          record_attempt(batch[b].data, packets[index[b]].length, state, time);
+          update_packet_state(index[b], state);
+        }
+        if(response != ACK && response != FAIL) hold_off();
+      };
+
+    #endif
+
+
+      /* Update a packet's state after a transmission attempt: */
+
+      void update_packet_state(PJON_Packet_Index i, uint16_t state) {
+        packets[i].state = state;
+        if(state != ACK) {
+          packets[i].attempts++;
+          if(packets[i].attempts <= MAX_ATTEMPTS) {
+            // Packets sent repeatedly retry keeping the deadline of their period
+            if(!packets[i].timing) packets[i].registration = micros();
+            return schedule(i);
+          }
+          if(packet_header((uint8_t *)packets[i].content) & SEGMENTATION_BIT) _segment_lost = true;
+          record_lost(i);
+          _error(CONNECTION_LOST, packets[i].content[0]);
+          if(!packets[i].state) return; // Removed by the error handler
+        }
+
+        if(!packets[i].timing) {
+          if(_auto_delete) remove(i);
+        } else {
+          packets[i].attempts = 0;
+          packets[i].registration = next_period(i);
+          packets[i].state = TO_BE_SENT; // A new sequence id is used in each period
+          if(packet_header((uint8_t *)packets[i].content) & SESSION_BIT)
+            set_session((uint8_t *)packets[i].content, packets[i].length, _session_id++);
+        }
+        if(packets[i].state) schedule(i);
+      };
+
+
+      /* Get the start of the next period of a packet sent repeatedly.
+         Deadlines are absolute (registration + k * timing) so they do not
+         drift, periods entirely elapsed (for example during a long blocking
+         call) are skipped. */
+
+      uint32_t next_period(PJON_Packet_Index i) const {
+        uint32_t elapsed = micros() - packets[i].registration;
+        return packets[i].registration + (elapsed / packets[i].timing) * packets[i].timing;
+      };
+
+
+      /* Record how late a packet sent repeatedly is handled: */
+
+      void record_jitter(uint32_t lateness) {
+      #if PJON_JITTER_STATS > 0
+        _jitter.samples++;
+        _jitter.total += lateness;
+        if(lateness < _jitter.min) _jitter.min = lateness;
+        if(lateness > _jitter.max) _jitter.max = lateness;
+      #else
+        (void)lateness;
+      #endif
+      };
+
+
+      /* Link statistics, if PJON_STATS_DEVICES is 0 these calls are empty
+         and the time is not read: */
+
+      uint32_t stats_time() const {
+      #if PJON_STATS_DEVICES > 0
+        return micros();
+      #else
+        return 0;
+      #endif
+      };
+
+
+      /* Record a transmission attempt of length bytes (0 if not started)
+         and its outcome, rtt is the time the response took (0 if none),
+         returns state: */
+
+      uint16_t record_attempt(const uint8_t *packet, uint16_t length, uint16_t state, uint32_t rtt = 0) {
+      #if PJON_STATS_DEVICES > 0
+        PJON_Device_Stats &s = device_stats(packet[0], receiver_bus_id((const char *)packet));
+        s.attempts++;
+        s.bytes_sent += length;
+        if(state == ACK) s.acknowledged++;
+        else if(state == NAK) s.naks++;
+        else if(state == BUSY) s.busy++;
+        else if(state == FAIL) s.fails++;
+        if(rtt && (state == ACK || state == NAK)) {
+          uint8_t b = 0;
+          for(uint32_t limit = PJON_RTT_RESOLUTION; b < PJON_RTT_BUCKETS - 1 && rtt >= limit; limit <<= 1) b++;
+          s.rtt[b]++;
+        }
+      #endif
+        return state;
+      };
+
+
+      /* Record the time a packet waited in the send list before its first
+         transmission attempt: */
+
+      void record_queue_wait(PJON_Packet_Index i, uint32_t wait) {
+      #if PJON_STATS_DEVICES > 0
+        PJON_Device_Stats &s = device_stats(packets[i].content[0], receiver_bus_id(packets[i].content));
+        s.dequeued++;
+        s.queue_wait += wait;
+        if(wait > s.queue_wait_max) s.queue_wait_max = wait;
+      #endif
+      };
+
+
+      /* Record a packet dropped after MAX_ATTEMPTS: */
+
+      void record_lost(PJON_Packet_Index i) {
+      #if PJON_STATS_DEVICES > 0
+        device_stats(packets[i].content[0], receiver_bus_id(packets[i].content)).lost++;
+      #endif
+      };
+
+
+      /* Record the packet received, if it contains the sender info: */
+
+      void record_reception(uint16_t length) {
+      #if PJON_STATS_DEVICES > 0
+        if(!(last_packet_info.header & SENDER_INFO_BIT)) return;
+        PJON_Device_Stats &s = device_stats(last_packet_info.sender_id, sender_bus_id());
+        s.packets_received++;
+        s.bytes_received += length;
+      #endif
+      };
+
+    #if PJON_STATS_DEVICES > 0
+
+      /* Find the statistics of a device, added if not present. When all
+         entries are used the device is counted in the last one: */
+
+      PJON_Device_Stats &device_stats(uint8_t id, const uint8_t *b_id) {
+        for(uint8_t d = 0; d < PJON_STATS_DEVICES; d++) {
+          PJON_Device_Stats &s = _stats[d];
+          if(s.used && s.id == id && bus_id_equality(s.bus_id, b_id)) return s;
+          if(!s.used) {
+            s.used = true;
+            s.id = id;
+            copy_bus_id(s.bus_id, b_id);
+            return s;
+          }
+        }
+        PJON_Device_Stats &s = _stats[PJON_STATS_DEVICES - 1];
+        s.id = NOT_ASSIGNED;
+        copy_bus_id(s.bus_id, localhost);
+        return s;
+      };
+
+    #endif
+
+
+      /* Send list scheduling (PJON_SEND_HEAP): free slots are kept in a
+         circular queue, so dispatch does not search for them, and packets to
+         be sent in a binary min-heap ordered by the time they are due (then
+         by the order in which they were scheduled), so update handles only
+         the packets that are ready. Times are compared as signed differences
+         to handle the micros() overflow, so MAX_SCHEDULE_INTERVAL caps how
+         far in the future a packet is scheduled. If PJON_SEND_HEAP is 0 only
+         the scheduling order is kept and update checks every packet. */
+
+      void schedule(PJON_Packet_Index i, uint32_t now = micros()) {
+      #if PJON_SEND_HEAP > 0
+        uint32_t elapsed = now - packets[i].registration;
+        uint32_t wait = packet_wait(i);
+        uint32_t remaining = (elapsed > wait) ? 0 : wait - elapsed + 1;
+        schedule_at(i, now + ((remaining > MAX_SCHEDULE_INTERVAL) ? MAX_SCHEDULE_INTERVAL : remaining));
+      #else
+        _order[i] = _schedule_count++;
+        (void)now;
+      #endif
+      };
+
+      void schedule_at(PJON_Packet_Index i, uint32_t due) {
+        _order[i] = _schedule_count++;
+      #if PJON_SEND_HEAP > 0
+        _due[i] = due;
+        if(_queue_position[i] == MAX_PACKETS) {
+          _queue_position[i] = _queue_length;
+          _queue[_queue_length++] = i;
+        }
+        sift_down(sift_up(_queue_position[i]));
+      #else
+        (void)due;
+      #endif
+      };
+
+
+      /* Remove a packet from the queue of packets to be sent: */
+
+      void unschedule(PJON_Packet_Index i) {
+      #if PJON_SEND_HEAP > 0
+        PJON_Packet_Index position = _queue_position[i];
+        if(position == MAX_PACKETS) return;
+        _queue_position[i] = MAX_PACKETS;
+        if(position == --_queue_length) return;
+        _queue[position] = _queue[_queue_length];
+        _queue_position[_queue[position]] = position;
+        sift_down(sift_up(position));
+      #else
+        (void)i;
+      #endif
+      };
+
+    #if PJON_SEND_HEAP > 0
+
+      bool due_before(PJON_Packet_Index a, PJON_Packet_Index b) const {
+        int32_t difference = _due[_queue[a]] - _due[_queue[b]];
+        return difference < 0 ||
+          (difference == 0 && (int16_t)(_order[_queue[a]] - _order[_queue[b]]) < 0);
+      };
+
+
+      void swap_queued(PJON_Packet_Index a, PJON_Packet_Index b) {
+        PJON_Packet_Index i = _queue[a];
+        _queue[a] = _queue[b];
+        _queue[b] = i;
+        _queue_position[_queue[a]] = a;
+        _queue_position[_queue[b]] = b;
+      };
+
+
+      PJON_Packet_Index sift_up(PJON_Packet_Index position) {
+        while(position && due_before(position, (position - 1) / 2)) {
+          swap_queued(position, (position - 1) / 2);
+          position = (position - 1) / 2;
+        }
+        return position;
+      };
+
+
+      void sift_down(PJON_Packet_Index position) {
+        while(true) {
+          uint16_t first = position;
+          uint16_t child = 2 * (uint16_t)position + 1;
+          if(child < _queue_length && due_before(child, first)) first = child;
+          if(child + 1 < _queue_length && due_before(child + 1, first)) first = child + 1;
+          if(first == position) return;
+          swap_queued(position, first);
+          position = first;
+        }
+      };
+
+    #endif
+
+
+      /* Check if two packets are directed to the same receiver: */
+
+      bool same_receiver(const char *one, const char *two) const {
+        if(one[0] != two[0] || ((one[1] ^ two[1]) & MODE_BIT)) return false;
+        if(!(one[1] & MODE_BIT)) return true;
+        return bus_id_equality(
+          (uint8_t *)one + 2 + header_length((uint8_t *)one) + ((one[1] & EXTEND_LENGTH_BIT) != 0),
+          (uint8_t *)two + 2 + header_length((uint8_t *)two) + ((two[1] & EXTEND_LENGTH_BIT) != 0)
+        );
       };
 
       uint8_t data[PACKET_MAX_LENGTH];
@@ -793,13 +2941,85 @@ limitations under the License. */
       boolean   _acknowledge = true;
       boolean   _auto_delete = true;
       boolean   _crc_32 = false;
+      boolean   _parity = false;
       error     _error;
       uint8_t   _mode;
       receiver  _receiver;
       boolean   _router = false;
+      route_handler _route_handler = NULL;
+      void     *_route_pointer = NULL;
       boolean   _sender_info = true;
       boolean   _shared = false;
+
+      PJON_Packet_Index _free_count;
+      uint16_t          _order[MAX_PACKETS];
+      uint16_t          _schedule_count = 0;
+    #if PJON_SEND_HEAP > 0
+      PJON_Packet_Index _free_slots[MAX_PACKETS];
+      PJON_Packet_Index _free_first;
+      PJON_Packet_Index _queue[MAX_PACKETS];
+      PJON_Packet_Index _queue_position[MAX_PACKETS];
+      PJON_Packet_Index _queue_length;
+      uint32_t          _due[MAX_PACKETS];
+    #endif
+    #if PJON_JITTER_STATS > 0
+      PJON_Jitter       _jitter;
+    #endif
+    #if PJON_RECEPTION_STATS > 0
+      PJON_Reception    _reception;
+    #endif
+    #if PJON_STATS_DEVICES > 0
+      PJON_Device_Stats _stats[PJON_STATS_DEVICES];
+    #endif
+    #if PACKET_POOL_LENGTH > 0
+      PJON_Packet_Pool<PACKET_POOL_LENGTH, PACKET_POOL_BLOCK> _pool;
+    #endif
+
+    #if ASYNC_ACK_PEERS > 0
+      boolean           _async_acknowledge = false;
+      uint8_t           _async_window = ASYNC_ACK_WINDOW;
+      PJON_Async_Peer   _peers[ASYNC_ACK_PEERS];
+      uint8_t           _peers_next = 0;
+      boolean           _pending_acknowledges = false;
+    #endif
+
+      boolean           _session = false;
+      uint16_t          _session_id = 0;
+    #if SESSION_PEERS > 0
+      PJON_Session_Peer _session_peers[SESSION_PEERS];
+      uint16_t          _session_use = 0;
+    #endif
+
+    #if HEADER_CONTEXTS > 0
+      boolean           _header_compression = false;
+      PJON_Context      _sent_contexts[HEADER_CONTEXTS];
+      uint8_t           _sent_contexts_next = 0;
+      PJON_Context      _received_contexts[HEADER_CONTEXTS];
+      uint8_t           _received_contexts_next = 0;
+    #endif
+
+    #if PJON_COMPRESSION > 0
+      boolean           _compression = false;
+      const uint8_t    *_dictionary = NULL;
+      uint16_t          _dictionary_length = 0;
+      uint8_t           _decompressed[PACKET_MAX_LENGTH];
+    #endif
+
+    #if MAX_REASSEMBLIES > 0
+      PJON_Reassembly   _reassemblies[MAX_REASSEMBLIES];
+    #endif
+      uint8_t           _transfer = 0;
+      boolean           _segment_lost = false;
+
+      uint32_t          _hold_off_end = 0;
+      uint32_t          _receive_duration = 0; // Of a receive() finding nothing
+    #if PJON_BURST > 0
+      uint32_t          _burst_duration = 0;
+      uint32_t          _burst_start = 0;
+      boolean           _bursting = false;
+    #endif
     protected:
       uint8_t   _device_id;
+      boolean   _receiving = false; // A received packet in data is being handled
   };
 #endif
@@ -52,6 +52,9 @@ limitations under the License. */
   #define PJONDefines_h
   #include "utils/CRC8.h"
   #include "utils/CRC32.h"
+  #include "utils/PacketPool.h"
+  #include "utils/Compression.h"
+  #include "utils/ErrorCorrection.h"
 
   /* Device id of the master */
   #define MASTER_ID   254
@@ -88,6 +91,13 @@ limitations under the License. */
   /* Internal constants */
   #define FAIL       65535
   #define TO_BE_SENT 74
+  #define WAITING_ACK 75
+
+  /* Header compression states of a receiver (see PJON::update_context) */
+  #define CONTEXT_PROPOSED  0 // Sent with the bus ids and the context index
+  #define CONTEXT_CONFIRMED 1 // Sent with the context index instead of the bus ids
+  #define CONTEXT_PROBING   2 // Proposal not acknowledged, sent without context
+  #define CONTEXT_REFUSED   3 // Context not supported, sent without context
 
   /* HEADER CONFIGURATION:
   Thanks to the header byte the transmitter is able to instruct
@@ -107,12 +117,18 @@ limitations under the License. */
   #define ENCODING_BIT      0B0000010000000000 // 1 - Encoding info | 0 - Not including encoding ingo
   #define DATA_COMP_BIT     0B0000001000000000 // 1 - Data compression | 0 - No data compression
   #define ENCRYPTION_BIT    0B0000000100000000 // 1 - Encrypted data | 0 - Not encrypted data
+  #define HEADER_BYTE_3_BIT 0B1000000000000000 // 1 - 3 bytes header | 0 - 2 bytes header
+  /* Third header byte, reserved by the specification and used only by the
+     header compression (see PJON::set_header_compression): */
+  #define CONTEXT_BIT       B00000001 // 1 - Context index included | 0 - No context
+  #define CONTEXT_ONLY_BIT  B00000010 // 1 - Bus ids replaced by the context | 0 - Bus ids included
 
   /* ERRORS: */
   #define CONNECTION_LOST     101
   #define PACKETS_BUFFER_FULL 102
   #define CONTENT_TOO_LONG    104
   #define ID_ACQUISITION_FAIL 105
+  #define PACKET_POOL_FULL    106
   #define DEVICES_BUFFER_FULL 254
 
   /* CONSTRAINTS:
@@ -133,6 +149,21 @@ limitations under the License. */
     #define MAX_PACKETS          5
   #endif
 
+  /* Index of a packet in the packet buffer */
+  #if MAX_PACKETS > 255
+    typedef uint16_t PJON_Packet_Index;
+  #else
+    typedef uint8_t  PJON_Packet_Index;
+  #endif
+
+  /* Maximum time a packet waits in the send list before its transmission
+     time is checked again (about 17 minutes) if PJON_SEND_HEAP is 1,
+     packets scheduled later are checked more than once. Must be lower than
+     2^31 microseconds. */
+  #ifndef MAX_SCHEDULE_INTERVAL
+    #define MAX_SCHEDULE_INTERVAL 0x40000000ul
+  #endif
+
   /* Max packet length, higher if necessary.
      The max packet length defines the length of packets pre-allocated buffers
      so it strongly affects memory consumption */
@@ -140,6 +171,166 @@ limitations under the License. */
     #define PACKET_MAX_LENGTH   50
   #endif
 
+  /* Max length of the bytes preceding the content: id, header (up to 3
+     bytes), length (2 bytes if extended), bus ids, sender id, context,
+     session id, segment info and sequence ids (see PJON::compose_header) */
+  #define HEADER_MAX_LENGTH     27
+
+  /* Packet pool length in bytes, if higher than 0 the content of the packets
+     in the send list is allocated from a pool of this length instead of
+     reserving PACKET_MAX_LENGTH bytes for each of the MAX_PACKETS packets, so
+     many short packets and a few long ones can share the same memory. If
+     the pool has no room PACKET_POOL_FULL error is thrown. */
+  #ifndef PACKET_POOL_LENGTH
+    #define PACKET_POOL_LENGTH  0
+  #endif
+
+  /* Smallest block allocated from the packet pool, blocks are allocated in
+     sizes of PACKET_POOL_BLOCK multiplied by a power of 2 (see
+     utils/PacketPool.h). A byte of metadata is used for each block */
+  #ifndef PACKET_POOL_BLOCK
+    #define PACKET_POOL_BLOCK   16
+  #endif
+
+  #if PACKET_POOL_LENGTH > 0 && PACKET_POOL_BLOCK < 4
+    #error "PACKET_POOL_BLOCK must be at least 4 bytes"
+  #endif
+
+  /* Link statistics (see PJON::get_stats): if higher than 0, transmission
+     attempts and their outcome, bytes, time waited in the send list and
+     response round trip times are counted for up to PJON_STATS_DEVICES
+     devices packets are sent to or received from. Devices over the limit
+     are counted together in the last entry. */
+  #ifndef PJON_STATS_DEVICES
+    #define PJON_STATS_DEVICES  0
+  #endif
+
+  /* Timing statistics of packets sent repeatedly (see PJON::get_jitter):
+     if higher than 0 how late their transmission is handled is recorded */
+  #ifndef PJON_JITTER_STATS
+    #define PJON_JITTER_STATS   0
+  #endif
+
+  /* Reception statistics (see PJON::get_reception): if higher than 0 the
+     bytes and packets received, skipped and corrected are counted */
+  #ifndef PJON_RECEPTION_STATS
+    #define PJON_RECEPTION_STATS 0
+  #endif
+
+  /* Buckets of the round trip time histogram: bucket n counts the responses
+     received in less than PJON_RTT_RESOLUTION << n microseconds (and more
+     than the previous bucket), the last one all the slower responses */
+  #ifndef PJON_RTT_BUCKETS
+    #define PJON_RTT_BUCKETS    10
+  #endif
+
+  #ifndef PJON_RTT_RESOLUTION
+    #define PJON_RTT_RESOLUTION 250
+  #endif
+
+  /* Content compression (see PJON::set_compression): if higher than 0 the
+     contents of the packets with DATA_COMP_BIT set are compressed and
+     decompressed (utils/Compression.h), PACKET_MAX_LENGTH bytes are used to
+     decompress the packets received. If 0 they are refused. */
+  #ifndef PJON_COMPRESSION
+    #define PJON_COMPRESSION    0
+  #endif
+
+  /* Maximum number of packets delivered in a single frame if supported by
+     the strategy (EthernetTCP and LocalUDP). Packets waiting to be sent to the
+     same receiver are delivered together and acknowledged with a bitmap.
+     Batching is disabled by default, all devices of the bus should set the
+     same value because it affects the strategies reception buffer length. */
+  #ifndef MAX_BATCH_PACKETS
+    #define MAX_BATCH_PACKETS    1
+  #endif
+
+  /* Send list scheduling (see PJON::schedule): if 1 the free slots are
+     kept in a queue and the packets to be sent in a min-heap ordered by the
+     time they are due, so dispatch and update do not scan the send list
+     (7 more bytes per packet). If 0 update checks every packet, as the few
+     packets of a microcontroller require. Batches are composed from the
+     packets due, so they require it. */
+  #ifndef PJON_SEND_HEAP
+    #if MAX_BATCH_PACKETS > 1
+      #define PJON_SEND_HEAP     1
+    #else
+      #define PJON_SEND_HEAP     0
+    #endif
+  #endif
+
+  #if MAX_BATCH_PACKETS > 1 && PJON_SEND_HEAP == 0
+    #error "MAX_BATCH_PACKETS higher than 1 requires PJON_SEND_HEAP"
+  #endif
+
+  /* Bursts (see PJON::set_burst_duration): if higher than 0 the packets
+     ready can be sent back to back without acquiring the medium again */
+  #ifndef PJON_BURST
+    #define PJON_BURST            0
+  #endif
+
+  /* Asynchronous acknowledge (see PJON::set_asynchronous_acknowledge):
+     Max number of packets sent to the same device and waiting to be
+     acknowledged, at most 32 (the length of the selective acknowledge bitmap).
+     Each device keeps the index of the packets in its window. */
+  #ifndef ASYNC_ACK_WINDOW
+    #define ASYNC_ACK_WINDOW      8
+  #endif
+
+  #if ASYNC_ACK_WINDOW < 1 || ASYNC_ACK_WINDOW > 32
+    #error ASYNC_ACK_WINDOW must be between 1 and 32
+  #endif
+
+  /* Time after which a packet not acknowledged is sent again (microseconds) */
+  #ifndef ASYNC_ACK_TIMEOUT
+    #define ASYNC_ACK_TIMEOUT 100000
+  #endif
+
+  /* Max number of devices exchanging packets with asynchronous acknowledge,
+     if more the least recently added is replaced losing its sequence state.
+     If 0 the asynchronous acknowledge is not available and the packets
+     having ACK_MODE_BIT are refused. */
+  #ifndef ASYNC_ACK_PEERS
+    #define ASYNC_ACK_PEERS       0
+  #endif
+
+  /* Max number of devices whose session ids are remembered to discard the
+     packets received again (see PJON::include_session_id), if more the least
+     recently used is replaced, so it should be at least the number of
+     devices sending packets with session ids at the same time. If 0 the packets having SESSION_BIT are
+     delivered without checking if they were already received. */
+  #ifndef SESSION_PEERS
+    #define SESSION_PEERS         0
+  #endif
+
+  /* Max number of devices sharing a bus ids context in each direction (see
+     PJON::set_header_compression), if more the least recently added is
+     replaced and the packets are sent with the bus ids again. If 0 header
+     compression is not available and the packets having the third header
+     byte are not received. */
+  #ifndef HEADER_CONTEXTS
+    #define HEADER_CONTEXTS       0
+  #endif
+
+  /* Segmentation (see PJON::send_segmented):
+     Max number of segmented payloads reassembled at the same time, if 0
+     the segments received are refused (they can still be sent) */
+  #ifndef MAX_REASSEMBLIES
+    #define MAX_REASSEMBLIES      0
+  #endif
+
+  /* Bytes of each reassembly buffering the segments received out of order
+     (4 bytes are used for each segment), if 0 they are refused until the
+     previous are received. It strongly affects memory consumption */
+  #ifndef SEGMENTATION_BUFFER_LENGTH
+    #define SEGMENTATION_BUFFER_LENGTH 0
+  #endif
+
+  /* Time after which a reassembly not receiving segments can be replaced */
+  #ifndef SEGMENTATION_TIMEOUT
+    #define SEGMENTATION_TIMEOUT 1000000
+  #endif
+
   /* TIMING:
      Maximum number of device id collisions during auto-addressing */
   #define MAX_ACQUIRE_ID_COLLISIONS      10
@@ -160,13 +351,24 @@ limitations under the License. */
 
   struct PJON_Packet {
     uint8_t  attempts;
+  #if PACKET_POOL_LENGTH > 0
+    char     *content;    // Allocated from the packet pool
+  #else
     char     content[PACKET_MAX_LENGTH];
+  #endif
     uint16_t length;
     uint32_t registration;
     uint16_t state;
     uint32_t timing;
   };
 
+  /* Packet segment, a packet can be transmitted as a list of segments
+     (see PJON::send_packet) avoiding to copy them in a single buffer */
+  struct PJON_Segment {
+    const uint8_t *data;
+    uint16_t length;
+  };
+
   /* Last received packet Metainfo */
   struct PacketInfo {
     uint16_t header = 0;
@@ -174,14 +376,180 @@ limitations under the License. */
     uint8_t receiver_bus_id[4];
     uint8_t sender_id = 0;
     uint8_t sender_bus_id[4];
+    /* Position and total length of the payload delivered, the payload of
+       segmented packets (SEGMENTATION_BIT) is delivered in more parts */
+    uint16_t payload_offset = 0;
+    uint16_t payload_length = 0;
+  };
+
+  /* Sequence state of a device exchanging packets with asynchronous acknowledge.
+     Packets sent are numbered by sequence id, their receiver acknowledges the
+     sequence id it expects (all the previous ones were received) and a bitmap
+     of the following ones received. */
+  struct PJON_Async_Peer {
+    uint8_t  id = BROADCAST;      // BROADCAST if not used
+    uint8_t  bus_id[4];
+    uint16_t sequence = 0;        // Sequence id of the next packet sent
+    uint16_t oldest = 0;          // Oldest sequence id sent not acknowledged
+    uint8_t  first = 0;           // Position of oldest in sent
+    bool     blocked = false;     // A packet waits for the window to move forward
+    PJON_Packet_Index sent[ASYNC_ACK_WINDOW]; // Packets sent, from oldest
+    uint16_t expected = 0;        // Sequence id expected from the device
+    uint32_t received = 0;        // Sequence ids received, bit n: expected + n
+    bool     receiving = false;   // A packet was received from the device
+    bool     acknowledge = false; // The acknowledge has to be sent
+  };
+
+  /* Session ids received from a device, to discard the packets sent again
+     because the acknowledge was lost (SESSION_BIT) */
+  struct PJON_Session_Peer {
+    uint8_t  id = BROADCAST;      // BROADCAST if not used
+    uint8_t  bus_id[4];
+    uint16_t last = 0;            // Most recent session id received
+    uint16_t use = 0;             // Lookup count when last used (PJON::get_session_peer)
+    uint32_t received = 0;        // Session ids received, bit n: last - n
+  };
+
+  /* Bus ids context (CONTEXT_BIT) negotiated with a receiver or received
+     from a sender: the bus ids of the packets exchanged are replaced by the
+     sender id and the context index */
+  struct PJON_Context {
+    uint8_t  id = BROADCAST;      // BROADCAST if not used
+    uint8_t  bus_id[4];           // Bus id of the device
+    uint8_t  index = 0;           // Unique for a sender id at its receiver
+    uint8_t  state = CONTEXT_PROPOSED; // Of a receiver (see PJON::update_context)
+  };
+
+  /* Reassembly of a segmented payload: the segments are delivered in order,
+     those received out of order are buffered as offset (2 bytes), length
+     (2 bytes) and data */
+  struct PJON_Reassembly {
+    bool     used = false;
+    uint8_t  sender_id = 0;
+    uint8_t  sender_bus_id[4];
+    uint8_t  transfer = 0;
+    uint16_t length = 0;    // Payload length
+    uint16_t delivered = 0; // Bytes delivered in order
+    uint32_t time = 0;      // Reception time of the last segment
+  #if SEGMENTATION_BUFFER_LENGTH > 0
+    uint16_t buffered = 0;
+    uint8_t  buffer[SEGMENTATION_BUFFER_LENGTH];
+  #endif
+  };
+
+  /* Timing statistics of packets sent repeatedly: how late, in microseconds,
+     their transmission is handled by update() compared to their deadline */
+  struct PJON_Jitter {
+    uint32_t samples = 0;
+    uint32_t min = 0xFFFFFFFF;
+    uint32_t max = 0;
+    uint32_t total = 0; // mean = total / samples
+  };
+
+  /* Reception statistics: packets received directed to this device (or all
+     in router mode) and packets directed to others, whose remaining bytes
+     are discarded without being parsed */
+  struct PJON_Reception {
+    uint32_t parsed = 0;          // Bytes of the packets received
+    uint32_t parsed_packets = 0;
+    uint32_t skipped = 0;         // Bytes of the packets directed to others
+    uint32_t skipped_packets = 0;
+    uint32_t corrected = 0;       // Bytes corrected with the parity (PARITY_BIT)
+  };
+
+  /* Link statistics of a device packets are sent to or received from (see
+     PJON::get_stats), id is NOT_ASSIGNED for the devices counted together
+     over PJON_STATS_DEVICES */
+  struct PJON_Device_Stats {
+    bool     used = false;
+    uint8_t  id = 0;
+    uint8_t  bus_id[4];
+    uint32_t attempts = 0;         // Transmission attempts
+    uint32_t acknowledged = 0;     // Delivered (or acknowledge not requested)
+    uint32_t naks = 0;
+    uint32_t busy = 0;             // Medium busy or not valid response
+    uint32_t fails = 0;            // No response
+    uint32_t lost = 0;             // Dropped after MAX_ATTEMPTS (CONNECTION_LOST)
+    uint32_t bytes_sent = 0;       // Bytes of all attempts
+    uint32_t bytes_received = 0;   // Bytes of the packets received (with sender info)
+    uint32_t packets_received = 0;
+    uint32_t dequeued = 0;         // Packets of the send list attempted the first time
+    uint32_t queue_wait = 0;       // Total microseconds they waited, mean = queue_wait / dequeued
+    uint32_t queue_wait_max = 0;
+    uint32_t rtt[PJON_RTT_BUCKETS] = {}; // Round trip time histogram
   };
 
   typedef void (* receiver)(uint8_t *payload, uint16_t length, const PacketInfo &packet_info);
   typedef void (* error)(uint8_t code, uint8_t data);
+  typedef bool (* route_handler)(
+    const uint8_t *packet,
+    uint16_t length,
+    const PacketInfo &packet_info,
+    void *custom_pointer
+  );
 
   static void dummy_receiver_handler(uint8_t *payload, uint16_t length, const PacketInfo &packet_info) {};
   static void dummy_error_handler(uint8_t code, uint8_t data) {};
 
+  /* Strategy optional features detection:
+     Optional methods are detected at compile time, if a strategy does not
+     implement them PJON falls back to the standard strategy methods. */
+
+  template<bool value>
+  struct PJON_Bool { };
+
+  /* Segmented transmission:
+     bool send_string_begin(uint16_t length)
+     void send_string_segment(const uint8_t *string, uint16_t length)
+     void send_string_end() */
+
+  template<typename Strategy>
+  struct PJON_Supports_Segments {
+    template<typename S> static char test(decltype(&S::send_string_segment));
+    template<typename S> static long test(...);
+    static const bool value = sizeof(test<Strategy>(0)) == sizeof(char);
+    typedef PJON_Bool<value> type;
+  };
+
+  /* Batched transmission (used only if MAX_BATCH_PACKETS > 1):
+     bool send_batch(const PJON_Segment *packets, uint8_t count)
+     uint16_t receive_batch_response(uint8_t *bitmap, uint8_t count) */
+
+  template<typename Strategy>
+  struct PJON_Supports_Batch {
+    template<typename S> static char test(decltype(&S::send_batch));
+    template<typename S> static long test(...);
+    static const bool value =
+      (MAX_BATCH_PACKETS > 1) && (sizeof(test<Strategy>(0)) == sizeof(char));
+    typedef PJON_Bool<value> type;
+  };
+
+  /* Frame reception, used by strategies receiving whole packets (datagrams or
+     length prefixed streams) to deliver them at once instead of byte by byte.
+     Copies up to max bytes of the next frame received in buffer and returns
+     its length, or FAIL if no frame is available:
+     uint16_t receive_frame(uint8_t *buffer, uint16_t max) */
+
+  template<typename Strategy>
+  struct PJON_Supports_Frames {
+    template<typename S> static char test(decltype(&S::receive_frame));
+    template<typename S> static long test(...);
+    static const bool value = sizeof(test<Strategy>(0)) == sizeof(char);
+    typedef PJON_Bool<value> type;
+  };
+
+  /* Waiting for data (used by receive(duration) if present), returns
+     true if data may be available, false if duration_us elapsed:
+     bool wait(uint32_t duration_us) */
+
+  template<typename Strategy>
+  struct PJON_Supports_Wait {
+    template<typename S> static char test(decltype(&S::wait));
+    template<typename S> static long test(...);
+    static const bool value = sizeof(test<Strategy>(0)) == sizeof(char);
+    typedef PJON_Bool<value> type;
+  };
+
   /* Check equality between two bus ids */
 
   boolean bus_id_equality(const uint8_t *name_one, const uint8_t *name_two) {
@@ -0,0 +1,330 @@
+
+ /*-O//\             __     __
+   |-gfo\           |__| | |  | |\ | ™
+   |!y°o:\          |  __| |__| | \| v6.0
+   |y"s§+`\         multi-master, multi-media communications bus system framework
+  /so+:-..`\        Copyright 2010-2016 by Giovanni Blu Mitolo gioscarab@gmail.com
+  |+/:ngr-*.`\
+  |5/:%&-a3f.:;\
+  \+//u/+g%{osv,,\
+    \=+&/osw+olds.\\
+       \:/+-.-°-:+oss\
+        | |       \oy\\
+        > <
+ ______-| |-___________________________________________________________________
+
+PJONGateway is a PJONRouter for hosts (Linux, macOS) running each bus in its
+own thread, so a slow or blocking transmission on a medium does not stall the
+others. Threads exchange packets only through lock-free queues:
+
+- Each bus has a MPSC queue of packets to be sent, written by the threads of
+  the other buses (packets forwarded) and by the application (forward).
+- Each bus has a SPSC queue of packets directed to the gateway, read by the
+  application thread calling receive, that calls the receiver function.
+
+  PJON<ThroughSerial> serial(bus_id_a, 100);
+  PJON<LocalUDP> udp(bus_id_b, 100);
+  PJONGateway gateway;
+  gateway.add_bus(serial);
+  gateway.add_bus(udp);
+  gateway.add_default_route(1);
+  gateway.set_cpu(0, 2);            // Optional: run the first bus on CPU 2
+  gateway.set_receiver(receiver_function);
+  gateway.start();
+  while(true) gateway.receive();
+
+Buses, routes and options can be changed only while the gateway is stopped,
+when started PJON instances are used only by the thread of their bus.
+ ______________________________________________________________________________
+
+Copyright 2012-2016 by Giovanni Blu Mitolo gioscarab@gmail.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#ifndef PJONGateway_h
+  #define PJONGateway_h
+  #include <PJONRouter.h>
+  #include "utils/PacketQueue.h"
+  #include <thread>
+  #include <mutex>
+  #if defined(__linux__)
+    #include <pthread.h>
+    #include <sched.h>
+  #endif
+
+  /* Packets each queue can contain (power of 2) */
+  #ifndef GATEWAY_QUEUE_LENGTH
+    #define GATEWAY_QUEUE_LENGTH 64
+  #endif
+
+  struct PJON_Gateway_Packet {
+    uint16_t   length;
+    uint8_t    payload_offset;
+    PacketInfo info;
+    uint8_t    data[PACKET_MAX_LENGTH];
+  };
+
+  typedef PJON_MPSC_Queue<PJON_Gateway_Packet, GATEWAY_QUEUE_LENGTH> PJON_Gateway_Outbound;
+  typedef PJON_SPSC_Queue<PJON_Gateway_Packet, GATEWAY_QUEUE_LENGTH> PJON_Gateway_Inbound;
+
+  class PJONGateway : public PJONRouter {
+    public:
+      PJONGateway() {
+        for(uint8_t b = 0; b < ROUTER_MAX_BUSES; b++) {
+          _cpu[b] = -1;
+          _loop[b] = NULL;
+          _loop_pointer[b] = NULL;
+        }
+      };
+
+      ~PJONGateway() {
+        stop();
+      };
+
+
+      /* Connect a bus to the gateway, returns its number or FAIL: */
+
+      template<typename Strategy>
+      uint16_t add_bus(PJON<Strategy> &bus) {
+        if(_running) return FAIL;
+        uint16_t b = PJONRouter::add_bus(bus);
+        if(b == FAIL) return FAIL;
+        _send[b] = _buses[b].forward;
+        _room[b] = room<Strategy>;
+        _overhead[b] = overhead<Strategy>;
+        _device_ids[b] = bus.device_id();
+      #if PJON_STATS_DEVICES > 0
+        _stats[b] = stats<Strategy>;
+      #endif
+        _buses[b].target = &_outbound[b];
+        _buses[b].forward = enqueue;
+        bus.set_route_handler(route, &_buses[b]);
+        return b;
+      };
+
+
+      /* Run the thread of the bus only on a CPU (-1 any, only on Linux): */
+
+      void set_cpu(uint8_t bus, int16_t cpu) {
+        if(bus < ROUTER_MAX_BUSES) _cpu[bus] = cpu;
+      };
+
+
+      /* Set a function called by the thread of the bus after each receive
+         and update, for example to handle the strategy or to run the other
+         devices of a simulated medium: */
+
+      void set_loop(uint8_t bus, void (*loop)(void *), void *custom_pointer = NULL) {
+        if(bus >= ROUTER_MAX_BUSES) return;
+        _loop[bus] = loop;
+        _loop_pointer[bus] = custom_pointer;
+      };
+
+
+      /* Set the function receiving the packets directed to the gateway, it
+         is called by receive in the application thread: */
+
+      void set_receiver(receiver r) {
+        _receiver = r;
+      };
+
+
+      /* Start a thread for each bus: */
+
+      bool start() {
+        if(_running) return false;
+        _running = true;
+        for(uint8_t b = 0; b < _bus_count; b++) _threads[b] = std::thread(&PJONGateway::run, this, b);
+        return true;
+      };
+
+
+      /* Stop the threads, packets still in the queues are kept: */
+
+      void stop() {
+        if(!_running) return;
+        _running = false;
+        for(uint8_t b = 0; b < _bus_count; b++) _threads[b].join();
+      };
+
+      bool running() const {
+        return _running;
+      };
+
+
+      /* Send a packet (already composed) through a bus, it can be called by
+         any thread, returns FAIL if the queue of the bus is full: */
+
+      uint16_t forward(uint8_t bus, const uint8_t *packet, uint16_t length) {
+        if(bus >= _bus_count || length > PACKET_MAX_LENGTH) return FAIL;
+        return enqueue(&_outbound[bus], packet, length);
+      };
+
+
+      /* Call the receiver function for each packet directed to the gateway
+         received by the buses, returns the number of packets received: */
+
+      uint16_t receive() {
+        uint16_t received = 0;
+        for(uint8_t b = 0; b < _bus_count; b++) {
+          PJON_Gateway_Packet *p;
+          while((p = _inbound[b].front())) {
+            _receiver(p->data + p->payload_offset, p->info.payload_length, p->info);
+            _inbound[b].pop();
+            received++;
+          }
+        }
+        return received;
+      };
+
+    #if PJON_STATS_DEVICES > 0
+
+      /* Copy the link statistics of a bus in destination (at most max
+         entries), returns the number of entries copied. It can be called by
+         any thread: if the gateway is running the copy is made by the
+         thread of the bus between two updates. */
+
+      uint8_t get_stats(uint8_t bus, PJON_Device_Stats *destination, uint8_t max) {
+        if(bus >= _bus_count) return 0;
+        if(!_running) return _stats[bus](_buses[bus].bus, destination, max);
+        std::lock_guard<std::mutex> lock(_stats_mutex);
+        _stats_destination = destination;
+        _stats_max = max;
+        _stats_request[bus].store(true, std::memory_order_release);
+        while(_stats_request[bus].load(std::memory_order_acquire) && _running)
+          std::this_thread::yield();
+        if(_stats_request[bus].exchange(false)) // Stopped before the copy
+          return _stats[bus](_buses[bus].bus, destination, max);
+        return _stats_count;
+      };
+
+    #endif
+
+    private:
+
+      /* Thread of a bus: sends the packets of its queue while its send list
+         has room, then receives and updates the bus */
+
+      void run(uint8_t b) {
+      #if defined(__linux__)
+        if(_cpu[b] >= 0) {
+          cpu_set_t set;
+          CPU_ZERO(&set);
+          CPU_SET(_cpu[b], &set);
+          pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        }
+      #endif
+        PJON_Router_Bus &bus = _buses[b];
+        while(_running.load(std::memory_order_relaxed)) {
+          PJON_Gateway_Packet *p;
+          while(_room[b](bus.bus) && (p = _outbound[b].front())) {
+            if(_send[b](bus.bus, p->data, p->length) == FAIL) break;
+            _outbound[b].pop();
+          }
+          bus.receive(bus.bus);
+          bus.update(bus.bus);
+          if(_loop[b]) _loop[b](_loop_pointer[b]);
+        #if PJON_STATS_DEVICES > 0
+          if(_stats_request[b].load(std::memory_order_acquire)) {
+            _stats_count = _stats[b](bus.bus, _stats_destination, _stats_max);
+            _stats_request[b].store(false, std::memory_order_release);
+          }
+        #endif
+        }
+      };
+
+
+      /* Route handler of the buses: packets directed to another bus are
+         added to its queue, packets directed to the gateway to the queue
+         read by receive. If the queue is full the packet is not
+         acknowledged, so it is sent again. */
+
+      static bool route(
+        const uint8_t *packet,
+        uint16_t length,
+        const PacketInfo &packet_info,
+        void *custom_pointer
+      ) {
+        PJON_Router_Bus *source = (PJON_Router_Bus *)custom_pointer;
+        PJONGateway *gateway = (PJONGateway *)source->router;
+        uint8_t b = source->index;
+        uint16_t bus = gateway->next_bus(*source, packet_info);
+        if(bus != FAIL) return enqueue(&gateway->_outbound[bus], packet, length) != FAIL;
+        if(
+          (packet_info.receiver_id != BROADCAST && packet_info.receiver_id != gateway->_device_ids[b]) ||
+          ((packet_info.header & MODE_BIT) && to_key(packet_info.receiver_bus_id) != gateway->_bus_ids[b])
+        ) return false; // Directed to another device of the bus
+        PJON_Gateway_Packet *p = gateway->_inbound[b].claim();
+        if(!p) return false;
+        uint8_t overhead = gateway->_overhead[b](source->bus, packet_info.header);
+        memcpy(p->data, packet, length);
+        p->length = length;
+        p->payload_offset = overhead - ((packet_info.header & CRC_BIT) ? 4 : 1);
+        p->info = packet_info;
+        p->info.payload_offset = 0;
+        p->info.payload_length = length - overhead;
+        gateway->_inbound[b].publish();
+        return true;
+      };
+
+
+      static uint16_t enqueue(void *target, const uint8_t *packet, uint16_t length) {
+        PJON_Gateway_Outbound *queue = (PJON_Gateway_Outbound *)target;
+        uint32_t ticket;
+        PJON_Gateway_Packet *p = queue->claim(ticket);
+        if(!p) return FAIL;
+        memcpy(p->data, packet, length);
+        p->length = length;
+        queue->publish(ticket);
+        return ACK;
+      };
+
+      template<typename Strategy>
+      static bool room(void *bus) {
+        return ((PJON<Strategy> *)bus)->get_packets_count() < MAX_PACKETS;
+      };
+
+    #if PJON_STATS_DEVICES > 0
+      template<typename Strategy>
+      static uint8_t stats(void *bus, PJON_Device_Stats *destination, uint8_t max) {
+        return ((PJON<Strategy> *)bus)->get_stats(destination, max);
+      };
+    #endif
+
+      template<typename Strategy>
+      static uint8_t overhead(void *bus, uint16_t header) {
+        return ((PJON<Strategy> *)bus)->packet_overhead(header);
+      };
+
+      PJON_Gateway_Outbound _outbound[ROUTER_MAX_BUSES];
+      PJON_Gateway_Inbound  _inbound[ROUTER_MAX_BUSES];
+      std::thread           _threads[ROUTER_MAX_BUSES];
+      std::atomic<bool>     _running{false};
+      int16_t               _cpu[ROUTER_MAX_BUSES];
+      uint8_t               _device_ids[ROUTER_MAX_BUSES];
+      void               (* _loop[ROUTER_MAX_BUSES])(void *);
+      void                 *_loop_pointer[ROUTER_MAX_BUSES];
+      receiver              _receiver = dummy_receiver_handler;
+      uint16_t           (* _send[ROUTER_MAX_BUSES])(void *bus, const uint8_t *packet, uint16_t length);
+      bool               (* _room[ROUTER_MAX_BUSES])(void *bus);
+      uint8_t            (* _overhead[ROUTER_MAX_BUSES])(void *bus, uint16_t header);
+    #if PJON_STATS_DEVICES > 0
+      uint8_t            (* _stats[ROUTER_MAX_BUSES])(void *bus, PJON_Device_Stats *destination, uint8_t max);
+      std::atomic<bool>     _stats_request[ROUTER_MAX_BUSES] = {};
+      std::mutex            _stats_mutex;
+      PJON_Device_Stats    *_stats_destination = NULL;
+      uint8_t               _stats_max = 0;
+      uint8_t               _stats_count = 0;
+    #endif
+  };
+#endif
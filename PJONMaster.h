@@ -65,7 +65,7 @@ limitations under the License. */
     bool     state        = 0;
   };
 
-  template<typename Strategy = SoftwareBitBang>
+  template<typename Strategy = PJON_DEFAULT_STRATEGY>
   class PJONMaster : public PJON<Strategy> {
     public:
       Device_reference ids[MAX_DEVICES];
@@ -271,6 +271,8 @@ limitations under the License. */
 
         uint8_t overhead = PJON<Strategy>::packet_overhead(this->data[1]);
         uint8_t CRC_overhead = (this->data[1] & CRC_BIT) ? 4 : 1;
+        boolean receiving = this->_receiving;
+        this->_receiving = true;
 
         if(this->last_packet_info.header & ADDRESS_BIT && this->data[2] > 4) {
           uint8_t request = this->data[overhead - CRC_overhead];
@@ -300,6 +302,7 @@ limitations under the License. */
         }
 
         _master_receiver(this->data + (overhead - CRC_overhead), this->data[2] - overhead, this->last_packet_info);
+        this->_receiving = receiving;
         return ACK;
       };
 
@@ -330,7 +333,7 @@ limitations under the License. */
 
       /* Master packet handling update: */
 
-      uint8_t update() {
+      uint16_t update() {
         free_reserved_ids_expired();
         _current_pjon_master = this;
         return PJON<Strategy>::update();
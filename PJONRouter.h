@@ -0,0 +1,315 @@
+
+ /*-O//\             __     __
+   |-gfo\           |__| | |  | |\ | ™
+   |!y°o:\          |  __| |__| | \| v6.0
+   |y"s§+`\         multi-master, multi-media communications bus system framework
+  /so+:-..`\        Copyright 2010-2016 by Giovanni Blu Mitolo gioscarab@gmail.com
+  |+/:ngr-*.`\
+  |5/:%&-a3f.:;\
+  \+//u/+g%{osv,,\
+    \=+&/osw+olds.\\
+       \:/+-.-°-:+oss\
+        | |       \oy\\
+        > <
+ ______-| |-___________________________________________________________________
+
+PJONRouter forwards packets between more PJON instances, each connected to a
+different bus (also using different strategies), choosing the bus through a
+routing table. A route associates a prefix of the receiver's bus id and device
+id to a bus, the longest prefix matching the receiver is chosen:
+
+  router.add_route(bus_id, 16, 1);           // 0.1.*.*       -> bus 1
+  router.add_route(bus_id, 32, 2);           // 0.1.2.3       -> bus 2
+  router.add_route(bus_id, 40, 0, 45);       // 0.1.2.3 id 45 -> bus 0
+  router.add_default_route(1);               // Any other     -> bus 1
+
+Packets forwarded are acknowledged by the router on behalf of their receiver
+(synchronous acknowledge) and are sent again by the router until delivered on
+the next bus. Packets with asynchronous acknowledge are forwarded as they are,
+their receiver acknowledges them to their sender through the router.
+ ______________________________________________________________________________
+
+Copyright 2012-2016 by Giovanni Blu Mitolo gioscarab@gmail.com
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#ifndef PJONRouter_h
+  #define PJONRouter_h
+  #include <PJON.h>
+
+  /* Maximum number of routes */
+  #ifndef ROUTER_MAX_ROUTES
+    #define ROUTER_MAX_ROUTES 32
+  #endif
+
+  /* Maximum number of buses connected to the router */
+  #ifndef ROUTER_MAX_BUSES
+    #define ROUTER_MAX_BUSES 4
+  #endif
+
+  /* Length in bits of a route matching bus id and device id */
+  #define ROUTE_MAX_PREFIX 40
+
+  /* Route to the bus numbered bus, prefix_length (0 - 40) bits of bus_id
+     and device_id are compared with the receiver: 0 is the default route,
+     32 a bus, 40 a single device */
+  struct PJON_Route {
+    uint32_t bus_id;
+    uint8_t  device_id;
+    uint8_t  prefix_length;
+    uint8_t  bus;
+  };
+
+  class PJONRouter;
+
+  /* Bus connected to the router, packets directed to it are passed to
+     forward with target (the PJON instance or a queue, see PJONGateway.h) */
+  struct PJON_Router_Bus {
+    void       *bus;
+    void       *target;
+    PJONRouter *router;
+    uint8_t     index;
+    uint16_t (* forward)(void *target, const uint8_t *packet, uint16_t length);
+    uint16_t (* update)(void *bus);
+    uint16_t (* receive)(void *bus);
+  };
+
+  class PJONRouter {
+    public:
+      PJONRouter() {
+        clear_routes();
+      };
+
+
+      /* Connect a bus to the router, returns its number or FAIL. The bus is
+         set in router mode and a route to its own bus id is added: */
+
+      template<typename Strategy>
+      uint16_t add_bus(PJON<Strategy> &bus) {
+        if(_bus_count == ROUTER_MAX_BUSES) return FAIL;
+        PJON_Router_Bus &b = _buses[_bus_count];
+        b.bus = &bus;
+        b.target = &bus;
+        b.router = this;
+        b.index = _bus_count;
+        b.forward = forward_packet<Strategy>;
+        b.update = update_bus<Strategy>;
+        b.receive = receive_bus<Strategy>;
+        _bus_ids[_bus_count] = to_key(bus.bus_id);
+        bus.set_router(true);
+        bus.set_route_handler(route, &b);
+        add_route(bus.bus_id, 32, _bus_count);
+        return _bus_count++;
+      };
+
+
+      /* Add a route (or update the bus of an existing one), returns false if
+         the routing table is full or the parameters are not valid: */
+
+      bool add_route(
+        const uint8_t *bus_id,
+        uint8_t prefix_length,
+        uint8_t bus,
+        uint8_t device_id = 0
+      ) {
+        if(prefix_length > ROUTE_MAX_PREFIX || bus >= ROUTER_MAX_BUSES) return false;
+        PJON_Route r;
+        r.bus_id = to_key(bus_id);
+        r.device_id = device_id;
+        r.prefix_length = prefix_length;
+        r.bus = bus;
+        mask(r);
+        uint16_t i = search(r.bus_id, r.device_id, prefix_length);
+        if(i < _end[prefix_length] && equal(_routes[i], r)) {
+          _routes[i].bus = bus;
+          return true;
+        }
+        if(_count == ROUTER_MAX_ROUTES) return false;
+        memmove(_routes + i + 1, _routes + i, (_count - i) * sizeof(PJON_Route));
+        _routes[i] = r;
+        for(uint8_t l = 0; l <= prefix_length; l++) _end[l]++;
+        _count++;
+        return true;
+      };
+
+
+      /* Route any receiver not matched by other routes: */
+
+      bool add_default_route(uint8_t bus) {
+        const uint8_t any[4] = {0, 0, 0, 0};
+        return add_route(any, 0, bus);
+      };
+
+
+      /* Remove a route, returns false if not present: */
+
+      bool remove_route(const uint8_t *bus_id, uint8_t prefix_length, uint8_t device_id = 0) {
+        if(prefix_length > ROUTE_MAX_PREFIX) return false;
+        PJON_Route r;
+        r.bus_id = to_key(bus_id);
+        r.device_id = device_id;
+        r.prefix_length = prefix_length;
+        mask(r);
+        uint16_t i = search(r.bus_id, r.device_id, prefix_length);
+        if(i == _end[prefix_length] || !equal(_routes[i], r)) return false;
+        memmove(_routes + i, _routes + i + 1, (_count - i - 1) * sizeof(PJON_Route));
+        for(uint8_t l = 0; l <= prefix_length; l++) _end[l]--;
+        _count--;
+        return true;
+      };
+
+
+      /* Remove all routes: */
+
+      void clear_routes() {
+        _count = 0;
+        for(uint8_t l = 0; l <= ROUTE_MAX_PREFIX; l++) _end[l] = 0;
+      };
+
+
+      /* Find the bus where the device is reachable, using the longest prefix
+         matching it. Returns FAIL if no route matches: */
+
+      uint16_t find_route(const uint8_t *bus_id, uint8_t device_id) const {
+        uint32_t key = to_key(bus_id);
+        for(int8_t l = ROUTE_MAX_PREFIX; l >= 0; l--) {
+          uint16_t begin = (l == ROUTE_MAX_PREFIX) ? 0 : _end[l + 1];
+          if(begin == _end[l]) continue;
+          PJON_Route r;
+          r.bus_id = key;
+          r.device_id = device_id;
+          r.prefix_length = l;
+          mask(r);
+          uint16_t i = search(r.bus_id, r.device_id, l);
+          if(i < _end[l] && equal(_routes[i], r)) return _routes[i].bus;
+        }
+        return FAIL;
+      };
+
+
+      /* Routing table, ordered by prefix length (longest first): */
+
+      const PJON_Route *get_routes() const { return _routes; };
+      uint16_t get_routes_count() const { return _count; };
+      uint8_t get_buses_count() const { return _bus_count; };
+
+
+      /* Receive from all buses and send the packets forwarded: */
+
+      void update() {
+        for(uint8_t b = 0; b < _bus_count; b++) _buses[b].update(_buses[b].bus);
+      };
+
+      void receive() {
+        for(uint8_t b = 0; b < _bus_count; b++) _buses[b].receive(_buses[b].bus);
+      };
+
+      void loop() {
+        receive();
+        update();
+      };
+
+    protected:
+
+      /* Bus where a packet received from source has to be forwarded, FAIL
+         if it stays on its bus: */
+
+      uint16_t next_bus(const PJON_Router_Bus &source, const PacketInfo &packet_info) const {
+        // Broadcasts and local packets stay on their bus
+        if(packet_info.receiver_id == BROADCAST || !(packet_info.header & MODE_BIT))
+          return FAIL;
+        if(to_key(packet_info.receiver_bus_id) == _bus_ids[source.index]) return FAIL;
+        uint16_t bus = find_route(packet_info.receiver_bus_id, packet_info.receiver_id);
+        if(bus >= _bus_count || bus == source.index) return FAIL;
+        return bus;
+      };
+
+
+      /* Route handler of the buses connected: forwards the packet if directed
+         to a device reachable through another bus, returns true if it has
+         been added to the send list of that bus. */
+
+      static bool route(
+        const uint8_t *packet,
+        uint16_t length,
+        const PacketInfo &packet_info,
+        void *custom_pointer
+      ) {
+        PJON_Router_Bus *source = (PJON_Router_Bus *)custom_pointer;
+        uint16_t bus = source->router->next_bus(*source, packet_info);
+        if(bus == FAIL) return false;
+        PJON_Router_Bus &target = source->router->_buses[bus];
+        return target.forward(target.target, packet, length) != FAIL;
+      };
+
+
+      template<typename Strategy>
+      static uint16_t forward_packet(void *bus, const uint8_t *packet, uint16_t length) {
+        return ((PJON<Strategy> *)bus)->forward(packet, length);
+      };
+
+      template<typename Strategy>
+      static uint16_t update_bus(void *bus) {
+        return ((PJON<Strategy> *)bus)->update();
+      };
+
+      template<typename Strategy>
+      static uint16_t receive_bus(void *bus) {
+        return ((PJON<Strategy> *)bus)->receive();
+      };
+
+
+      static uint32_t to_key(const uint8_t *bus_id) {
+        return
+          (uint32_t)bus_id[0] << 24 | (uint32_t)bus_id[1] << 16 |
+          (uint32_t)bus_id[2] << 8 | bus_id[3];
+      };
+
+      /* Clear the bits after the prefix */
+
+      static void mask(PJON_Route &r) {
+        uint8_t l = r.prefix_length;
+        if(l < 32) {
+          r.bus_id = l ? r.bus_id & (0xFFFFFFFF << (32 - l)) : 0;
+          r.device_id = 0;
+        } else r.device_id &= (uint8_t)(0xFF << (ROUTE_MAX_PREFIX - l));
+      };
+
+      static bool equal(const PJON_Route &a, const PJON_Route &b) {
+        return a.bus_id == b.bus_id && a.device_id == b.device_id;
+      };
+
+      /* Position of the first route of the given prefix length not lower
+         than the key (binary search) */
+
+      uint16_t search(uint32_t bus_id, uint8_t device_id, uint8_t prefix_length) const {
+        uint16_t begin = (prefix_length == ROUTE_MAX_PREFIX) ? 0 : _end[prefix_length + 1];
+        uint16_t end = _end[prefix_length];
+        while(begin < end) {
+          uint16_t middle = begin + (end - begin) / 2;
+          const PJON_Route &r = _routes[middle];
+          if(r.bus_id < bus_id || (r.bus_id == bus_id && r.device_id < device_id))
+            begin = middle + 1;
+          else end = middle;
+        }
+        return begin;
+      };
+
+      PJON_Route      _routes[ROUTER_MAX_ROUTES];
+      uint16_t        _count;
+      uint16_t        _end[ROUTE_MAX_PREFIX + 1]; // End of the routes of each prefix length
+      PJON_Router_Bus _buses[ROUTER_MAX_BUSES];
+      uint32_t        _bus_ids[ROUTER_MAX_BUSES];
+      uint8_t         _bus_count = 0;
+  };
+#endif
@@ -57,7 +57,7 @@ limitations under the License. */
   #define PJONSlave_h
   #include <PJON.h>
 
-  template<typename Strategy = SoftwareBitBang>
+  template<typename Strategy = PJON_DEFAULT_STRATEGY>
   class PJONSlave : public PJON<Strategy> {
     public:
 
@@ -104,7 +104,7 @@ limitations under the License. */
 
       void acquire_id_multi_master(uint8_t limit = 0) {
         if(limit >= MAX_ACQUIRE_ID_COLLISIONS)
-          return _slave_error(ID_ACQUISITION_FAIL, FAIL);
+          return _slave_error(ID_ACQUISITION_FAIL, (uint8_t)FAIL);
 
         delay(random(ACQUIRE_ID_DELAY * 0.25, ACQUIRE_ID_DELAY));
         uint32_t time = micros();
@@ -161,11 +161,11 @@ limitations under the License. */
       bool discard_device_id() {
         char request[6] = {
           ID_NEGATE,
-          _rid >> 24,
-          _rid >> 16,
-          _rid >> 8,
-          _rid,
-          this->_device_id
+          (char)(_rid >> 24),
+          (char)(_rid >> 16),
+          (char)(_rid >> 8),
+          (char)_rid,
+          (char)this->_device_id
         };
 
         if(this->send_packet_blocking(
@@ -219,7 +219,7 @@ limitations under the License. */
         if(this->last_packet_info.header & ADDRESS_BIT && this->_device_id != MASTER_ID) {
           uint8_t overhead = this->packet_overhead(this->last_packet_info.header);
           uint8_t CRC_overhead = (this->last_packet_info.header & CRC_BIT) ? 4 : 1;
-          uint8_t rid[4] = {_rid >> 24, _rid >> 16, _rid >> 8, _rid};
+          uint8_t rid[4] = {(uint8_t)(_rid >> 24), (uint8_t)(_rid >> 16), (uint8_t)(_rid >> 8), (uint8_t)_rid};
           char response[6];
           response[1] = rid[0];
           response[2] = rid[1];
@@ -279,15 +279,18 @@ limitations under the License. */
         uint16_t received_data = PJON<Strategy>::receive();
         if(received_data != ACK) return received_data;
 
-        uint8_t overhead = this->packet_overhead(this->data[1]);
+        uint8_t overhead = this->packet_overhead(this->last_packet_info.header);
+        boolean receiving = this->_receiving;
+        this->_receiving = true;
 
         if(!handle_addressing())
           _slave_receiver(
             this->data + (overhead - (this->data[1] & CRC_BIT ? 4 : 1)),
-            this->data[this->data[1] & EXTEND_HEADER_BIT ? 3 : 2] - overhead,
+            this->data[1 + this->header_length(this->data)] - overhead,
             this->last_packet_info
           );
 
+        this->_receiving = receiving;
         return ACK;
       };
 
@@ -318,7 +321,7 @@ limitations under the License. */
 
       /* Slave packet handling update: */
 
-      uint8_t update() {
+      uint16_t update() {
         _current_pjon_slave = this;
         return PJON<Strategy>::update();
       };
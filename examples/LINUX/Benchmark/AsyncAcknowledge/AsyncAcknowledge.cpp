@@ -0,0 +1,78 @@
+/* Synchronous vs asynchronous acknowledge throughput on a simulated link
+   A device sends packets to another through the VirtualBus strategy with
+   the simulated clock, with 5 milliseconds of latency. With the synchronous
+   acknowledge each packet waits for its response (a round trip), with the
+   asynchronous acknowledge up to a window of packets is sent while the
+   acknowledges travel back. Results depend only on the protocol and the
+   simulation parameters.
+
+   Compile from this directory with:
+   g++ -O2 -I../../../.. AsyncAcknowledge.cpp -o AsyncAcknowledge && ./AsyncAcknowledge */
+
+#define PJON_VIRTUAL_CLOCK
+#define MAX_PACKETS 64
+#define ASYNC_ACK_PEERS 4
+#define ASYNC_ACK_WINDOW 32
+#include <PJON.h>
+#include <stdio.h>
+
+#define PACKETS   1000
+#define CONTENT   "01234567890123456789"
+#define LATENCY   5000
+
+uint32_t received = 0;
+
+void receiver_function(uint8_t *payload, uint16_t length, const PacketInfo &packet_info) {
+  received++;
+};
+
+void poll(void *device) {
+  ((PJON<VirtualBus> *)device)->receive();
+};
+
+/* Send PACKETS packets keeping the send list full, window 0 is synchronous */
+
+void transfer(uint32_t bit_rate, uint8_t window, uint16_t collision_rate) {
+  VirtualBusMedium medium(bit_rate, LATENCY, collision_rate);
+  PJON<VirtualBus> transmitter(1), destination(2);
+  transmitter.strategy.set_medium(medium);
+  destination.strategy.set_medium(medium);
+  destination.strategy.set_poll(poll, &destination);
+  destination.set_receiver(receiver_function);
+  transmitter.set_asynchronous_acknowledge(window > 0, window);
+
+  received = 0;
+  uint32_t sent = 0;
+  uint32_t start = micros();
+  while(sent < PACKETS || transmitter.get_packets_count()) {
+    while(sent < PACKETS && transmitter.get_packets_count() < MAX_PACKETS)
+      if(transmitter.send(2, CONTENT, 20) != FAIL) sent++;
+    transmitter.update();
+    transmitter.receive();
+    destination.receive();
+    if((uint32_t)(micros() - start) > 600000000) break; // 10 minutes
+  }
+  uint32_t duration = micros() - start;
+
+  if(window) printf("asynchronous, window %2u", window);
+  else printf("synchronous,          ");
+  printf(
+    " %8u bps %5.2f%% collisions: %8.1f packets/s, %u received, %u frames\n",
+    bit_rate,
+    collision_rate / 100.0,
+    received * 1000000.0 / duration,
+    received,
+    medium.frames
+  );
+};
+
+int main() {
+  printf("%u packets of 20 bytes, %u us latency:\n", PACKETS, LATENCY);
+  const uint8_t windows[] = { 0, 1, 4, 8, 16, 32 };
+  for(uint8_t w = 0; w < 6; w++) transfer(115200, windows[w], 0);
+  printf("\n");
+  for(uint8_t w = 0; w < 6; w++) transfer(1000000, windows[w], 0);
+  printf("\n");
+  for(uint8_t w = 0; w < 6; w++) transfer(1000000, windows[w], 100);
+  return 0;
+};
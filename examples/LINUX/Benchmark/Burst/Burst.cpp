@@ -0,0 +1,98 @@
+/* Burst transmission benchmark (set_burst_duration)
+   A device queues 20 packets of 4 bytes and sends them calling update(),
+   with synchronous acknowledge. The VirtualBus medium is timed like
+   SoftwareBitBang in STANDARD mode: 472us per byte and can_start listening
+   for 492us plus a random delay up to COLLISION_DELAY. Without bursts each
+   packet acquires the medium, with bursts the packets following the first
+   are sent as soon as the previous is acknowledged, for up to the burst
+   duration. Reported are the medium acquisitions, the time to deliver the
+   queue, the goodput (bytes of content delivered per second) and its
+   improvement. Returns 1 if a packet is not delivered.
+
+   Compile from this directory with:
+   g++ -O2 -I../../../.. Burst.cpp -o Burst && ./Burst */
+
+#define PJON_VIRTUAL_CLOCK
+#define MAX_PACKETS 20
+#define PJON_BURST 1
+#include <PJON.h>
+#include <stdio.h>
+
+#define QUEUES 10
+#define PACKETS 20
+#define CONTENT_LENGTH 4
+
+/* VirtualBus counting the medium acquisitions */
+
+class CountingBus : public VirtualBus {
+  public:
+    uint32_t acquisitions = 0;
+
+    boolean can_start() {
+      acquisitions++;
+      return VirtualBus::can_start();
+    };
+};
+
+PJON<CountingBus> transmitter(1), destination(2);
+uint32_t delivered = 0;
+
+void receiver_function(uint8_t *payload, uint16_t length, const PacketInfo &packet_info) {
+  if(length == CONTENT_LENGTH) delivered++;
+};
+
+void poll(void *) {
+  destination.receive();
+};
+
+/* Goodput in bytes per second sending QUEUES times PACKETS packets */
+
+double measure(uint32_t burst_duration) {
+  VirtualBusMedium medium(16949, 0, 0); // 8 bits every 472us
+  medium.sensing = 492;                 // Padding bit and 9.5 bits
+  transmitter.strategy.set_medium(medium);
+  destination.strategy.set_medium(medium);
+  transmitter.strategy.acquisitions = 0;
+  transmitter.set_burst_duration(burst_duration);
+  delivered = 0;
+  uint32_t start = micros();
+  for(uint16_t q = 0; q < QUEUES; q++) {
+    for(uint16_t p = 0; p < PACKETS; p++)
+      transmitter.send(2, "1234", CONTENT_LENGTH);
+    while(transmitter.get_packets_count()) {
+      transmitter.update();
+      destination.receive();
+    }
+  }
+  uint32_t elapsed = micros() - start;
+  double goodput = (double)delivered * CONTENT_LENGTH * 1000000.0 / elapsed;
+  printf(
+    "  %8u %10.2f %8.1f %10.1f",
+    burst_duration, (double)transmitter.strategy.acquisitions / QUEUES,
+    elapsed / 1000.0 / QUEUES, goodput
+  );
+  return goodput;
+};
+
+int main() {
+  destination.strategy.set_poll(poll);
+  destination.set_receiver(receiver_function);
+  const uint32_t durations[] = {0, 20000, 50000, 200000};
+  printf(
+    "%u queues of %u packets of %u bytes, SoftwareBitBang timing:\n"
+    "  burst us  acq/queue ms/queue goodput B/s  gain\n",
+    QUEUES, PACKETS, CONTENT_LENGTH
+  );
+  bool passed = true;
+  double plain = 0;
+  for(uint8_t d = 0; d < sizeof(durations) / sizeof(durations[0]); d++) {
+    double goodput = measure(durations[d]);
+    if(!d) plain = goodput;
+    printf(" %+5.1f%%\n", (goodput / plain - 1) * 100);
+    if(delivered != QUEUES * PACKETS) {
+      printf("  %u packets not delivered!\n", QUEUES * PACKETS - delivered);
+      passed = false;
+    }
+  }
+  return !passed;
+};
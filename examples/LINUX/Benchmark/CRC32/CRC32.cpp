@@ -0,0 +1,120 @@
+/* CRC32 implementations benchmark
+   Reports bytes per cycle (bytes per nanosecond if the cycle counter is
+   not available) of each compute_crc_32 implementation for buffers from
+   16 bytes to 64 kilobytes. Before measuring, each implementation is
+   checked to be bit-exact with the bit by bit one for every length from 0
+   to 257 bytes starting at every offset from 0 to 7 (so also unaligned),
+   continuing the CRC of a buffer split in two parts, and the bit by bit
+   one is checked with the CRC32 check value of "123456789".
+
+   Compile from this directory with:
+   g++ -O3 -march=native -I../../../.. CRC32.cpp -o CRC32 && ./CRC32 */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+  #include <x86intrin.h>
+  #define TIME_UNIT "cycle"
+  uint64_t now() { return __rdtsc(); };
+#else
+  #define TIME_UNIT "ns"
+  uint64_t now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000ull + t.tv_nsec;
+  };
+#endif
+
+#include "utils/CRC32.h"
+
+typedef uint32_t (*crc_32_implementation)(uint32_t crc, const uint8_t *data, size_t length);
+
+struct Implementation {
+  const char *name;
+  crc_32_implementation update;
+};
+
+Implementation implementations[] = {
+  {"tableless",  crc_32_update_tableless},
+  {"nibble",     crc_32_update_nibble},
+  {"table",      crc_32_update_table},
+  {"slice-by-8", crc_32_update_slice_by_8},
+#if defined(CRC32_HARDWARE_AVAILABLE)
+  {"hardware",   crc_32_update_hardware}
+#endif
+};
+
+#define BUFFER_LENGTH 65536
+#define BYTES_PER_TEST 16777216
+
+uint8_t buffer[BUFFER_LENGTH];
+volatile uint32_t result; // Avoids the computation to be optimized away
+
+#define CHECK_LENGTH 257
+#define CHECK_OFFSETS 8
+
+bool check(const Implementation &implementation) {
+  for(uint8_t offset = 0; offset < CHECK_OFFSETS; offset++)
+    for(uint16_t length = 0; length <= CHECK_LENGTH; length++) {
+      const uint8_t *data = buffer + offset;
+      uint32_t expected = crc_32_update_tableless(0xFFFFFFFF, data, length);
+      uint16_t half = length / 2;
+      if(
+        implementation.update(0xFFFFFFFF, data, length) != expected ||
+        implementation.update(
+          implementation.update(0xFFFFFFFF, data, half), data + half, length - half
+        ) != expected
+      ) {
+        printf(
+          "%s result is not bit-exact with length %u at offset %u!\n",
+          implementation.name, length, offset
+        );
+        return false;
+      }
+    }
+  return true;
+};
+
+int main() {
+  for(uint32_t i = 0; i < BUFFER_LENGTH; i++) buffer[i] = rand();
+  uint8_t count = sizeof(implementations) / sizeof(Implementation);
+
+  if(~crc_32_update_tableless(0xFFFFFFFF, (const uint8_t *)"123456789", 9) != 0xCBF43926) {
+    printf("tableless check value is wrong!\n");
+    return 1;
+  }
+  for(uint8_t i = 0; i < count; i++)
+    if(!check(implementations[i])) return 1;
+  printf("%u implementations bit-exact\n\n", count);
+
+  printf("Bytes per " TIME_UNIT "\n%10s", "length");
+  for(uint8_t i = 0; i < count; i++) printf("%12s", implementations[i].name);
+  printf("\n");
+
+  for(uint32_t length = 16; length <= BUFFER_LENGTH; length *= 4) {
+    printf("%10u", length);
+    uint32_t expected = crc_32_update_tableless(0xFFFFFFFF, buffer, length);
+    uint32_t iterations = BYTES_PER_TEST / length;
+    for(uint8_t i = 0; i < count; i++) {
+      /* Tableless is slow, a smaller sample is enough */
+      uint32_t runs = (i == 0) ? iterations / 16 + 1 : iterations;
+      uint32_t crc = 0;
+      uint64_t start = now();
+      for(uint32_t r = 0; r < runs; r++)
+        crc ^= implementations[i].update(0xFFFFFFFF ^ r, buffer, length);
+      uint64_t elapsed = now() - start;
+      if(implementations[i].update(0xFFFFFFFF, buffer, length) != expected) {
+        printf("\n%s result is not bit-exact!\n", implementations[i].name);
+        return 1;
+      }
+      result = crc;
+      printf("%12.3f", (double)runs * length / (elapsed ? elapsed : 1));
+    }
+    printf("\n");
+  }
+  return 0;
+};
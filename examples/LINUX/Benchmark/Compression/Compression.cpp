@@ -0,0 +1,167 @@
+/* Content compression benchmark (DATA_COMP_BIT, utils/Compression.h)
+   For typical payloads of a sensor network are reported the compression
+   ratio, the length of the frame sent with and without compression and the
+   encode and decode time per byte of content (cycles, nanoseconds if the
+   cycle counter is not available), without and with a static dictionary
+   containing the keys of the JSON messages. Each payload is also sent
+   through compose_packet and receive() to check that it is delivered as it
+   was. Payloads that do not get shorter are sent as they are.
+
+   Compile from this directory with:
+   g++ -O2 -I../../../.. Compression.cpp -o Compression && ./Compression */
+
+#define PJON_COMPRESSION 1
+#define PACKET_MAX_LENGTH 300
+#include <PJON.h>
+#include <stdio.h>
+#if defined(__x86_64__) || defined(__i386__)
+  #include <x86intrin.h>
+  #define TIME_UNIT "cycles"
+  uint64_t now() { return __rdtsc(); };
+#else
+  #define TIME_UNIT "ns"
+  uint64_t now() {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000ull + t.tv_nsec;
+  };
+#endif
+
+#define RUNS 2000
+
+/* Strategy receiving the last frame sent */
+
+class Loopback {
+  public:
+    uint8_t  frame[PACKET_MAX_LENGTH];
+    uint16_t length = 0;
+
+    uint16_t receive_frame(uint8_t *data, uint16_t max_length) {
+      if(!length || length > max_length) return FAIL;
+      memcpy(data, frame, length);
+      uint16_t received = length;
+      length = 0;
+      return received;
+    };
+
+    boolean  can_start() { return true; };
+    uint16_t receive_byte() { return FAIL; };
+    uint16_t receive_response() { return ACK; };
+    void     send_response(uint8_t response) { };
+    void     send_string(uint8_t *string, uint16_t length) { };
+};
+
+const uint8_t dictionary[] =
+  "{\"id\":,\"temperature\":,\"humidity\":,\"pressure\":,\"battery\":,"
+  "\"status\":\"ok\",\"time\":}";
+
+struct Payload {
+  const char *name;
+  char content[256];
+  uint16_t length;
+};
+
+Payload payloads[5];
+
+uint8_t received[PACKET_MAX_LENGTH];
+uint16_t received_length = 0;
+
+void receiver_function(uint8_t *payload, uint16_t length, const PacketInfo &packet_info) {
+  memcpy(received, payload, length);
+  received_length = length;
+};
+
+void prepare() {
+  payloads[0].name = "JSON reading";
+  payloads[0].length = sprintf(
+    payloads[0].content,
+    "{\"id\":12,\"temperature\":21.5,\"humidity\":48,\"battery\":3.71}"
+  );
+  payloads[1].name = "JSON readings";
+  payloads[1].length = 0;
+  for(uint8_t i = 0; i < 3; i++)
+    payloads[1].length += sprintf(
+      payloads[1].content + payloads[1].length,
+      "{\"id\":%u,\"temperature\":%u.%u,\"humidity\":%u,\"status\":\"ok\"}",
+      12 + i, 20 + i, 3 * i, 45 + i
+    );
+  payloads[2].name = "Text";
+  payloads[2].length = sprintf(
+    payloads[2].content,
+    "Device 12 started, device 13 started, device 14 not responding"
+  );
+  payloads[3].name = "Samples";
+  payloads[3].length = 128;
+  for(uint8_t i = 0; i < 64; i++) { // Slowly changing 16 bits readings
+    uint16_t sample = 512 + (i / 8);
+    payloads[3].content[i * 2] = sample & 0xFF;
+    payloads[3].content[i * 2 + 1] = sample >> 8;
+  }
+  payloads[4].name = "Random";
+  payloads[4].length = 64;
+  for(uint8_t i = 0; i < 64; i++) payloads[4].content[i] = rand();
+};
+
+/* Report a payload compressed with or without the dictionary, returns
+   false if it is not delivered as it was */
+
+bool measure(PJON<Loopback> &bus, const Payload &payload, bool use_dictionary) {
+  const uint8_t *d = use_dictionary ? dictionary : NULL;
+  uint16_t d_length = use_dictionary ? sizeof(dictionary) - 1 : 0;
+  uint8_t compressed[PACKET_MAX_LENGTH], decompressed[PACKET_MAX_LENGTH];
+  uint16_t length = 0, plain = 0;
+  uint64_t start = now();
+  for(uint32_t r = 0; r < RUNS; r++)
+    length = lz_compress(
+      (const uint8_t *)payload.content, payload.length,
+      compressed, PACKET_MAX_LENGTH, d, d_length
+    );
+  double encode = (double)(now() - start) / RUNS / payload.length;
+  start = now();
+  for(uint32_t r = 0; r < RUNS; r++)
+    plain = lz_decompress(compressed, length, decompressed, PACKET_MAX_LENGTH, d, d_length);
+  double decode = (double)(now() - start) / RUNS / payload.length;
+  if(plain != payload.length || memcmp(decompressed, payload.content, plain)) return false;
+
+  bus.set_compression(false);
+  uint16_t frame = bus.compose_packet(
+    1, bus.bus_id, (char *)bus.strategy.frame, payload.content,
+    payload.length, bus.send_header()
+  );
+  bus.set_compression(true, d, d_length);
+  bus.strategy.length = bus.compose_packet(
+    1, bus.bus_id, (char *)bus.strategy.frame, payload.content,
+    payload.length, bus.send_header()
+  );
+  uint16_t compressed_frame = bus.strategy.length;
+  received_length = 0;
+  if(bus.receive() != ACK) return false;
+  if(received_length != payload.length || memcmp(received, payload.content, received_length))
+    return false;
+
+  printf(
+    "  %-14s %-4s %5u %5u %6.2f %6u %6u %9.1f %9.1f\n",
+    payload.name, use_dictionary ? "yes" : "no", payload.length, length,
+    (double)payload.length / length, frame, compressed_frame, encode, decode
+  );
+  return true;
+};
+
+int main() {
+  prepare();
+  PJON<Loopback> bus(1);
+  bus.set_receiver(receiver_function);
+  printf(
+    "Compression (window of %u bytes, " TIME_UNIT " per byte of content):\n"
+    "  payload        dict  bytes  comp  ratio  frame  comp.f    encode    decode\n",
+    COMPRESSION_WINDOW
+  );
+  bool passed = true;
+  for(uint8_t p = 0; p < 5; p++)
+    for(uint8_t d = 0; d < 2; d++)
+      if(!measure(bus, payloads[p], d)) {
+        printf("  %s is not delivered as it was!\n", payloads[p].name);
+        passed = false;
+      }
+  return !passed;
+};
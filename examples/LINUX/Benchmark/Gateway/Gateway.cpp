@@ -0,0 +1,124 @@
+/* Multi-threaded gateway compared to a single threaded router
+   From 2 to 8 buses (VirtualBus media with the real clock) are bridged, on
+   each bus a device sends packets to the device of the next bus through the
+   gateway, with synchronous acknowledge. The router runs all buses in a
+   single loop, the gateway runs each bus in its own thread passing packets
+   through lock-free queues. Reported are the packets forwarded per second
+   and the average latency from the send call to the reception, with all
+   buses at the same speed and with the first bus slower than the others
+   (its transmissions stall the router loop but not the gateway threads).
+   Results depend on the number of CPUs available.
+
+   Compile from this directory with:
+   g++ -O2 -pthread -I../../../.. Gateway.cpp -o Gateway && ./Gateway */
+
+#define ROUTER_MAX_BUSES 8
+#include <PJONGateway.h>
+#include <stdio.h>
+
+#define DURATION 1000000 // Microseconds of each run
+#define CONTENT_LENGTH 20
+
+std::atomic<uint32_t> delivered(0);
+std::atomic<uint64_t> latency(0);
+
+void receiver_function(uint8_t *payload, uint16_t length, const PacketInfo &packet_info) {
+  uint32_t sent;
+  memcpy(&sent, payload, 4);
+  latency += micros() - sent;
+  delivered++;
+};
+
+void poll(void *device) {
+  ((PJON<VirtualBus> *)device)->receive();
+};
+
+/* The device of a bus sends a packet to the device of the next bus as
+   soon as the previous one is delivered */
+
+struct Endpoint {
+  PJON<VirtualBus> *device;
+  uint8_t next_bus_id[4];
+};
+
+void endpoint_loop(void *pointer) {
+  Endpoint *e = (Endpoint *)pointer;
+  if(!e->device->get_packets_count()) {
+    char content[CONTENT_LENGTH] = {0};
+    uint32_t now = micros();
+    memcpy(content, &now, 4);
+    e->device->send(1, e->next_bus_id, content, CONTENT_LENGTH);
+  }
+  e->device->update();
+  e->device->receive();
+};
+
+void bridge(uint8_t count, bool threads, uint32_t first_bit_rate) {
+  VirtualBusMedium *media[ROUTER_MAX_BUSES];
+  PJON<VirtualBus> *buses[ROUTER_MAX_BUSES], *devices[ROUTER_MAX_BUSES];
+  Endpoint endpoints[ROUTER_MAX_BUSES];
+  PJONRouter *router = new PJONRouter();
+  PJONGateway *gateway = new PJONGateway();
+  for(uint8_t b = 0; b < count; b++) {
+    uint8_t bus_id[4] = {0, 0, 0, (uint8_t)(b + 1)};
+    media[b] = new VirtualBusMedium(b ? 115200 : first_bit_rate);
+    buses[b] = new PJON<VirtualBus>(bus_id, 100);
+    devices[b] = new PJON<VirtualBus>(bus_id, 1);
+    buses[b]->strategy.set_medium(*media[b]);
+    devices[b]->strategy.set_medium(*media[b]);
+    buses[b]->strategy.set_poll(poll, buses[b]);
+    devices[b]->strategy.set_poll(poll, devices[b]);
+    devices[b]->set_receiver(receiver_function);
+    endpoints[b].device = devices[b];
+    memcpy(endpoints[b].next_bus_id, bus_id, 4);
+    endpoints[b].next_bus_id[3] = (b + 1) % count + 1;
+    if(threads) {
+      gateway->add_bus(*buses[b]);
+      gateway->set_loop(b, endpoint_loop, &endpoints[b]);
+    } else router->add_bus(*buses[b]);
+  }
+
+  delivered = 0;
+  latency = 0;
+  uint32_t start = micros();
+  if(threads) {
+    gateway->start();
+    while((uint32_t)(micros() - start) < DURATION) delay(10);
+    gateway->stop();
+  } else
+    while((uint32_t)(micros() - start) < DURATION) {
+      router->loop();
+      for(uint8_t b = 0; b < count; b++) endpoint_loop(&endpoints[b]);
+    }
+  uint32_t duration = micros() - start;
+
+  printf(
+    "%u buses, %-7s %7.1f packets/s, average latency %8.1f us\n",
+    count,
+    threads ? "gateway" : "router",
+    delivered * 1000000.0 / duration,
+    delivered ? (double)latency / delivered : 0.0
+  );
+  for(uint8_t b = 0; b < count; b++) {
+    delete devices[b];
+    delete buses[b];
+    delete media[b];
+  }
+  delete router;
+  delete gateway;
+};
+
+int main() {
+  const uint8_t counts[] = {2, 4, 8};
+  printf("Packets of %u bytes, all buses at 115200 bps:\n", CONTENT_LENGTH);
+  for(uint8_t c = 0; c < 3; c++) {
+    bridge(counts[c], false, 115200);
+    bridge(counts[c], true, 115200);
+  }
+  printf("\nPackets of %u bytes, first bus at 9600 bps, others at 115200 bps:\n", CONTENT_LENGTH);
+  for(uint8_t c = 0; c < 3; c++) {
+    bridge(counts[c], false, 9600);
+    bridge(counts[c], true, 9600);
+  }
+  return 0;
+};
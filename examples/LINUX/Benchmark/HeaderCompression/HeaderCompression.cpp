@@ -0,0 +1,92 @@
+/* Header compression benchmark (HEADER_CONTEXTS)
+   A device sends packets of 20 bytes in shared mode to a device of another
+   bus on the same medium, with synchronous acknowledge and sender info,
+   without and with set_header_compression: after the first packet is
+   acknowledged the bus ids are replaced by a context index. The
+   VirtualBus medium is configured with the byte duration of
+   SoftwareBitBang (STANDARD mode, 472us per byte) and of ThroughSerial at
+   9600Bd (10 bits per byte). Reported are the bytes per frame, the
+   goodput (bytes of content delivered per second) and its improvement.
+   Returns 1 if a packet is not delivered or its sender bus id is wrong.
+
+   Compile from this directory with:
+   g++ -O2 -I../../../.. HeaderCompression.cpp -o HeaderCompression && ./HeaderCompression */
+
+#define PJON_VIRTUAL_CLOCK
+#define HEADER_CONTEXTS 4
+#include <PJON.h>
+#include <stdio.h>
+
+#define PACKETS 200
+#define CONTENT_LENGTH 20
+
+const uint8_t bus_a[4] = {0, 0, 0, 1};
+const uint8_t bus_b[4] = {0, 0, 0, 2};
+PJON<VirtualBus> transmitter(bus_a, 1), destination(bus_b, 2);
+uint32_t delivered = 0, wrong = 0;
+
+void receiver_function(uint8_t *payload, uint16_t length, const PacketInfo &packet_info) {
+  delivered++;
+  if(
+    length != CONTENT_LENGTH || packet_info.sender_id != 1 ||
+    !bus_id_equality(packet_info.sender_bus_id, bus_a) ||
+    !bus_id_equality(packet_info.receiver_bus_id, bus_b)
+  ) wrong++;
+};
+
+void poll(void *) {
+  destination.receive();
+};
+
+/* Goodput in bytes per second sending PACKETS packets */
+
+double measure(uint32_t bit_rate, bool compression, double &frame_bytes) {
+  VirtualBusMedium medium(bit_rate, 0, 0);
+  transmitter.strategy.set_medium(medium);
+  destination.strategy.set_medium(medium);
+  transmitter.set_header_compression(compression);
+  delivered = 0;
+  uint32_t start = micros();
+  char content[CONTENT_LENGTH];
+  memset(content, 'x', CONTENT_LENGTH);
+  for(uint16_t p = 0; p < PACKETS; p++) {
+    transmitter.send(2, bus_b, content, CONTENT_LENGTH);
+    while(transmitter.get_packets_count()) {
+      transmitter.update();
+      destination.receive();
+    }
+  }
+  uint32_t elapsed = micros() - start;
+  frame_bytes = (double)(medium.bytes - medium.frames / 2) / (medium.frames / 2); // Without responses
+  return (double)delivered * CONTENT_LENGTH * 1000000.0 / elapsed;
+};
+
+bool report(const char *name, uint32_t bit_rate) {
+  double plain_bytes, compressed_bytes;
+  double plain = measure(bit_rate, false, plain_bytes);
+  bool passed = delivered == PACKETS;
+  double compressed = measure(bit_rate, true, compressed_bytes);
+  passed &= delivered == PACKETS;
+  printf(
+    "  %-16s %6.1f %6.1f B/s   %6.1f %6.1f B/s   %+5.1f%%\n",
+    name, plain_bytes, plain, compressed_bytes, compressed,
+    (compressed / plain - 1) * 100
+  );
+  return passed;
+};
+
+int main() {
+  transmitter.set_shared_network(true);
+  destination.set_shared_network(true);
+  destination.strategy.set_poll(poll);
+  destination.set_receiver(receiver_function);
+  printf(
+    "%u packets of %u bytes in shared mode:\n"
+    "  medium           bus ids (bytes, goodput)  context (bytes, goodput)  gain\n",
+    PACKETS, CONTENT_LENGTH
+  );
+  bool passed = report("SoftwareBitBang", 16949); // 8 bits every 472us
+  passed &= report("ThroughSerial", 7680);        // 9600Bd, start and stop bits
+  if(wrong) printf("  %u packets received with wrong info!\n", wrong);
+  return !passed || wrong;
+};
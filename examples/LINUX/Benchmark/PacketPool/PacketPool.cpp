@@ -0,0 +1,89 @@
+/* Memory utilization of the packet pool compared to fixed packet buffers
+   The send list is filled with packets having the content lengths of a mixed
+   workload (short packets and long ones) until it has no more room, first
+   with the packet pool, then with the fixed layout (MAX_PACKETS buffers of
+   PACKET_MAX_LENGTH bytes) using the same memory. Then packets are removed
+   and sent randomly, as they would be delivered, to check the utilization
+   of the pool in the long run, without compaction.
+
+   Compile from this directory with:
+   g++ -O2 -I../../../.. PacketPool.cpp -o PacketPool && ./PacketPool */
+
+#define PJON_VIRTUAL_CLOCK
+#define PACKET_MAX_LENGTH   256
+#define MAX_PACKETS         128
+#define PACKET_POOL_LENGTH  2048
+#include <PJON.h>
+#include <stdio.h>
+
+#define OPERATIONS 100000
+
+char content[PACKET_MAX_LENGTH];
+
+/* Content length of the next packet, long_rate per 100 packets are long */
+
+uint16_t content_length(uint8_t long_rate) {
+  if((uint8_t)random(100) < long_rate) return 150 + random(90);
+  return 8 + random(24);
+};
+
+void workload(const char *name, uint8_t long_rate) {
+  PJON<VirtualBus> bus(1);
+  const PJON_Packet_Pool<PACKET_POOL_LENGTH, PACKET_POOL_BLOCK> &pool = bus.get_packet_pool();
+  uint32_t memory = pool.length() + pool.metadata();
+
+  // Fill the packet pool
+  randomSeed(long_rate);
+  uint16_t pool_packets = 0;
+  while(bus.send(2, content, content_length(long_rate)) != FAIL) pool_packets++;
+  uint32_t pool_bytes = pool.requested();
+
+  // Fill the fixed buffers fitting in the same memory with the same packets
+  randomSeed(long_rate);
+  uint16_t fixed_packets = memory / PACKET_MAX_LENGTH;
+  uint32_t fixed_bytes = 0;
+  for(uint16_t p = 0; p < fixed_packets; p++) {
+    uint16_t header = NOT_ASSIGNED;
+    fixed_bytes += bus.compose_header_length(2, header, content_length(long_rate));
+  }
+
+  // Remove and send packets randomly
+  uint64_t queued = 0, requested = 0;
+  for(uint32_t o = 0; o < OPERATIONS; o++) {
+    if(random(2)) bus.remove(random(MAX_PACKETS));
+    else bus.send(2, content, content_length(long_rate));
+    queued += bus.get_packets_count();
+    requested += pool.requested();
+  }
+
+  // Removing all packets the pool has to be merged back in a single block
+  bus.remove_all_packets();
+  bool merged = !pool.used() && pool.largest_free() == pool.length();
+
+  printf(
+    "%-14s pool: %3u packets %5.1f%% used, fixed: %3u packets %5.1f%% used, "
+    "in the long run: %5.1f packets %5.1f%% used%s\n",
+    name,
+    pool_packets,
+    pool_bytes * 100.0 / memory,
+    fixed_packets,
+    fixed_bytes * 100.0 / memory,
+    (double)queued / OPERATIONS,
+    requested * 100.0 / OPERATIONS / memory,
+    merged ? "" : ", NOT MERGED BACK"
+  );
+};
+
+int main() {
+  printf(
+    "Packet pool of %u bytes, blocks of %u bytes, fixed layout of %u bytes packets:\n",
+    PACKET_POOL_LENGTH,
+    PACKET_POOL_BLOCK,
+    PACKET_MAX_LENGTH
+  );
+  workload("Short packets", 0);
+  workload("10% long", 10);
+  workload("50% long", 50);
+  workload("Long packets", 100);
+  return 0;
+};
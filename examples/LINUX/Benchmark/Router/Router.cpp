@@ -0,0 +1,192 @@
+/* Routing table lookup and forwarding through a router
+   Routing tables of thousands of routes (prefixes of 16, 24, 32 and 40 bits
+   and a default route) are filled randomly, then the longest prefix match of
+   random receivers is looked up, reporting lookups per second compared to a
+   linear scan of the table, checking that results are the same.
+   Then a router connects three VirtualBus media (with the simulated clock):
+   a device on the first bus sends packets to a device on the third, with
+   synchronous acknowledge (sent by the router on behalf of the receiver)
+   and with asynchronous acknowledge (sent by the receiver through the
+   router). The forwarding fails if a packet is lost or not delivered once.
+
+   Compile from this directory with:
+   g++ -O2 -I../../../.. Router.cpp -o Router && ./Router */
+
+#define PJON_VIRTUAL_CLOCK
+#define MAX_PACKETS 16
+#define ASYNC_ACK_PEERS 4
+#define ROUTER_MAX_ROUTES 16384
+#include <PJONRouter.h>
+#include <stdio.h>
+#include <time.h>
+
+#define LOOKUPS 1000000
+#define PACKETS 200
+
+uint64_t now() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000ull + t.tv_nsec;
+};
+
+struct Receiver {
+  uint8_t bus_id[4];
+  uint8_t device_id;
+};
+
+PJONRouter router;
+Receiver receivers[LOOKUPS];
+uint16_t results[LOOKUPS];
+
+/* Reference: the longest route matching scanning the whole table */
+
+uint16_t linear_lookup(const Receiver &r) {
+  uint32_t key = (uint32_t)r.bus_id[0] << 24 | r.bus_id[1] << 16 | r.bus_id[2] << 8 | r.bus_id[3];
+  uint64_t address = (uint64_t)key << 8 | r.device_id;
+  const PJON_Route *routes = router.get_routes();
+  int16_t best_length = -1;
+  uint16_t best = FAIL;
+  for(uint16_t i = 0; i < router.get_routes_count(); i++) {
+    uint8_t l = routes[i].prefix_length;
+    uint64_t prefix = (uint64_t)routes[i].bus_id << 8 | routes[i].device_id;
+    uint64_t mask = l ? ~0ull << (64 - l) >> 24 : 0;
+    if((address & mask) == prefix && l > best_length) {
+      best_length = l;
+      best = routes[i].bus;
+    }
+  }
+  return best;
+};
+
+bool lookup_benchmark(uint16_t count) {
+  router.clear_routes();
+  srand(count);
+  while(router.get_routes_count() < count - 1) {
+    uint8_t bus_id[4] = { 0, (uint8_t)rand(), (uint8_t)(rand() % 64), (uint8_t)rand() };
+    uint8_t type = rand() % 10;
+    uint8_t length = (type < 2) ? 16 : (type < 6) ? 24 : (type < 9) ? 32 : 40;
+    router.add_route(bus_id, length, rand() % 3, rand());
+  }
+  router.add_default_route(0);
+
+  // Half of the receivers match a route, half are random
+  const PJON_Route *routes = router.get_routes();
+  for(uint32_t i = 0; i < LOOKUPS; i++) {
+    uint32_t key = rand();
+    uint8_t device_id = rand();
+    if(i % 2) {
+      const PJON_Route &r = routes[rand() % router.get_routes_count()];
+      uint8_t l = r.prefix_length;
+      key = (l < 32) ? r.bus_id | (key & (l ? 0xFFFFFFFF >> l : 0xFFFFFFFF)) : r.bus_id;
+      if(l > 32) device_id = r.device_id | (device_id & (0xFF >> (l - 32)));
+    }
+    receivers[i].bus_id[0] = key >> 24;
+    receivers[i].bus_id[1] = key >> 16;
+    receivers[i].bus_id[2] = key >> 8;
+    receivers[i].bus_id[3] = key;
+    receivers[i].device_id = device_id;
+  }
+
+  uint64_t start = now();
+  for(uint32_t i = 0; i < LOOKUPS; i++)
+    results[i] = router.find_route(receivers[i].bus_id, receivers[i].device_id);
+  uint64_t elapsed = now() - start;
+
+  // The linear scan is slow, a smaller sample is enough
+  uint32_t sample = LOOKUPS / (count / 64 + 1);
+  uint32_t mismatches = 0;
+  uint64_t linear_start = now();
+  for(uint32_t i = 0; i < sample; i++) mismatches += results[i] != linear_lookup(receivers[i]);
+  uint64_t linear_elapsed = now() - linear_start;
+  bool passed = !mismatches;
+  printf(
+    "%6u routes: %10.0f lookups/s (%6.1f ns), linear scan %10.0f lookups/s: %s\n",
+    router.get_routes_count(),
+    LOOKUPS * 1e9 / elapsed,
+    (double)elapsed / LOOKUPS,
+    sample * 1e9 / linear_elapsed,
+    passed ? "PASSED" : "FAILED"
+  );
+  return passed;
+};
+
+/* Forwarding from the first bus to the third through the router */
+
+uint8_t  deliveries[PACKETS];
+uint16_t received = 0;
+
+void receiver_function(uint8_t *payload, uint16_t length, const PacketInfo &packet_info) {
+  uint16_t id = payload[0] << 8 | payload[1];
+  if(id < PACKETS && !deliveries[id]++) received++;
+};
+
+void poll(void *device) {
+  ((PJON<VirtualBus> *)device)->receive();
+};
+
+bool forwarding_simulation(bool asynchronous) {
+  const uint8_t bus_a[4] = {0, 0, 0, 1}, bus_b[4] = {0, 0, 0, 2}, bus_c[4] = {0, 0, 0, 3};
+  VirtualBusMedium a(1000000, 100), b(1000000, 100), c(1000000, 100);
+  PJON<VirtualBus> router_a(bus_a, 100), router_b(bus_b, 100), router_c(bus_c, 100);
+  PJON<VirtualBus> transmitter(bus_a, 1), destination(bus_c, 2);
+  router_a.strategy.set_medium(a);
+  router_b.strategy.set_medium(b);
+  router_c.strategy.set_medium(c);
+  transmitter.strategy.set_medium(a);
+  destination.strategy.set_medium(c);
+  router_a.strategy.set_poll(poll, &router_a);
+  router_c.strategy.set_poll(poll, &router_c);
+  destination.strategy.set_poll(poll, &destination);
+  destination.set_receiver(receiver_function);
+  transmitter.set_asynchronous_acknowledge(asynchronous);
+
+  PJONRouter *r = new PJONRouter(); // The routing table of the benchmark is large
+  r->add_bus(router_a);
+  r->add_bus(router_b);
+  r->add_bus(router_c);
+
+  memset(deliveries, 0, PACKETS);
+  received = 0;
+  uint16_t sent = 0;
+  uint32_t start = micros();
+  while(sent < PACKETS || transmitter.get_packets_count()) {
+    if(sent < PACKETS) {
+      char content[2] = { (char)(sent >> 8), (char)sent };
+      if(transmitter.send(2, bus_c, content, 2) != FAIL) sent++;
+    }
+    transmitter.update();
+    transmitter.receive();
+    r->loop();
+    destination.receive();
+    if((uint32_t)(micros() - start) > 60000000) break; // 1 minute
+  }
+  for(uint8_t i = 0; i < 100 && router_c.get_packets_count(); i++) {
+    r->loop();
+    destination.receive();
+  }
+  uint32_t duration = micros() - start;
+  bool passed = received == PACKETS && !transmitter.get_packets_count();
+  for(uint16_t p = 0; p < PACKETS; p++) passed &= deliveries[p] == 1;
+  printf(
+    "%s acknowledge: %u of %u packets forwarded, %7.1f packets/s: %s\n",
+    asynchronous ? "asynchronous" : "synchronous ",
+    received,
+    PACKETS,
+    received * 1000000.0 / duration,
+    passed ? "PASSED" : "FAILED"
+  );
+  delete r;
+  return passed;
+};
+
+int main() {
+  bool passed = true;
+  printf("Longest prefix match of %u random receivers:\n", LOOKUPS);
+  const uint16_t counts[] = { 100, 1000, 4000, 16000 };
+  for(uint8_t c = 0; c < 4; c++) passed &= lookup_benchmark(counts[c]);
+  printf("\n%u packets from bus 0.0.0.1 to bus 0.0.0.3, 1Mbps 100us latency:\n", PACKETS);
+  passed &= forwarding_simulation(false);
+  passed &= forwarding_simulation(true);
+  printf(passed ? "PASSED\n" : "FAILED\n");
+  return !passed;
+};
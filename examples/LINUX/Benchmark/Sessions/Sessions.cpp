@@ -0,0 +1,113 @@
+/* Cost of the duplicate suppression with session ids
+   Frames are received from memory by a strategy delivering whole frames,
+   so receive() is measured without a medium. Reported are the nanoseconds
+   per packet received without session ids, with session ids (new ones,
+   registered in the cache of SESSION_PEERS senders) and of duplicates
+   (each sender sends again its last DUPLICATES packets, they are
+   acknowledged again and not delivered), for packets coming from more
+   senders: with more senders than SESSION_PEERS the entries are replaced,
+   so duplicates are not recognized.
+
+   Compile from this directory with:
+   g++ -O2 -I../../../.. Sessions.cpp -o Sessions && ./Sessions */
+
+#define SESSION_PEERS 4
+#include <PJON.h>
+#include <stdio.h>
+
+#define FRAMES  256
+#define ROUNDS  2000
+#define DUPLICATES 16 // Packets each sender sends again
+#define CONTENT "01234567890123456789"
+
+/* Strategy receiving frames from memory */
+
+class Replay {
+  public:
+    uint8_t  frames[FRAMES][PACKET_MAX_LENGTH];
+    uint16_t lengths[FRAMES];
+    uint16_t next = 0;
+
+    uint16_t receive_frame(uint8_t *data, uint16_t max_length) {
+      uint16_t f = next;
+      next = (next + 1) % FRAMES;
+      memcpy(data, frames[f], lengths[f]);
+      return lengths[f];
+    };
+
+    boolean  can_start() { return true; };
+    uint16_t receive_byte() { return FAIL; };
+    uint16_t receive_response() { return ACK; };
+    void     send_response(uint8_t response) { };
+    void     send_string(uint8_t *string, uint16_t length) { };
+};
+
+PJON<Replay> bus(1);
+uint32_t delivered = 0;
+uint16_t next_session = 0; // Not received yet from any sender
+
+void receiver_function(uint8_t *payload, uint16_t length, const PacketInfo &packet_info) {
+  delivered++;
+};
+
+uint64_t nanoseconds() {
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000ull + t.tv_nsec;
+};
+
+/* Compose the frames sent by senders devices, if session is set with
+   distinct session ids for each sender from first on (then repeated) */
+
+void compose(uint8_t senders, bool session, uint16_t first, uint16_t distinct) {
+  PJON<Replay> sender;
+  uint16_t header = sender.get_header() | (session ? SESSION_BIT : 0);
+  for(uint16_t f = 0; f < FRAMES; f++) {
+    sender.set_id(10 + f % senders);
+    uint8_t *frame = bus.strategy.frames[f];
+    uint16_t length = sender.compose_packet(1, sender.bus_id, (char *)frame, CONTENT, 20, header);
+    if(session) sender.set_session(frame, length, first + (f / senders) % distinct);
+    bus.strategy.lengths[f] = length;
+  }
+};
+
+/* Nanoseconds per packet received. If distinct is FRAMES the session ids
+   change at each round, so packets are not duplicates, if less each sender
+   sends again its last distinct packets. */
+
+double measure(uint8_t senders, bool session, uint16_t distinct = FRAMES) {
+  uint64_t total = 0;
+  delivered = 0;
+  for(uint32_t r = 0; r < ROUNDS; r++) {
+    if(!r || distinct == FRAMES) {
+      compose(senders, session, next_session, distinct);
+      next_session += FRAMES / senders;
+    }
+    uint64_t start = nanoseconds();
+    for(uint16_t f = 0; f < FRAMES; f++) bus.receive();
+    total += nanoseconds() - start;
+  }
+  return (double)total / (ROUNDS * FRAMES);
+};
+
+int main() {
+  bus.set_receiver(receiver_function);
+  bus.set_acknowledge(false);
+  printf("Packets of 20 bytes, %u session peers:\n", SESSION_PEERS);
+  const uint8_t senders[] = {1, 4, 8, 32};
+  for(uint8_t s = 0; s < 4; s++) {
+    double plain = measure(senders[s], false);
+    double session = measure(senders[s], true);
+    uint32_t fresh = delivered;
+    double duplicate = measure(senders[s], true, DUPLICATES);
+    uint32_t first = senders[s] * DUPLICATES; // Received the first time
+    printf(
+      "%2u senders: without session %6.1f ns, with session %6.1f ns (%+5.1f ns), "
+      "duplicates %6.1f ns, %5.1f%% of the duplicates delivered\n",
+      senders[s], plain, session, session - plain, duplicate,
+      (delivered - first) * 100.0 / (ROUNDS * FRAMES - first)
+    );
+    if(fresh != ROUNDS * FRAMES) printf("  %u packets not delivered\n", ROUNDS * FRAMES - fresh);
+  }
+  return 0;
+};
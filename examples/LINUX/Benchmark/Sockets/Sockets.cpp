@@ -0,0 +1,182 @@
+/* LocalUDP and EthernetTCP on a Linux host
+   Two processes communicate through the loopback interface, the transmitter
+   bound to 127.0.0.1 and the receiver to 127.0.0.2, using the POSIX sockets
+   layer (interfaces/LINUX/PJON_LINUX_Ethernet.h). Reported are:
+   - The packets per second delivered with synchronous acknowledge.
+   - The packets per second delivered with synchronous acknowledge queuing
+     1, 8 and 64 packets at a time in the send list: update sends the
+     packets queued for the receiver in a single frame acknowledged with a
+     bitmap (MAX_BATCH_PACKETS), 1 queued packet is sent alone.
+   - The packets per second sent without acknowledge, with and without
+     send batching (LocalUDP only, datagrams sent with a single sendmmsg),
+     and the ones received (datagrams are lost if the receiver is slower).
+   - The CPU time used by the receiver while waiting in receive(duration)
+     with no traffic: strategies wait in the kernel instead of polling.
+   It is also verified that the LocalUDP datagrams have the same format
+   used by Arduino devices (magic header followed by the packet).
+
+   Compile from this directory with:
+   g++ -O2 -I../../../.. Sockets.cpp -o Sockets && ./Sockets */
+
+#define MAX_PACKETS       64
+#define MAX_BATCH_PACKETS 64
+#include <PJON.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define PACKETS 2048 // Multiple of the packets queued
+#define IDLE    1000000 // Microseconds the receiver waits with no traffic
+#define CONTENT "01234567890123456789"
+
+uint8_t mac[6] = {0xDE, 0xAD, 0xBE, 0xEF, 0xFE, 0xED};
+uint8_t transmitter_ip[4] = {127, 0, 0, 1};
+uint8_t receiver_ip[4] = {127, 0, 0, 2};
+uint32_t received = 0, lost = 0;
+bool stopped = false;
+
+void receiver_function(uint8_t *payload, uint16_t length, const PacketInfo &packet_info) {
+  if(payload[0] == 'S') stopped = true;
+  else received++;
+};
+
+void error_handler(uint8_t code, uint8_t data) {
+  if(code == CONNECTION_LOST) lost++;
+};
+
+uint32_t cpu_time() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return
+    (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 +
+    usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+};
+
+void configure(PJON<LocalUDP> &bus, const uint8_t *peer) {
+  bus.strategy.set_broadcast_address(peer);
+};
+
+void configure(PJON<EthernetTCP> &bus, const uint8_t *peer) {
+  bus.strategy.link.set_id(bus.device_id());
+  bus.strategy.link.add_node(peer == receiver_ip ? 44 : 45, peer);
+  bus.strategy.link.keep_connection(true);
+  bus.strategy.link.start_listening();
+};
+
+/* Receiver (child process): waits with no traffic, then receives until
+   the stop packet, prints the packets received and the CPU time used
+   while waiting */
+
+template<typename Strategy>
+void run_receiver() {
+  Ethernet.begin(mac, receiver_ip);
+  PJON<Strategy> bus(44);
+  configure(bus, transmitter_ip);
+  bus.set_receiver(receiver_function);
+
+  uint32_t start = micros(), cpu = cpu_time(), elapsed;
+  while((elapsed = micros() - start) < IDLE) bus.receive(IDLE - elapsed);
+  cpu = cpu_time() - cpu;
+  while(!stopped) bus.receive(100000);
+  printf(
+    "%5u received, CPU time waiting %u ms in receive(duration): %.2f ms\n",
+    received,
+    IDLE / 1000,
+    cpu / 1000.0
+  );
+  exit(0);
+};
+
+/* Transmitter (parent process): sends PACKETS packets, queued ones at a
+   time if queued is not 0, then the stop packet, prints the packets per
+   second */
+
+template<typename Strategy>
+void run_transmitter(const char *name, bool acknowledge, bool batching, uint8_t queued = 0) {
+  fflush(stdout);
+  pid_t child = fork();
+  if(!child) run_receiver<Strategy>();
+  Ethernet.begin(mac, transmitter_ip);
+  PJON<Strategy> bus(45);
+  configure(bus, receiver_ip);
+  set_batching(bus, batching);
+  bus.set_acknowledge(acknowledge);
+  bus.set_error(error_handler);
+  lost = 0;
+  delay(IDLE / 1000 + 100); // The receiver is idle
+
+  uint32_t delivered = 0, start = micros();
+  if(queued)
+    for(uint32_t p = 0; p < PACKETS; p += queued) {
+      for(uint8_t q = 0; q < queued; q++) bus.send(44, CONTENT, 20);
+      while(bus.get_packets_count()) bus.update();
+    }
+  else for(uint32_t p = 0; p < PACKETS; p++) {
+    if(acknowledge) delivered += bus.send_packet_blocking(44, CONTENT, 20) == ACK;
+    else bus.send_packet(44, (char *)CONTENT, 20);
+  }
+  uint32_t duration = micros() - start;
+  if(queued) delivered = PACKETS - lost;
+  char mode[20];
+  if(queued) sprintf(mode, "ack, %u queued", queued);
+  else strcpy(mode, acknowledge ? "acknowledge" : batching ? "no ack, batching" : "no ack");
+  printf(
+    "  %-11s %-16s %7.0f packets/s, %4u acknowledged,",
+    name,
+    mode,
+    PACKETS * 1000000.0 / duration,
+    delivered
+  );
+  fflush(stdout);
+  bus.set_acknowledge(true);
+  bus.send_packet_blocking(44, "S", 1);
+  bus.receive();
+  int status;
+  waitpid(child, &status, 0);
+  if(status) printf(" receiver failed\n");
+};
+
+void set_batching(PJON<LocalUDP> &bus, bool batching) {
+  bus.strategy.set_send_batching(batching);
+};
+
+void set_batching(PJON<EthernetTCP> &bus, bool batching) { };
+
+/* A LocalUDP packet is received by a plain UDP socket */
+
+bool wire_format() {
+  uint8_t listener_ip[4] = {127, 0, 0, 3};
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  sockaddr_in a = IPAddress(listener_ip).address(DEFAULT_UDP_PORT);
+  if(bind(fd, (sockaddr *)&a, sizeof(a))) return false;
+  Ethernet.begin(mac, transmitter_ip);
+  PJON<LocalUDP> bus(45);
+  bus.strategy.set_broadcast_address(listener_ip);
+  bus.set_acknowledge(false);
+  bus.send_packet(44, (char *)CONTENT, 20);
+
+  char expected[PACKET_MAX_LENGTH];
+  uint8_t datagram[PACKET_MAX_LENGTH + 4];
+  uint16_t length = bus.compose_packet(44, bus.bus_id, expected, CONTENT, 20);
+  ssize_t size = recv(fd, datagram, sizeof(datagram), 0);
+  close(fd);
+  uint32_t magic = UDP_MAGIC_HEADER;
+  return
+    size == length + 4 &&
+    !memcmp(datagram, &magic, 4) &&
+    !memcmp(datagram + 4, expected, length);
+};
+
+int main() {
+  printf("LocalUDP wire format: %s\n", wire_format() ? "PASSED" : "FAILED");
+  printf("Packets of 20 bytes through the loopback interface:\n");
+  run_transmitter<LocalUDP>("LocalUDP", true, false);
+  run_transmitter<LocalUDP>("LocalUDP", false, false);
+  run_transmitter<LocalUDP>("LocalUDP", false, true);
+  run_transmitter<EthernetTCP>("EthernetTCP", true, false);
+  for(uint16_t queued = 1; queued <= 64; queued *= 8)
+    run_transmitter<LocalUDP>("LocalUDP", true, false, queued);
+  for(uint16_t queued = 1; queued <= 64; queued *= 8)
+    run_transmitter<EthernetTCP>("EthernetTCP", true, false, queued);
+  return 0;
+};
@@ -0,0 +1,168 @@
+/* ThroughSerial on a Linux host through a pseudo terminal
+   Two processes communicate through a pseudo terminal pair, the transmitter
+   on the master side and the receiver on the slave side, using the termios
+   Stream of interfaces/LINUX/PJON_LINUX_Serial.h. Reported are the frames
+   per second delivered with synchronous acknowledge at 115200 and 1000000
+   baud, compared to a Stream doing a system call for each byte and polling
+   for data (as writing and reading byte by byte did before), and the CPU
+   time used by the receiver while waiting in receive(duration) with no
+   traffic. A pseudo terminal does not limit the transfer rate, so the
+   results show the cost of the software (and the free time ThroughSerial
+   waits before transmitting), the bound set by the baud rate of a real
+   serial port is reported for comparison. Packets longer than 255 bytes
+   are sent to verify they are not truncated.
+
+   Compile from this directory with:
+   g++ -O2 -I../../../.. ThroughSerial.cpp -o ThroughSerial && ./ThroughSerial */
+
+#define PACKET_MAX_LENGTH 320
+#include <PJON.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define PACKETS 500
+#define IDLE    1000000 // Microseconds the receiver waits with no traffic
+#define CONTENT_LENGTH 20
+#define LONG_CONTENT_LENGTH 300
+
+uint32_t received = 0;
+bool stopped = false, truncated = false;
+
+void receiver_function(uint8_t *payload, uint16_t length, const PacketInfo &packet_info) {
+  if(payload[0] == 'S') stopped = true;
+  else received++;
+  if(payload[0] == 'L' && length != LONG_CONTENT_LENGTH) truncated = true;
+};
+
+uint32_t cpu_time() {
+  rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return
+    (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000000 +
+    usage.ru_utime.tv_usec + usage.ru_stime.tv_usec;
+};
+
+/* A Stream doing a system call for each byte written or read */
+
+class UnbufferedSerial : public Stream {
+  public:
+    using Stream::write;
+
+    UnbufferedSerial(int fd) : _fd(fd) { };
+
+    int available() {
+      if(_peeked < 0) {
+        uint8_t b;
+        if(::read(_fd, &b, 1) == 1) _peeked = b;
+      }
+      return _peeked >= 0;
+    };
+
+    int read() {
+      int b = available() ? _peeked : -1;
+      _peeked = -1;
+      return b;
+    };
+
+    int peek() {
+      return available() ? _peeked : -1;
+    };
+
+    size_t write(const uint8_t *buffer, size_t length) {
+      for(size_t i = 0; i < length; i++)
+        while(::write(_fd, buffer + i, 1) != 1);
+      return length;
+    };
+
+    void flush() {
+      tcdrain(_fd);
+    };
+
+  private:
+    int _fd;
+    int _peeked = -1;
+};
+
+/* Receiver (child process): waits with no traffic, then receives until
+   the stop packet, prints the packets received and the CPU time used
+   while waiting */
+
+void run_receiver(int fd, uint32_t baud, bool buffered) {
+  PJON_Serial serial;
+  if(!serial.begin(fd, baud)) exit(1);
+  UnbufferedSerial unbuffered(fd);
+  PJON<ThroughSerial> bus(44);
+  bus.strategy.set_serial(buffered ? (Stream *)&serial : (Stream *)&unbuffered);
+  bus.set_receiver(receiver_function);
+
+  uint32_t start = micros(), cpu = cpu_time(), elapsed;
+  while((elapsed = micros() - start) < IDLE) bus.receive(IDLE - elapsed);
+  cpu = cpu_time() - cpu;
+  while(!stopped) bus.receive(100000);
+  printf(
+    "%5u received%s, CPU time waiting %u ms: %.2f ms\n",
+    received,
+    truncated ? " (TRUNCATED)" : "",
+    IDLE / 1000,
+    cpu / 1000.0
+  );
+  exit(0);
+};
+
+/* Transmitter (parent process): sends PACKETS packets of content_length
+   bytes, then the stop packet, prints the frames per second */
+
+void run_transmitter(uint32_t baud, bool buffered, uint16_t content_length) {
+  int master = posix_openpt(O_RDWR | O_NOCTTY);
+  grantpt(master);
+  unlockpt(master);
+  int slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+  fflush(stdout);
+  pid_t child = fork();
+  if(!child) {
+    close(master);
+    run_receiver(slave, baud, buffered);
+  }
+  close(slave);
+  PJON_Serial serial;
+  serial.begin(master, baud);
+  UnbufferedSerial unbuffered(master);
+  PJON<ThroughSerial> bus(45);
+  bus.strategy.set_serial(buffered ? (Stream *)&serial : (Stream *)&unbuffered);
+  delay(IDLE / 1000 + 100); // The receiver is idle
+
+  char content[LONG_CONTENT_LENGTH];
+  memset(content, content_length > CONTENT_LENGTH ? 'L' : 'C', content_length);
+  uint32_t delivered = 0, start = micros();
+  for(uint32_t p = 0; p < PACKETS; p++)
+    if(bus.send_packet_blocking(44, content, content_length) == ACK) delivered++;
+    else bus.receive(); // Drop a late response
+  uint32_t duration = micros() - start;
+  uint16_t frame = bus.packet_overhead() + content_length + 1; // With ACK
+  printf(
+    "  %7u baud %3u bytes %-10s %6.0f frames/s (line bound %5.0f), %4u acknowledged,",
+    baud,
+    content_length,
+    buffered ? "buffered" : "unbuffered",
+    delivered * 1000000.0 / duration,
+    baud / (frame * 10.0),
+    delivered
+  );
+  fflush(stdout);
+  bus.send_packet_blocking(44, "S", 1);
+  int status;
+  waitpid(child, &status, 0);
+  if(status) printf(" receiver failed\n");
+};
+
+int main() {
+  printf("Packets through a pseudo terminal, synchronous acknowledge:\n");
+  const uint32_t bauds[] = {115200, 1000000};
+  for(uint8_t b = 0; b < 2; b++) {
+    run_transmitter(bauds[b], false, CONTENT_LENGTH);
+    run_transmitter(bauds[b], true, CONTENT_LENGTH);
+  }
+  run_transmitter(1000000, true, LONG_CONTENT_LENGTH);
+  return 0;
+};
@@ -0,0 +1,111 @@
+/* PJON protocol benchmark on a simulated medium
+   Runs PJON instances in the same process connected by the VirtualBus
+   strategy with the simulated clock, reporting packets per second and
+   synchronous acknowledge latency at various bit rates and latencies, and
+   the throughput of more devices contending the medium with collisions.
+   Results depend only on the protocol and the simulation parameters.
+
+   Compile from this directory with:
+   g++ -O2 -I../../../.. VirtualBus.cpp -o VirtualBus && ./VirtualBus */
+
+#define PJON_VIRTUAL_CLOCK
+#include <PJON.h>
+#include <stdio.h>
+
+#define DEVICES   4
+#define PACKETS   1000
+#define CONTENT   "01234567890123456789"
+
+PJON<VirtualBus> *devices[DEVICES];
+uint32_t received = 0;
+
+void receiver_function(uint8_t *payload, uint16_t length, const PacketInfo &packet_info) {
+  received++;
+};
+
+void poll(void *device) {
+  ((PJON<VirtualBus> *)device)->receive();
+};
+
+/* A device sends packets to another, one at a time */
+
+void point_to_point(uint32_t bit_rate, uint32_t latency) {
+  VirtualBusMedium medium(bit_rate, latency);
+  PJON<VirtualBus> transmitter(1), receiver(2);
+  transmitter.strategy.set_medium(medium);
+  receiver.strategy.set_medium(medium);
+  receiver.strategy.set_poll(poll, &receiver);
+  receiver.set_receiver(receiver_function);
+
+  uint32_t acknowledged = 0, latency_total = 0, latency_max = 0;
+  uint32_t start = micros();
+  for(uint16_t i = 0; i < PACKETS; i++) {
+    uint32_t time = micros();
+    if(transmitter.send_packet(2, (char *)CONTENT, 20) != ACK) continue;
+    time = micros() - time;
+    acknowledged++;
+    latency_total += time;
+    if(time > latency_max) latency_max = time;
+  }
+  uint32_t duration = micros() - start;
+
+  printf(
+    "%8u bps %6u us latency: %9.1f packets/s, ACK latency mean %7.1f us max %6u us\n",
+    bit_rate,
+    latency,
+    acknowledged * 1000000.0 / duration,
+    acknowledged ? (double)latency_total / acknowledged : 0,
+    latency_max
+  );
+};
+
+/* More devices send packets to each other using the send list */
+
+void contention(uint32_t bit_rate, uint32_t latency, uint16_t collision_rate) {
+  VirtualBusMedium medium(bit_rate, latency, collision_rate);
+  for(uint8_t d = 0; d < DEVICES; d++) {
+    devices[d] = new PJON<VirtualBus>(d + 1);
+    devices[d]->strategy.set_medium(medium);
+    devices[d]->strategy.set_poll(poll, devices[d]);
+    devices[d]->set_receiver(receiver_function);
+  }
+
+  received = 0;
+  uint32_t start = micros();
+  uint32_t sent = 0;
+  while(sent < PACKETS || received < sent) {
+    for(uint8_t d = 0; d < DEVICES; d++) {
+      if(sent < PACKETS && devices[d]->send(((d + 1) % DEVICES) + 1, CONTENT, 20) != FAIL) sent++;
+      devices[d]->update();
+      devices[d]->receive();
+    }
+    if((uint32_t)(micros() - start) > 600000000) break; // 10 minutes
+  }
+  uint32_t duration = micros() - start;
+
+  printf(
+    "%u devices %8u bps %5.2f%% collisions: %9.1f packets/s, %u frames, %u collisions\n",
+    DEVICES,
+    bit_rate,
+    collision_rate / 100.0,
+    received * 1000000.0 / duration,
+    medium.frames,
+    medium.collisions
+  );
+  for(uint8_t d = 0; d < DEVICES; d++) delete devices[d];
+};
+
+int main() {
+  printf("Point to point, %u packets of 20 bytes:\n", PACKETS);
+  const uint32_t bit_rates[] = { 9600, 115200, 1000000, 10000000 };
+  const uint32_t latencies[] = { 0, 1000, 5000 };
+  for(uint8_t r = 0; r < 4; r++)
+    for(uint8_t l = 0; l < 3; l++)
+      point_to_point(bit_rates[r], latencies[l]);
+
+  printf("\nContention, %u packets of 20 bytes:\n", PACKETS);
+  const uint16_t collision_rates[] = { 0, 100, 1000 };
+  for(uint8_t c = 0; c < 3; c++)
+    contention(115200, 100, collision_rates[c]);
+  return 0;
+};
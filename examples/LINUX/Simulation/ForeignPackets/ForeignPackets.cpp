@@ -0,0 +1,98 @@
+/* Reception of packets directed to other devices on a shared medium
+   A device sends packets back to back (without acknowledge) to two others
+   through the VirtualBus strategy with the simulated clock, most of them to
+   the first. The second receives all the packets on the medium: those
+   directed to the first are skipped reading their length, so their
+   remaining bytes are not parsed as new packets. The reception statistics
+   of the second device and the results of its receive() calls are reported,
+   the simulation fails if a packet directed to it is lost or a foreign
+   packet is parsed.
+
+   Compile from this directory with:
+   g++ -O2 -I../../../.. ForeignPackets.cpp -o ForeignPackets && ./ForeignPackets */
+
+#define PJON_VIRTUAL_CLOCK
+#define PACKET_MAX_LENGTH 300
+#define PJON_RECEPTION_STATS 1
+#include <PJON.h>
+#include <stdio.h>
+
+#define PACKETS 1000
+
+uint32_t received = 0; // By the destination and the bystander
+uint32_t results[4] = { 0, 0, 0, 0 }; // ACK, NAK, BUSY, FAIL
+
+void receiver_function(uint8_t *payload, uint16_t length, const PacketInfo &packet_info) {
+  received++;
+};
+
+/* Receive until no more data is available */
+
+void receive_all(PJON<VirtualBus> &device, bool count) {
+  uint16_t result;
+  do {
+    result = device.receive();
+    if(count) results[(result == ACK) ? 0 : (result == NAK) ? 1 : (result == BUSY) ? 2 : 3]++;
+  } while(result != FAIL);
+};
+
+bool simulate(uint16_t length, bool shared) {
+  const uint8_t bus_id[4] = { 0, 0, 0, 1 };
+  VirtualBusMedium medium(115200, 100);
+  PJON<VirtualBus> transmitter(bus_id, 1), destination(bus_id, 2), bystander(bus_id, 3);
+  PJON<VirtualBus> *devices[3] = { &transmitter, &destination, &bystander };
+  for(uint8_t d = 0; d < 3; d++) {
+    devices[d]->set_shared_network(shared);
+    devices[d]->strategy.set_medium(medium);
+    devices[d]->set_receiver(receiver_function);
+  }
+  transmitter.set_acknowledge(false);
+
+  char content[256];
+  memset(content, '!', length);
+  memset(results, 0, sizeof(results));
+  received = 0;
+  uint32_t to_bystander = 0;
+  for(uint16_t p = 0; p < PACKETS; p++) {
+    uint8_t id = (p % 10) ? 2 : 3;
+    if(transmitter.send_packet(id, bus_id, content, length) == ACK && id == 3) to_bystander++;
+    // The destination is polled every 3 packets, so they are buffered
+    if(!(p % 3)) receive_all(destination, false);
+    receive_all(bystander, true);
+  }
+  receive_all(destination, false);
+  const PJON_Reception &reception = bystander.get_reception();
+  bool passed =
+    reception.parsed_packets == to_bystander && to_bystander == PACKETS / 10 &&
+    reception.skipped_packets + reception.parsed_packets == PACKETS &&
+    received == PACKETS && !results[1];
+
+  printf(
+    "%3u bytes %s: parsed %4u packets %6u bytes, skipped %4u packets %6u bytes, "
+    "receive() ACK %4u NAK %u BUSY %4u FAIL %5u: %s\n",
+    length,
+    shared ? "shared" : "local ",
+    reception.parsed_packets,
+    reception.parsed,
+    reception.skipped_packets,
+    reception.skipped,
+    results[0],
+    results[1],
+    results[2],
+    results[3],
+    passed ? "PASSED" : "FAILED"
+  );
+  return passed;
+};
+
+int main() {
+  printf("%u packets, 9 of 10 directed to another device, 115200 bps:\n", PACKETS);
+  bool passed = true;
+  const uint16_t lengths[] = { 8, 64, 255 };
+  for(uint8_t l = 0; l < 3; l++) {
+    passed &= simulate(lengths[l], false);
+    passed &= simulate(lengths[l], true);
+  }
+  printf(passed ? "PASSED\n" : "FAILED\n");
+  return !passed;
+};
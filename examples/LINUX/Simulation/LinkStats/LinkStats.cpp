@@ -0,0 +1,98 @@
+/* Per-device link statistics on a simulated medium
+   A device sends packets to a device on a medium corrupting a frame every
+   20 (collisions), that replies to each packet, and to a device not
+   present. The link statistics of the transmitter are printed
+   and checked: each attempt has an outcome, the packets to the device not
+   present are lost, the round trip times of the responses are counted in
+   the histograms and the replies are counted as received. Returns 1 if the
+   validation fails.
+
+   Compile from this directory with:
+   g++ -O2 -I../../../.. LinkStats.cpp -o LinkStats && ./LinkStats */
+
+#define PJON_VIRTUAL_CLOCK
+#define PJON_STATS_DEVICES 4
+#include <PJON.h>
+#include <stdio.h>
+
+#define PACKETS 200
+
+PJON<VirtualBus> transmitter(1), device(2);
+uint32_t replies = 0;
+
+void reply(uint8_t *payload, uint16_t length, const PacketInfo &packet_info) {
+  device.reply("Reply", 5);
+};
+
+void count_replies(uint8_t *payload, uint16_t length, const PacketInfo &packet_info) {
+  replies++;
+};
+
+void poll_transmitter(void *) {
+  transmitter.receive();
+};
+
+void poll_device(void *) {
+  device.receive();
+};
+
+void loop() {
+  transmitter.update();
+  transmitter.receive(1000);
+  device.update();
+  device.receive();
+};
+
+int main() {
+  VirtualBusMedium medium(200000, 100, 500);
+  transmitter.strategy.set_medium(medium);
+  device.strategy.set_medium(medium);
+  transmitter.strategy.set_poll(poll_transmitter);
+  device.strategy.set_poll(poll_device);
+  transmitter.set_receiver(count_replies);
+  device.set_receiver(reply);
+
+  uint32_t sent = 0;
+  for(uint32_t p = 0; p < PACKETS; p++) {
+    uint8_t id = (p % 10 == 9) ? 3 : 2;
+    while(transmitter.send(id, "Hello, how are you?", 19) == FAIL) loop();
+    sent++;
+    for(uint8_t i = 0; i < 20; i++) loop();
+  }
+  while(transmitter.get_packets_count()) loop();
+
+  PJON_Device_Stats stats[PJON_STATS_DEVICES];
+  uint8_t count = transmitter.get_stats(stats, PJON_STATS_DEVICES);
+  bool passed = count == 2;
+  uint32_t received = 0, dequeued = 0;
+  printf(
+    "Device Attempts   ACK  NAK BUSY FAIL Lost  Sent B Recv B Wait max RTT histogram (%uus buckets, doubling)\n",
+    PJON_RTT_RESOLUTION
+  );
+  for(uint8_t d = 0; d < count; d++) {
+    const PJON_Device_Stats &s = stats[d];
+    printf(
+      "%6u %8u %5u %4u %4u %4u %4u %7u %6u %8u",
+      s.id, s.attempts, s.acknowledged, s.naks, s.busy, s.fails, s.lost,
+      s.bytes_sent, s.bytes_received, s.queue_wait_max
+    );
+    uint32_t rtt = 0;
+    for(uint8_t b = 0; b < PJON_RTT_BUCKETS; b++) {
+      printf(" %u", s.rtt[b]);
+      rtt += s.rtt[b];
+    }
+    printf("\n");
+    if(s.attempts != s.acknowledged + s.naks + s.busy + s.fails) passed = false;
+    if(rtt != s.acknowledged + s.naks) passed = false;
+    if(s.id == 3 && (s.acknowledged || !s.lost)) passed = false;
+    if(s.id != 3 && (s.lost || !s.acknowledged || !s.packets_received)) passed = false;
+    received += s.packets_received;
+    dequeued += s.dequeued;
+  }
+  printf("Packets sent %u, dequeued %u, replies received %u (counted %u)\n", sent, dequeued, replies, received);
+  if(dequeued != sent || received != replies) passed = false;
+  if(transmitter.get_device_stats(2) != NULL) transmitter.reset_stats();
+  if(transmitter.get_stats(stats, PJON_STATS_DEVICES)) passed = false;
+  printf(passed ? "PASSED\n" : "FAILED\n");
+  return !passed;
+};
@@ -0,0 +1,153 @@
+/* Reception while a destination is failing, on a simulated clock
+   A device sends packets to a device that never responds, first through
+   the send list (send and update) and then with send_packet_blocking,
+   while another device sends it a packet every INTERVAL microseconds. The
+   link keeps a single frame (as a UART or a socket buffer), so a frame not
+   received before the next one arrives is lost. The back-off between the
+   attempts (up to MAX_ATTEMPTS^3 microseconds) and the collision delay are
+   never waited, frames are received during them: the simulation fails if
+   any frame is lost or is received later than a transmission attempt
+   lasts. The longest call is reported: update() lasts a single attempt,
+   send_packet_blocking all its attempts. Returns 1 if it fails.
+
+   Compile from this directory with:
+   g++ -O2 -I../../../.. NonBlocking.cpp -o NonBlocking && ./NonBlocking */
+
+#define PJON_VIRTUAL_CLOCK
+#include <PJON.h>
+#include <stdio.h>
+
+#define BYTE_TIME        100     // Microseconds to transmit a byte
+#define LINK_TIMEOUT     2000    // Microseconds a response is waited
+#define INTERVAL         5000    // Microseconds between incoming frames
+#define DURATION         5000000 // Microseconds of each test
+
+/* A link receiving a frame every INTERVAL, where nobody responds */
+
+class Link {
+  public:
+    uint8_t  frame[PACKET_MAX_LENGTH];
+    uint16_t length = 0;
+    uint32_t next = 0;      // Arrival of the next frame
+    uint32_t arrival = 0;   // Arrival of the frame buffered
+    int16_t  position = -1; // Next byte of the frame buffered, -1 if none
+    uint32_t arrived = 0;
+    uint32_t lost = 0;
+    uint32_t attempts = 0;
+
+    void start() {
+      next = micros() + INTERVAL;
+      position = -1;
+      arrived = lost = attempts = 0;
+    };
+
+    boolean can_start() {
+      update();
+      return true;
+    };
+
+    uint16_t receive_byte() {
+      update();
+      if(position < 0) {
+        delayMicroseconds(BYTE_TIME);
+        return FAIL;
+      }
+      uint8_t value = frame[position++];
+      if(position == length) position = -1;
+      return value;
+    };
+
+    uint16_t receive_response() {
+      delayMicroseconds(LINK_TIMEOUT);
+      return FAIL;
+    };
+
+    void send_response(uint8_t response) {
+      delayMicroseconds(BYTE_TIME);
+    };
+
+    void send_string(uint8_t *string, uint16_t length) {
+      attempts++;
+      delayMicroseconds(length * BYTE_TIME);
+    };
+
+  private:
+    void update() {
+      while((int32_t)(micros() - next) >= 0) {
+        if(position >= 0) lost++;
+        position = 0;
+        arrival = next;
+        next += INTERVAL;
+        arrived++;
+      }
+    };
+};
+
+PJON<Link> bus(1), other(2);
+uint32_t received = 0;
+uint32_t max_latency = 0;
+
+void receiver_function(uint8_t *payload, uint16_t length, const PacketInfo &packet_info) {
+  uint32_t latency = micros() - bus.strategy.arrival;
+  if(latency > max_latency) max_latency = latency;
+  received++;
+};
+
+bool report(const char *name, uint32_t max_call) {
+  uint32_t limit = LINK_TIMEOUT + (PACKET_MAX_LENGTH + bus.strategy.length) * BYTE_TIME;
+  bool passed =
+    !bus.strategy.lost && received + 1 >= bus.strategy.arrived && max_latency <= limit;
+  printf(
+    "%-20s %5u attempts, frames %4u arrived %4u received %4u lost, "
+    "max latency %5u us, longest call %5u us\n",
+    name,
+    bus.strategy.attempts,
+    bus.strategy.arrived,
+    received,
+    bus.strategy.lost,
+    max_latency,
+    max_call
+  );
+  return passed;
+};
+
+void start() {
+  received = max_latency = 0;
+  bus.strategy.start();
+};
+
+int main() {
+  uint16_t header = other.get_header() & ~ACK_REQUEST_BIT;
+  bus.strategy.length = other.compose_packet(
+    1, other.bus_id, (char *)bus.strategy.frame, "Incoming", 8, header
+  );
+  bus.set_receiver(receiver_function);
+  bool passed = true;
+
+  start();
+  uint32_t begin = micros(), longest = 0;
+  while((uint32_t)(micros() - begin) < DURATION) {
+    if(!bus.get_packets_count()) bus.send(3, "Unreachable", 11);
+    uint32_t time = micros();
+    bus.update();
+    time = micros() - time;
+    if(time > longest) longest = time;
+    bus.receive();
+  }
+  passed &= report("send and update:", longest);
+
+  start();
+  begin = micros();
+  longest = 0;
+  while((uint32_t)(micros() - begin) < DURATION) {
+    uint32_t time = micros();
+    bus.send_packet_blocking(3, "Unreachable", 11);
+    time = micros() - time;
+    if(time > longest) longest = time;
+    bus.receive();
+  }
+  passed &= report("send_packet_blocking:", longest);
+
+  printf(passed ? "PASSED\n" : "FAILED\n");
+  return !passed;
+};
@@ -0,0 +1,242 @@
+/* OverSampling demodulators on synthetic noisy waveforms
+   Frames of 20 bytes in the OverSampling format (see send_byte) are
+   generated as waveforms with edge jitter, clock drift of the transmitter
+   and noise spikes, and are decoded by the fixed point demodulator of the
+   strategy (Demodulator.h) and by the floating point average used before.
+   Reading the time and the pin is modeled costing 4us each and the floating
+   point average 4us more per sample, about what they cost on a 16MHz AVR,
+   so fewer samples per bit fit in short bits and the floating point
+   average, restarting the timing of each bit, falls behind the transmitter.
+   Reported are the frames decoded without errors at decreasing bit widths
+   (increasing bit rates), the simulation fails if the fixed point
+   demodulator loses frames with the default timing or if the floating
+   point one does not decode the clean frames with the default timing.
+
+   Compile from this directory with:
+   g++ -O2 -I../../../.. OverSampling.cpp -o OverSampling && ./OverSampling */
+
+#include <PJON.h>
+#include <strategies/OverSampling/Timing.h>
+#include <strategies/OverSampling/Demodulator.h>
+#include <algorithm>
+#include <stdio.h>
+#include <vector>
+
+#define FRAMES 100
+#define FRAME_LENGTH 20
+#define TIME_COST 4
+#define READ_COST 4
+#define FLOAT_COST 4
+
+/* Noise of the medium */
+
+struct Noise {
+  const char *name;
+  uint16_t jitter;       // Maximum displacement of an edge, percent of a bit
+  int16_t  drift;        // Transmitter clock error, per thousand
+  uint16_t spike_rate;   // Average spikes every millisecond, per thousand
+  uint16_t spike_length; // Maximum duration of a spike in microseconds
+};
+
+/* A waveform is a list of edges (starting LOW) and a list of spikes
+   (inverting the level while present) */
+
+struct Signal {
+  std::vector<uint32_t> edges, spikes;
+
+  uint8_t level(uint32_t t) const {
+    return (
+      (std::upper_bound(edges.begin(), edges.end(), t) - edges.begin()) +
+      (std::upper_bound(spikes.begin(), spikes.end(), t) - spikes.begin())
+    ) & 1;
+  };
+};
+
+/* The demodulators read the signal advancing the simulated time by the
+   cost of each operation, varying of 1us as interrupts and the 4us
+   resolution of micros() do on AVR */
+
+struct SimulatedInput {
+  const Signal *signal;
+  uint32_t t;
+  uint32_t seed = 1;
+
+  void spend(uint16_t cost) {
+    seed = (seed * 1103515245) + 12345;
+    t += cost - 1 + ((seed >> 16) % 3);
+  };
+
+  uint32_t time() {
+    spend(TIME_COST);
+    return t;
+  };
+
+  uint8_t read() {
+    uint8_t value = signal->level(t);
+    spend(READ_COST);
+    return value;
+  };
+};
+
+/* The demodulator used before, a floating point average of the samples
+   restarting the timing of each bit after the previous */
+
+template<uint16_t BIT_WIDTH, uint16_t BIT_SPACER>
+struct FloatDemodulator {
+  SimulatedInput input;
+
+  float average(float value) {
+    uint8_t sample = input.read();
+    input.spend(FLOAT_COST);
+    return (value * 0.999) + (sample * 0.001);
+  };
+
+  uint8_t read_byte() {
+    uint8_t byte_value = 0;
+    for(uint8_t i = 0; i < 8; i++) {
+      uint32_t time = input.time();
+      float value = 0.5;
+      while((uint32_t)(input.time() - time) < BIT_WIDTH)
+        value = average(value);
+      byte_value += (value > 0.5) << i;
+    }
+    return byte_value;
+  };
+
+  uint16_t receive_byte() {
+    float value = 0.5;
+    uint32_t time = input.time();
+    while(((uint32_t)(input.time() - time) < BIT_SPACER) && input.read())
+      value = average(value);
+    time = input.time();
+    if(value > 0.5) {
+      value = 0.5;
+      while((uint32_t)(input.time() - time) < BIT_WIDTH)
+        value = average(value);
+      if(value < 0.5) return read_byte();
+    }
+    return FAIL;
+  };
+};
+
+/* Transmit a frame: each byte is preceded by a HIGH padding bit of a
+   spacer duration and by a LOW padding bit */
+
+void transmit(
+  Signal &signal,
+  const uint8_t *frame,
+  uint32_t start,
+  uint16_t bit_width,
+  uint16_t bit_spacer,
+  const Noise &noise
+) {
+  double scale = 1.0 + noise.drift / 1000.0, t = start;
+  uint8_t level = 0;
+  int32_t jitter = (int32_t)bit_width * noise.jitter / 100;
+  signal.edges.clear();
+  signal.spikes.clear();
+  for(uint16_t b = 0; b < FRAME_LENGTH; b++)
+    for(int8_t i = -2; i < 8; i++) {
+      uint8_t value = (i == -2) ? 1 : (i == -1) ? 0 : (frame[b] >> i) & 1;
+      if(value != level) {
+        signal.edges.push_back((uint32_t)t + (jitter ? random(-jitter, jitter + 1) : 0));
+        level = value;
+      }
+      t += ((i == -2) ? bit_spacer : bit_width) * scale;
+    }
+  if(level) signal.edges.push_back((uint32_t)t);
+  if(!noise.spike_rate) return;
+  for(uint32_t s = start; s < t; ) {
+    s += random(1, 2000000 / noise.spike_rate);
+    signal.spikes.push_back(s);
+    s += random(1, noise.spike_length + 1);
+    signal.spikes.push_back(s);
+    s++;
+  }
+};
+
+/* Decode a frame as PJON does, calling receive_byte until all bytes are
+   received or the frame is over, returns true if decoded without errors */
+
+template<typename Demodulator>
+bool decode(Demodulator &demodulator, const uint8_t *frame, uint32_t end) {
+  uint8_t received = 0;
+  while(demodulator.input.t < end && received < FRAME_LENGTH) {
+    uint16_t value = demodulator.receive_byte();
+    if(value == FAIL) continue;
+    if(value != frame[received]) return false;
+    received++;
+  }
+  return received == FRAME_LENGTH;
+};
+
+/* Returns the percentage of frames decoded by a demodulator */
+
+template<typename Demodulator, uint16_t BIT_WIDTH, uint16_t BIT_SPACER>
+double simulate(const Noise &noise) {
+  Signal signal;
+  Demodulator demodulator;
+  uint32_t decoded = 0;
+  randomSeed(12345); // Same waveforms for all demodulators
+  for(uint32_t f = 0; f < FRAMES; f++) {
+    uint8_t frame[FRAME_LENGTH];
+    for(uint8_t b = 0; b < FRAME_LENGTH; b++) frame[b] = random(256);
+    uint32_t start = 1000000 * (f + 1);
+    transmit(signal, frame, start, BIT_WIDTH, BIT_SPACER, noise);
+    demodulator.input.signal = &signal;
+    demodulator.input.t = start - random(1, BIT_WIDTH);
+    decoded += decode(demodulator, frame, start + FRAME_LENGTH * 12 * BIT_WIDTH);
+  }
+  return decoded * 100.0 / FRAMES;
+};
+
+/* Passes if the fixed point demodulator decodes all frames without spikes
+   and at least the frames decoded by the floating point one with spikes,
+   and if the floating point one decodes the clean frames at the default
+   bit width (so it is a valid baseline) */
+
+template<uint16_t BIT_WIDTH>
+bool sweep(const Noise &noise) {
+  const uint16_t BIT_SPACER = BIT_WIDTH * 328 / 512;
+  double result[3] = {
+    simulate<FloatDemodulator<BIT_WIDTH, BIT_SPACER>, BIT_WIDTH, BIT_SPACER>(noise),
+    simulate<OSDemodulator<SimulatedInput, BIT_WIDTH, BIT_SPACER, 8, BIT_SPACER / 4>, BIT_WIDTH, BIT_SPACER>(noise),
+    simulate<OSDemodulator<SimulatedInput, BIT_WIDTH, BIT_SPACER, 4, BIT_SPACER / 4>, BIT_WIDTH, BIT_SPACER>(noise)
+  };
+  printf(
+    "  %-7s %4uus %6.0f bps %9.0f%% %13.0f%% %13.0f%%\n",
+    noise.name, BIT_WIDTH, 1000000.0 / BIT_WIDTH, result[0], result[1], result[2]
+  );
+  bool clean = !noise.drift && !noise.spike_rate;
+  if(BIT_WIDTH == OS_BIT_WIDTH && clean && result[0] < 100) return false;
+  return (result[1] == 100) || (noise.spike_rate && (result[1] >= result[0]));
+};
+
+template<uint16_t BIT_WIDTH>
+bool sweep_all(const Noise *noises, uint8_t count) {
+  bool passed = true;
+  for(uint8_t n = 0; n < count; n++) passed &= sweep<BIT_WIDTH>(noises[n]);
+  return passed;
+};
+
+int main() {
+  const Noise noises[] = {
+    {"clean", 1, 0, 0, 0},
+    {"jitter", 10, 20, 0, 0},
+    {"noisy", 10, 20, 500, 30}
+  };
+  printf(
+    "Frames of %u bytes decoded (%u frames):\n"
+    "  noise   bit     rate        float    fixed 8 samples  fixed 4 samples\n",
+    FRAME_LENGTH, FRAMES
+  );
+  bool passed = sweep_all<OS_BIT_WIDTH>(noises, 3);
+  sweep_all<384>(noises, 3);
+  sweep_all<256>(noises, 3);
+  sweep_all<192>(noises, 3);
+  sweep_all<128>(noises, 3);
+  sweep_all<96>(noises, 3);
+  sweep_all<64>(noises, 3);
+  printf(passed ? "PASSED\n" : "FAILED\n");
+  return !passed;
+};
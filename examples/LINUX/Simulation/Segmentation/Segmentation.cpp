@@ -0,0 +1,83 @@
+/* Segmented transmission of a payload longer than PACKET_MAX_LENGTH
+   A device sends a 8kB payload to another through the VirtualBus strategy
+   with the simulated clock, using packets of at most 64 bytes. The receiver
+   writes each part delivered at its payload_offset and the reassembled
+   payload is compared with the original. Segments are sent with synchronous
+   acknowledge and with asynchronous acknowledge (so segments lost are
+   received out of order after the following ones), with and without
+   collisions.
+
+   Compile from this directory with:
+   g++ -O2 -I../../../.. Segmentation.cpp -o Segmentation && ./Segmentation */
+
+#define PJON_VIRTUAL_CLOCK
+#define PACKET_MAX_LENGTH          64
+#define MAX_PACKETS                16
+#define ASYNC_ACK_PEERS            4
+#define MAX_REASSEMBLIES           1
+#define SEGMENTATION_BUFFER_LENGTH 1024
+#include <PJON.h>
+#include <stdio.h>
+
+#define PAYLOAD_LENGTH 8192
+
+uint8_t  payload[PAYLOAD_LENGTH];
+uint8_t  reassembled[PAYLOAD_LENGTH];
+uint32_t expected_offset = 0;
+bool     in_order = true;
+
+void receiver_function(uint8_t *content, uint16_t length, const PacketInfo &packet_info) {
+  if(!(packet_info.header & SEGMENTATION_BIT)) return;
+  if(packet_info.payload_offset != expected_offset) in_order = false;
+  if(packet_info.payload_offset + length <= PAYLOAD_LENGTH)
+    memcpy(reassembled + packet_info.payload_offset, content, length);
+  expected_offset = packet_info.payload_offset + length;
+};
+
+void poll(void *device) {
+  ((PJON<VirtualBus> *)device)->receive();
+};
+
+bool transfer(bool asynchronous, uint16_t collision_rate) {
+  VirtualBusMedium medium(1000000, 1000, collision_rate);
+  PJON<VirtualBus> transmitter(1), destination(2);
+  transmitter.strategy.set_medium(medium);
+  destination.strategy.set_medium(medium);
+  destination.strategy.set_poll(poll, &destination);
+  destination.set_receiver(receiver_function);
+  transmitter.set_asynchronous_acknowledge(asynchronous);
+
+  memset(reassembled, 0, PAYLOAD_LENGTH);
+  expected_offset = 0;
+  in_order = true;
+  uint32_t start = micros();
+  uint16_t result = transmitter.send_segmented(2, (char *)payload, PAYLOAD_LENGTH);
+  uint32_t duration = micros() - start;
+  bool passed =
+    result == ACK && in_order && expected_offset == PAYLOAD_LENGTH &&
+    !memcmp(payload, reassembled, PAYLOAD_LENGTH);
+
+  printf(
+    "%s acknowledge, %5.2f%% collisions: %s in %7.1f ms, %7.1f kB/s, %u frames\n",
+    asynchronous ? "asynchronous" : "synchronous ",
+    collision_rate / 100.0,
+    passed ? "PASSED" : "FAILED",
+    duration / 1000.0,
+    PAYLOAD_LENGTH * 1000.0 / duration,
+    medium.frames
+  );
+  return passed;
+};
+
+int main() {
+  for(uint16_t i = 0; i < PAYLOAD_LENGTH; i++) payload[i] = random(256);
+  printf("%u bytes payload, packets of %u bytes, 1Mbps 1ms latency:\n", PAYLOAD_LENGTH, PACKET_MAX_LENGTH);
+  bool passed = true;
+  const uint16_t collision_rates[] = { 0, 200 };
+  for(uint8_t c = 0; c < 2; c++) {
+    passed &= transfer(false, collision_rates[c]);
+    passed &= transfer(true, collision_rates[c]);
+  }
+  printf(passed ? "PASSED\n" : "FAILED\n");
+  return !passed;
+};
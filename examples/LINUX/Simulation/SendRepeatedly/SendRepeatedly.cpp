@@ -0,0 +1,86 @@
+/* send_repeatedly timing validation on a simulated clock
+   A device sends packets repeatedly with different intervals while its
+   loop takes a variable time (and once stalls for longer than an interval).
+   The receiver checks that each packet is received every interval without
+   cumulative drift: the n-th reception must happen after the n-th deadline
+   and before the next one. The jitter statistics of the transmitter are
+   printed at the end. Returns 1 if the validation fails.
+
+   Compile from this directory with:
+   g++ -O2 -I../../../.. SendRepeatedly.cpp -o SendRepeatedly && ./SendRepeatedly */
+
+#define PJON_VIRTUAL_CLOCK
+#define PJON_JITTER_STATS 1
+#include <PJON.h>
+#include <stdio.h>
+
+#define TASKS     4
+#define DURATION  10000000 // 10 seconds
+#define STALL_AT  5000000  // Stall of the transmitter loop
+#define STALL     35000
+
+const uint32_t intervals[TASKS] = { 10000, 25000, 100000, 1000000 };
+
+PJON<VirtualBus> transmitter(1), destination(2);
+uint32_t start;
+uint32_t receptions[TASKS];
+uint32_t errors = 0;
+
+void receiver_function(uint8_t *payload, uint16_t length, const PacketInfo &packet_info) {
+  uint8_t task = payload[0];
+  uint32_t elapsed = micros() - start;
+  uint32_t deadline = intervals[task] * (receptions[task] + 1);
+  // Periods elapsed during the stall are skipped
+  while(elapsed >= deadline + intervals[task]) {
+    receptions[task]++;
+    deadline += intervals[task];
+  }
+  if(elapsed < deadline) {
+    printf("Task %u received %u us before its deadline\n", task, deadline - elapsed);
+    errors++;
+  }
+  receptions[task]++;
+};
+
+void poll(void *) {
+  destination.receive();
+};
+
+int main() {
+  VirtualBusMedium medium(1000000, 50);
+  transmitter.strategy.set_medium(medium);
+  destination.strategy.set_medium(medium);
+  destination.strategy.set_poll(poll);
+  destination.set_receiver(receiver_function);
+
+  start = micros();
+  for(uint8_t t = 0; t < TASKS; t++)
+    transmitter.send_repeatedly(2, (const char *)&t, 1, intervals[t]);
+
+  bool stalled = false;
+  while((uint32_t)(micros() - start) < DURATION) {
+    transmitter.update();
+    delayMicroseconds(random(0, 500)); // Other work done in the loop
+    if(!stalled && (uint32_t)(micros() - start) > STALL_AT) {
+      delayMicroseconds(STALL);
+      stalled = true;
+    }
+  }
+
+  for(uint8_t t = 0; t < TASKS; t++) {
+    uint32_t expected = DURATION / intervals[t];
+    printf("Task %u every %7u us: %5u periods, %u expected\n", t, intervals[t], receptions[t], expected);
+    if(receptions[t] + 1 < expected || receptions[t] > expected) errors++;
+  }
+
+  const PJON_Jitter &jitter = transmitter.get_jitter();
+  printf(
+    "Jitter: %u samples, min %u us, max %u us, mean %.1f us\n",
+    jitter.samples,
+    jitter.min,
+    jitter.max,
+    jitter.samples ? (double)jitter.total / jitter.samples : 0
+  );
+  printf(errors ? "FAILED\n" : "PASSED\n");
+  return errors ? 1 : 0;
+};
@@ -0,0 +1,128 @@
+/* Duplicate suppression with session ids on a lossy medium
+   A device sends numbered packets to a device on a medium corrupting a
+   frame every 10, so some synchronous acknowledges are lost and the packets
+   are sent again although they were received. Each packet is sent by the
+   send list and by send_packet_blocking, and a packet is sent repeatedly:
+   without session ids the receiver delivers some packets twice, with
+   session ids (include_session_id) it has to deliver every packet exactly
+   once and every period of the repeated packet. Then SESSION_PEERS devices
+   send packets in turn: without session ids some are delivered twice, with
+   session ids the receiver remembers the session ids of all the devices
+   and has to deliver every packet exactly once, with one device more
+   the least recently used is replaced and the packets delivered twice are
+   only reported. Returns 1 if it fails.
+
+   Compile from this directory with:
+   g++ -O2 -I../../../.. Sessions.cpp -o Sessions && ./Sessions */
+
+#define PJON_VIRTUAL_CLOCK
+#define SESSION_PEERS 4
+#include <PJON.h>
+#include <stdio.h>
+
+#define PACKETS  500
+#define SENDER_PACKETS 200 // Packets sent by each of the senders
+#define INTERVAL 20000 // Microseconds between the periods of the repeated packet
+
+PJON<VirtualBus> transmitter(1), destination(2);
+PJON<VirtualBus> senders[SESSION_PEERS + 1];
+uint8_t  deliveries[PACKETS * 2];
+uint8_t  sender_deliveries[SESSION_PEERS + 1][SENDER_PACKETS];
+uint32_t repeated = 0;
+
+void receiver_function(uint8_t *payload, uint16_t length, const PacketInfo &packet_info) {
+  if(payload[0] == 'R') repeated++;
+  else if(payload[0] == 'S')
+    sender_deliveries[payload[1]][(payload[2] << 8) | payload[3]]++;
+  else deliveries[(payload[0] << 8) | payload[1]]++;
+};
+
+void poll(void *) {
+  destination.receive();
+};
+
+bool test(bool session) {
+  VirtualBusMedium medium(200000, 50, 1000);
+  transmitter.strategy.set_medium(medium);
+  destination.strategy.set_medium(medium);
+  transmitter.include_session_id(session);
+  memset(deliveries, 0, sizeof(deliveries));
+  repeated = 0;
+
+  uint32_t start = micros();
+  uint16_t task = transmitter.send_repeatedly(2, "R", 1, INTERVAL);
+  for(uint16_t p = 0; p < PACKETS * 2; p++) {
+    char content[2] = {(char)(p >> 8), (char)p};
+    if(p & 1) transmitter.send_packet_blocking(2, content, 2);
+    else {
+      transmitter.send(2, content, 2);
+      while(transmitter.get_packets_count() > 1) {
+        transmitter.update();
+        destination.receive();
+      }
+    }
+    destination.receive();
+  }
+  uint32_t periods = (micros() - start) / INTERVAL;
+  transmitter.remove(task);
+
+  uint32_t duplicates = 0, missing = 0;
+  for(uint16_t p = 0; p < PACKETS * 2; p++) {
+    if(deliveries[p] > 1) duplicates += deliveries[p] - 1;
+    if(!deliveries[p]) missing++;
+  }
+  printf(
+    "%-20s %5u frames, %3u corrupted: %3u delivered twice, %u missing, "
+    "repeated packet %u times in %u periods\n",
+    session ? "With session ids:" : "Without session ids:",
+    medium.frames, medium.collisions, duplicates, missing, repeated, periods
+  );
+  if(!session) return duplicates > 0;
+  return !duplicates && !missing && repeated + 2 >= periods && repeated <= periods + 1;
+};
+
+bool test_senders(uint8_t count, bool session) {
+  VirtualBusMedium medium(200000, 50, 1000);
+  destination.strategy.set_medium(medium);
+  for(uint8_t s = 0; s < count; s++) {
+    senders[s].set_id(10 + s);
+    senders[s].strategy.set_medium(medium);
+    senders[s].include_session_id(session);
+  }
+  memset(sender_deliveries, 0, sizeof(sender_deliveries));
+
+  for(uint16_t p = 0; p < SENDER_PACKETS; p++)
+    for(uint8_t s = 0; s < count; s++) {
+      char content[4] = {'S', (char)s, (char)(p >> 8), (char)p};
+      senders[s].send_packet_blocking(2, content, 4);
+      destination.receive();
+    }
+
+  uint32_t duplicates = 0, missing = 0;
+  for(uint8_t s = 0; s < count; s++)
+    for(uint16_t p = 0; p < SENDER_PACKETS; p++) {
+      if(sender_deliveries[s][p] > 1) duplicates += sender_deliveries[s][p] - 1;
+      if(!sender_deliveries[s][p]) missing++;
+    }
+  char label[24];
+  sprintf(label, "%u senders%s:", count, session ? "" : ", no ids");
+  printf(
+    "%-20s %5u frames, %3u corrupted: %3u delivered twice, %u missing\n",
+    label, medium.frames, medium.collisions, duplicates, missing
+  );
+  if(!session) return duplicates > 0;
+  if(count > SESSION_PEERS) return true;
+  return !duplicates && !missing;
+};
+
+int main() {
+  destination.strategy.set_poll(poll);
+  destination.set_receiver(receiver_function);
+  bool passed = test(false);
+  passed &= test(true);
+  passed &= test_senders(SESSION_PEERS, false);
+  passed &= test_senders(SESSION_PEERS, true);
+  passed &= test_senders(SESSION_PEERS + 1, true);
+  printf(passed ? "PASSED\n" : "FAILED\n");
+  return !passed;
+};
@@ -0,0 +1,52 @@
+/* Reception of a PJONSlave during the back-off of send_packet_blocking
+   A device sends a packet (without acknowledge) to a PJONSlave, that then
+   calls send_packet_blocking towards a device that is not present: the
+   first attempt finds the medium busy and the packet is received during
+   the back-off. PJONSlave delivers the packets to its own receiver in its
+   receive(), so the back-off must call it and not the receive() of PJON,
+   that would acknowledge the packet and drop it. The simulation fails if a
+   packet is not delivered to the receiver of the PJONSlave.
+
+   Compile from this directory with:
+   g++ -O2 -I../../../.. SlaveBackOff.cpp -o SlaveBackOff && ./SlaveBackOff */
+
+#define PJON_VIRTUAL_CLOCK
+#include <PJONSlave.h>
+#include <stdio.h>
+
+#define PACKETS 50
+
+uint32_t delivered = 0;
+
+void receiver_function(uint8_t *payload, uint16_t length, const PacketInfo &packet_info) {
+  if(length == 8 && !memcmp(payload, "Incoming", 8)) delivered++;
+};
+
+void error_handler(uint8_t code, uint8_t data) { };
+
+int main() {
+  VirtualBusMedium medium(115200, 0, 0);
+  PJONSlave<VirtualBus> slave(1);
+  PJON<VirtualBus> other(2);
+  slave.strategy.set_medium(medium);
+  other.strategy.set_medium(medium);
+  slave.set_receiver(receiver_function);
+  slave.set_error(error_handler);
+  uint16_t header = other.get_header() & ~ACK_REQUEST_BIT;
+
+  uint32_t busy = 0;
+  for(uint16_t p = 0; p < PACKETS; p++) {
+    while(other.receive() != FAIL); // Discard the attempts of the slave
+    other.send_packet(1, (char *)"Incoming", 8, header);
+    if(!slave.strategy.can_start()) busy++;
+    slave.send_packet_blocking(3, slave.bus_id, "Unreachable", 11, NOT_ASSIGNED, 20000);
+  }
+
+  bool passed = busy == PACKETS && delivered == PACKETS;
+  printf(
+    "%u packets sent to the slave before send_packet_blocking, "
+    "%u found the medium busy, %u delivered\n", PACKETS, busy, delivered
+  );
+  printf(passed ? "PASSED\n" : "FAILED\n");
+  return !passed;
+};
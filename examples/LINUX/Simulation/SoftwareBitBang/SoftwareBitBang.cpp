@@ -0,0 +1,150 @@
+/* SoftwareBitBang edge decoder on simulated waveforms
+   Frames of 20 bytes in the Padded jittering format (see send_byte) are
+   transmitted with a clock skew of the transmitter, and the timestamps of
+   their edges, delayed by a random latency as an interrupt service routine
+   and micros() do, are decoded by SWBBEdgeDecoder (EdgeDecoder.h)
+   configured for the bit width transmitted. For each mode (with its ratio
+   between padding bit and bit width) the bit width is decreased until a
+   frame is lost, reported is the maximum bit rate decoding all frames with
+   the transmitter skewed in both directions. The latency is the error of
+   the timestamps: on a 16MHz AVR micros() has a resolution of 4us and the
+   interrupt adds a few microseconds. The simulation fails if the nominal
+   timing of a mode loses frames with up to 5% of skew and 2us of latency.
+
+   Compile from this directory with:
+   g++ -O2 -I../../../.. SoftwareBitBang.cpp -o SoftwareBitBang && ./SoftwareBitBang */
+
+#include <PJON.h>
+#include <strategies/SoftwareBitBang/Timing.h>
+#include <strategies/SoftwareBitBang/EdgeDecoder.h>
+#include <stdio.h>
+#include <vector>
+
+#define FRAMES 50
+#define FRAME_LENGTH 20
+
+struct Edge {
+  uint32_t time;
+  uint8_t level;
+};
+
+/* Transmit a frame as send_byte does with a clock skewed of skew per
+   thousand, timestamps are delayed of up to latency microseconds */
+
+void transmit(
+  std::vector<Edge> &edges,
+  const uint8_t *frame,
+  uint16_t bit_width,
+  uint16_t bit_spacer,
+  int16_t skew,
+  uint16_t latency
+) {
+  double scale = 1.0 + skew / 1000.0, t = 1000;
+  uint8_t level = 0;
+  uint32_t last = 0;
+  edges.clear();
+  for(uint16_t b = 0; b < FRAME_LENGTH; b++)
+    for(int8_t i = -2; i < 8; i++) {
+      uint8_t value = (i == -2) ? 1 : (i == -1) ? 0 : (frame[b] >> i) & 1;
+      if(value != level) {
+        uint32_t time = (uint32_t)(t + random(0, latency + 1));
+        if(time < last) time = last; // Interrupts are served in order
+        edges.push_back({time, value});
+        last = time;
+        level = value;
+      }
+      t += ((i == -2) ? bit_spacer : bit_width) * scale;
+    }
+  if(level) edges.push_back({(uint32_t)(t + random(0, latency + 1)), 0});
+};
+
+/* Feed the edges to the decoder polling it before each edge, returns true
+   if the frame is decoded without errors */
+
+template<typename Decoder>
+bool decode(Decoder &decoder, const std::vector<Edge> &edges, const uint8_t *frame) {
+  uint8_t received = 0;
+  uint16_t value;
+  for(uint32_t e = 0; e <= edges.size(); e++) {
+    uint32_t now = (e < edges.size()) ? edges[e].time : edges.back().time + 10000;
+    while((value = decoder.receive_byte(now)) != FAIL)
+      if(received >= FRAME_LENGTH || value != frame[received++]) return false;
+    if(e < edges.size()) decoder.edge(now, edges[e].level);
+  }
+  return received == FRAME_LENGTH;
+};
+
+/* True if all frames are decoded with the skew in both directions */
+
+template<uint16_t BIT_WIDTH, uint16_t BIT_SPACER, uint16_t ACCEPTANCE>
+bool reliable(uint16_t skew, uint16_t latency) {
+  std::vector<Edge> edges;
+  SWBBEdgeDecoder<BIT_WIDTH, BIT_SPACER, ACCEPTANCE> decoder;
+  randomSeed(12345);
+  for(uint32_t f = 0; f < FRAMES; f++) {
+    uint8_t frame[FRAME_LENGTH];
+    for(uint8_t b = 0; b < FRAME_LENGTH; b++) frame[b] = random(256);
+    for(int8_t sign = -1; sign <= 1; sign += 2) {
+      transmit(edges, frame, BIT_WIDTH, BIT_SPACER, sign * skew, latency);
+      decoder.reset();
+      if(!decode(decoder, edges, frame)) return false;
+    }
+  }
+  return true;
+};
+
+/* Minimum bit width of a mode decoding all frames, starting from its
+   nominal bit width (scaling the padding bit and the acceptance with it) */
+
+template<uint16_t WIDTH, uint16_t SPACER, uint16_t ACCEPTANCE, uint16_t W>
+struct Sweep {
+  static uint16_t minimum_width(uint16_t skew, uint16_t latency) {
+    if(!reliable<W, (W * SPACER) / WIDTH, (W * ACCEPTANCE) / WIDTH>(skew, latency))
+      return W + 1;
+    return Sweep<WIDTH, SPACER, ACCEPTANCE, W - 1>::minimum_width(skew, latency);
+  };
+};
+
+template<uint16_t WIDTH, uint16_t SPACER, uint16_t ACCEPTANCE>
+struct Sweep<WIDTH, SPACER, ACCEPTANCE, 1> {
+  static uint16_t minimum_width(uint16_t skew, uint16_t latency) {
+    return 2;
+  };
+};
+
+const uint16_t skews[] = {0, 20, 50, 100};
+const uint16_t latencies[] = {0, 2, 4, 8};
+
+template<uint16_t WIDTH, uint16_t SPACER, uint16_t ACCEPTANCE>
+bool sweep_mode(const char *name) {
+  bool passed = true;
+  for(uint8_t l = 0; l < 4; l++) {
+    printf("  %-9s %3uus/%3uus  %2uus", name, WIDTH, SPACER, latencies[l]);
+    for(uint8_t s = 0; s < 4; s++) {
+      uint16_t width = Sweep<WIDTH, SPACER, ACCEPTANCE, WIDTH>::minimum_width(
+        skews[s], latencies[l]
+      );
+      if(width > WIDTH) {
+        printf("        -      ");
+        if(skews[s] <= 50 && latencies[l] <= 2) passed = false;
+      } else printf(" %6.1fkBd %3uus", 1000.0 / width, width);
+    }
+    printf("\n");
+  }
+  return passed;
+};
+
+int main() {
+  printf(
+    "Maximum bit rate decoding %u frames of %u bytes (skew in both directions):\n"
+    "  mode      bit/padding latency   skew 0%%         skew 2%%"
+    "         skew 5%%         skew 10%%\n",
+    FRAMES * 2, FRAME_LENGTH
+  );
+  bool passed = true;
+  passed &= sweep_mode<40, 112, 40>("STANDARD");
+  passed &= sweep_mode<28, 66, 28>("FAST");
+  passed &= sweep_mode<20, 56, 20>("OVERDRIVE");
+  printf(passed ? "PASSED\n" : "FAILED\n");
+  return !passed;
+};
@@ -0,0 +1,67 @@
+
+/* Batched transmission benchmark: measures packets per second delivered with
+   1, 8 and 64 packets queued for the same receiver. With MAX_BATCH_PACKETS > 1
+   the queued packets are sent together in a single UDP datagram and are
+   acknowledged with a single response. Set MAX_BATCH_PACKETS to 1 to compare
+   with one packet per datagram. */
+
+#define MAX_BATCH_PACKETS  64
+#define MAX_PACKETS        64
+#define PACKET_MAX_LENGTH  32
+
+#include <PJON.h>
+
+// Ethernet configuration for this device
+byte gateway[] = { 192, 1, 1, 1 };
+byte subnet[] = { 255, 255, 255, 0 };
+byte mac[] = {0xDE, 0xCD, 0x7E, 0xEF, 0xFE, 0x5D};
+uint8_t local_ip[] = { 192, 1, 1, 150 };
+
+// <Strategy name> bus(selected device id)
+PJON<LocalUDP> bus(45);
+
+const uint8_t queue_lengths[] = { 1, 8, 64 };
+uint8_t test = 0;
+uint8_t queued = 0;
+uint32_t delivered = 0;
+uint32_t fails = 0;
+uint32_t start;
+char content[] = "0123456789012345";
+
+void setup() {
+  Serial.begin(115200);
+  Serial.println("Transmitter started.");
+  Ethernet.begin(mac, local_ip, gateway, gateway, subnet);
+
+  bus.set_error(error_handler);
+  bus.begin();
+  start = millis();
+}
+
+void error_handler(uint8_t code, uint8_t data) {
+  if(code == CONNECTION_LOST) fails++;
+};
+
+void loop() {
+  // Packets removed from the buffer since the last call were delivered (or lost)
+  uint8_t remaining = bus.update();
+  delivered += queued - remaining;
+  queued = remaining;
+
+  // Keep the selected number of packets queued
+  while(queued < queue_lengths[test] && bus.send(44, content, 16) != FAIL)
+    queued++;
+
+  if(millis() - start > 5000) {
+    Serial.print("Queued: ");
+    Serial.print(queue_lengths[test]);
+    Serial.print(" Packets/s: ");
+    Serial.print((delivered - fails) / 5);
+    Serial.print(" Fails: ");
+    Serial.println(fails);
+    delivered = 0;
+    fails = 0;
+    test = (test + 1) % sizeof(queue_lengths);
+    start = millis();
+  }
+};
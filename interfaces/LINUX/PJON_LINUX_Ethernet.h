@@ -0,0 +1,550 @@
+
+/* PJON POSIX sockets layer (Linux)
+   Implements with non-blocking sockets the classes of the Arduino Ethernet
+   library used by the LocalUDP and EthernetTCP strategies (IPAddress,
+   EthernetUDP, EthernetClient and EthernetServer), so the strategies run on
+   a host unchanged, with the same wire format, and devices on a host can
+   communicate with Arduino devices on the same network.
+
+   - Reception never blocks, strategies wait for data in the kernel with
+     PJON_Epoll (see their wait method and PJON::receive(duration)), instead
+     of polling the sockets.
+   - EthernetUDP receives up to PJON_UDP_RECEIVE_BATCH datagrams with a
+     single recvmmsg call, with set_deferred(true) datagrams written are
+     queued and sent with a single sendmmsg call by flush, when the queue is
+     full or before the next reception.
+
+   The local IP passed to Ethernet.begin is used to bind the sockets, so more
+   devices can run on a host using the addresses 127.0.0.x, otherwise sockets
+   are bound to all interfaces (needed to receive broadcasts).
+   ____________________________________________________________________________
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License. */
+
+#pragma once
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+/* Datagrams received with a single recvmmsg call */
+#ifndef PJON_UDP_RECEIVE_BATCH
+  #define PJON_UDP_RECEIVE_BATCH 16
+#endif
+
+/* Datagrams sent with a single sendmmsg call (see EthernetUDP::set_deferred) */
+#ifndef PJON_UDP_SEND_BATCH
+  #define PJON_UDP_SEND_BATCH 16
+#endif
+
+/* Maximum length of a datagram, the longest sent by LocalUDP (a batch) */
+#ifndef PJON_UDP_DATAGRAM_LENGTH
+  #define PJON_UDP_DATAGRAM_LENGTH (5 + MAX_BATCH_PACKETS * (PACKET_MAX_LENGTH + 2))
+#endif
+
+/* Maximum duration of a TCP connection attempt in microseconds */
+#ifndef PJON_CONNECT_TIMEOUT
+  #define PJON_CONNECT_TIMEOUT 1000000
+#endif
+
+/* Maximum duration of a TCP write waiting for room in the socket buffer */
+#ifndef PJON_WRITE_TIMEOUT
+  #define PJON_WRITE_TIMEOUT 1000000
+#endif
+
+/* Maximum number of sockets waited by a PJON_Epoll */
+#define PJON_EPOLL_MAX_SOCKETS 4
+
+class IPAddress {
+  public:
+    IPAddress() { memset(_address, 0, 4); };
+
+    IPAddress(uint8_t a, uint8_t b, uint8_t c, uint8_t d) {
+      _address[0] = a;
+      _address[1] = b;
+      _address[2] = c;
+      _address[3] = d;
+    };
+
+    IPAddress(const uint8_t *address) { memcpy(_address, address, 4); };
+
+    uint8_t operator[](uint8_t i) const { return _address[i]; };
+    uint8_t &operator[](uint8_t i) { return _address[i]; };
+
+    bool operator==(const IPAddress &other) const {
+      return !memcmp(_address, other._address, 4);
+    };
+
+    bool any() const {
+      return !(_address[0] | _address[1] | _address[2] | _address[3]);
+    };
+
+    /* Socket address of a port at this address */
+
+    sockaddr_in address(uint16_t port) const {
+      sockaddr_in a;
+      memset(&a, 0, sizeof(a));
+      a.sin_family = AF_INET;
+      a.sin_port = htons(port);
+      memcpy(&a.sin_addr.s_addr, _address, 4);
+      return a;
+    };
+
+  private:
+    uint8_t _address[4];
+};
+
+/* The Ethernet object of the Arduino library, only the local IP is used */
+
+class PJON_Ethernet_Interface {
+  public:
+    void begin(const uint8_t *mac, IPAddress ip = IPAddress()) {
+      (void)mac;
+      _ip = ip;
+    };
+
+    void begin(
+      const uint8_t *mac,
+      IPAddress ip,
+      IPAddress dns,
+      IPAddress gateway = IPAddress(),
+      IPAddress subnet = IPAddress()
+    ) {
+      (void)dns;
+      (void)gateway;
+      (void)subnet;
+      begin(mac, ip);
+    };
+
+    IPAddress localIP() const { return _ip; };
+
+  private:
+    IPAddress _ip;
+};
+
+inline PJON_Ethernet_Interface &PJON_Ethernet() {
+  static PJON_Ethernet_Interface ethernet;
+  return ethernet;
+};
+
+static PJON_Ethernet_Interface &Ethernet __attribute__((unused)) = PJON_Ethernet();
+
+/* Wait for a socket to be ready for the events (POLLIN or POLLOUT) */
+
+inline bool PJON_wait_socket(int fd, short events, uint32_t duration_us) {
+  if(fd < 0) return false;
+  pollfd p;
+  p.fd = fd;
+  p.events = events;
+  p.revents = 0;
+  return poll(&p, 1, (duration_us + 999) / 1000) > 0;
+};
+
+inline bool PJON_bind(int fd, uint16_t port) {
+  int on = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  sockaddr_in a = PJON_Ethernet().localIP().address(port);
+  return bind(fd, (sockaddr *)&a, sizeof(a)) == 0;
+};
+
+
+/* Waits in the kernel until one of the sockets has data to be read, the
+   sockets registered are kept in sync with the ones passed */
+
+class PJON_Epoll {
+  public:
+    PJON_Epoll() { };
+    PJON_Epoll(const PJON_Epoll &) { };
+    PJON_Epoll &operator=(const PJON_Epoll &) { return *this; };
+
+    ~PJON_Epoll() {
+      if(_fd >= 0) close(_fd);
+    };
+
+
+    /* Wait up to duration_us for data, returns true if available: */
+
+    bool wait(const int *sockets, uint8_t count, uint32_t duration_us) {
+      if(_fd < 0 && (_fd = epoll_create1(EPOLL_CLOEXEC)) < 0) return false;
+      // Remove sockets not waited anymore
+      for(uint8_t r = 0; r < _count; )
+        if(!contains(sockets, count, _sockets[r])) {
+          epoll_ctl(_fd, EPOLL_CTL_DEL, _sockets[r], NULL);
+          _sockets[r] = _sockets[--_count];
+        } else r++;
+      for(uint8_t s = 0; s < count; s++) {
+        if(sockets[s] < 0) continue;
+        epoll_event e;
+        e.events = EPOLLIN;
+        e.data.fd = sockets[s];
+        if(contains(_sockets, _count, sockets[s])) {
+          // A socket closed and a new one with the same number are re-added
+          if(!epoll_ctl(_fd, EPOLL_CTL_MOD, sockets[s], &e) || errno != ENOENT) continue;
+          epoll_ctl(_fd, EPOLL_CTL_ADD, sockets[s], &e);
+        } else if(_count < PJON_EPOLL_MAX_SOCKETS && !epoll_ctl(_fd, EPOLL_CTL_ADD, sockets[s], &e))
+          _sockets[_count++] = sockets[s];
+      }
+      if(!_count) return false;
+      epoll_event events[PJON_EPOLL_MAX_SOCKETS];
+      return epoll_wait(_fd, events, PJON_EPOLL_MAX_SOCKETS, (duration_us + 999) / 1000) > 0;
+    };
+
+  private:
+    static bool contains(const int *sockets, uint8_t count, int fd) {
+      for(uint8_t i = 0; i < count; i++) if(sockets[i] == fd) return true;
+      return false;
+    };
+
+    int     _fd = -1;
+    int     _sockets[PJON_EPOLL_MAX_SOCKETS];
+    uint8_t _count = 0;
+};
+
+
+class EthernetUDP {
+  public:
+    EthernetUDP() { };
+
+    ~EthernetUDP() {
+      stop();
+    };
+
+
+    /* Open the socket listening on port, returns 1 if successful: */
+
+    uint8_t begin(uint16_t port) {
+      stop();
+      _fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+      if(_fd < 0) return 0;
+      int on = 1;
+      setsockopt(_fd, SOL_SOCKET, SO_BROADCAST, &on, sizeof(on));
+      if(!PJON_bind(_fd, port)) {
+        stop();
+        return 0;
+      }
+      return 1;
+    };
+
+    void stop() {
+      if(_fd >= 0) close(_fd);
+      _fd = -1;
+      _in_count = _in_next = 0;
+      _length = _position = 0;
+      _out_count = 0;
+    };
+
+
+    /* Move to the next datagram received, returns its length or 0: */
+
+    int parsePacket() {
+      flush();
+      if(_fd < 0) return 0;
+      if(_in_next >= _in_count) {
+        mmsghdr messages[PJON_UDP_RECEIVE_BATCH];
+        iovec vectors[PJON_UDP_RECEIVE_BATCH];
+        memset(messages, 0, sizeof(messages));
+        for(uint8_t i = 0; i < PJON_UDP_RECEIVE_BATCH; i++) {
+          vectors[i].iov_base = _in[i];
+          vectors[i].iov_len = PJON_UDP_DATAGRAM_LENGTH;
+          messages[i].msg_hdr.msg_iov = &vectors[i];
+          messages[i].msg_hdr.msg_iovlen = 1;
+          messages[i].msg_hdr.msg_name = &_in_from[i];
+          messages[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+        }
+        int received = recvmmsg(_fd, messages, PJON_UDP_RECEIVE_BATCH, MSG_DONTWAIT, NULL);
+        _in_count = (received > 0) ? received : 0;
+        _in_next = 0;
+        for(uint8_t i = 0; i < _in_count; i++)
+          _in_length[i] = (messages[i].msg_hdr.msg_flags & MSG_TRUNC) ? 0 : messages[i].msg_len;
+      }
+      _length = _position = 0;
+      if(_in_next >= _in_count) return 0;
+      _current = _in_next++;
+      _length = _in_length[_current];
+      return _length;
+    };
+
+    int available() const {
+      return _length - _position;
+    };
+
+    int read(uint8_t *buffer, size_t length) {
+      size_t count = (length < (size_t)available()) ? length : available();
+      memcpy(buffer, _in[_current] + _position, count);
+      _position += count;
+      return count;
+    };
+
+    int read(char *buffer, size_t length) {
+      return read((uint8_t *)buffer, length);
+    };
+
+    int read() {
+      if(!available()) return -1;
+      return _in[_current][_position++];
+    };
+
+    IPAddress remoteIP() const {
+      return IPAddress((const uint8_t *)&_in_from[_current].sin_addr.s_addr);
+    };
+
+    uint16_t remotePort() const {
+      return ntohs(_in_from[_current].sin_port);
+    };
+
+
+    /* Compose a datagram: */
+
+    int beginPacket(IPAddress ip, uint16_t port) {
+      if(_out_count == PJON_UDP_SEND_BATCH) flush();
+      _out_to[_out_count] = ip.address(port);
+      _out_length[_out_count] = 0;
+      return 1;
+    };
+
+    size_t write(const uint8_t *buffer, size_t length) {
+      uint16_t &position = _out_length[_out_count];
+      if(position + length > PJON_UDP_DATAGRAM_LENGTH) length = PJON_UDP_DATAGRAM_LENGTH - position;
+      memcpy(_out[_out_count] + position, buffer, length);
+      position += length;
+      return length;
+    };
+
+    size_t write(const char *buffer, size_t length) {
+      return write((const uint8_t *)buffer, length);
+    };
+
+    size_t write(uint8_t value) {
+      return write(&value, 1);
+    };
+
+    int endPacket() {
+      _out_count++;
+      if(!_deferred || _out_count == PJON_UDP_SEND_BATCH) return flush();
+      return 1;
+    };
+
+
+    /* Send the datagrams queued, returns 1 if all were sent: */
+
+    int flush() {
+      if(!_out_count) return 1;
+      mmsghdr messages[PJON_UDP_SEND_BATCH];
+      iovec vectors[PJON_UDP_SEND_BATCH];
+      memset(messages, 0, sizeof(messages));
+      for(uint8_t i = 0; i < _out_count; i++) {
+        vectors[i].iov_base = _out[i];
+        vectors[i].iov_len = _out_length[i];
+        messages[i].msg_hdr.msg_iov = &vectors[i];
+        messages[i].msg_hdr.msg_iovlen = 1;
+        messages[i].msg_hdr.msg_name = &_out_to[i];
+        messages[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+      }
+      uint8_t sent = 0;
+      while(sent < _out_count) {
+        int result = sendmmsg(_fd, messages + sent, _out_count - sent, 0);
+        if(result <= 0) break; // Datagrams are dropped as a busy medium would do
+        sent += result;
+      }
+      bool all = sent == _out_count;
+      _out_count = 0;
+      return all;
+    };
+
+
+    /* Queue datagrams written (sent by flush) instead of sending them: */
+
+    void set_deferred(bool deferred) {
+      if(!deferred) flush();
+      _deferred = deferred;
+    };
+
+    /* True if datagrams received are waiting to be parsed */
+
+    bool buffered() const {
+      return _in_next < _in_count;
+    };
+
+    int fd() const { return _fd; };
+
+  private:
+    int         _fd = -1;
+    // Reception
+    uint8_t     _in[PJON_UDP_RECEIVE_BATCH][PJON_UDP_DATAGRAM_LENGTH];
+    uint16_t    _in_length[PJON_UDP_RECEIVE_BATCH];
+    sockaddr_in _in_from[PJON_UDP_RECEIVE_BATCH];
+    uint8_t     _in_count = 0;
+    uint8_t     _in_next = 0;
+    uint8_t     _current = 0;
+    uint16_t    _length = 0;
+    uint16_t    _position = 0;
+    // Transmission
+    uint8_t     _out[PJON_UDP_SEND_BATCH][PJON_UDP_DATAGRAM_LENGTH];
+    uint16_t    _out_length[PJON_UDP_SEND_BATCH];
+    sockaddr_in _out_to[PJON_UDP_SEND_BATCH];
+    uint8_t     _out_count = 0;
+    bool        _deferred = false;
+};
+
+
+/* A TCP connection, copies refer to the same socket as in the Arduino
+   library. read returns -1 if no data is available, 0 if the connection
+   has been closed. */
+
+class EthernetClient {
+  public:
+    EthernetClient() { };
+    EthernetClient(int fd) : _fd(fd) { };
+
+
+    /* Connect waiting up to PJON_CONNECT_TIMEOUT, returns 1 if connected: */
+
+    int connect(IPAddress ip, uint16_t port) {
+      stop();
+      _fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+      if(_fd < 0) return 0;
+      int on = 1;
+      setsockopt(_fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+      sockaddr_in a = ip.address(port);
+      if(::connect(_fd, (sockaddr *)&a, sizeof(a)) && errno != EINPROGRESS) {
+        stop();
+        return 0;
+      }
+      int error = 0;
+      socklen_t length = sizeof(error);
+      if(
+        !PJON_wait_socket(_fd, POLLOUT, PJON_CONNECT_TIMEOUT) ||
+        getsockopt(_fd, SOL_SOCKET, SO_ERROR, &error, &length) || error
+      ) {
+        stop();
+        return 0;
+      }
+      return 1;
+    };
+
+
+    /* Connected or with data still to be read: */
+
+    uint8_t connected() {
+      if(_fd < 0) return 0;
+      uint8_t value;
+      int result = recv(_fd, &value, 1, MSG_PEEK | MSG_DONTWAIT);
+      return result > 0 || (result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+    };
+
+    int available() {
+      int count = 0;
+      if(_fd < 0 || ioctl(_fd, FIONREAD, &count)) return 0;
+      return count;
+    };
+
+    int read(uint8_t *buffer, size_t length) {
+      if(_fd < 0) return 0;
+      if(!length) return connected() ? -1 : 0;
+      int result = recv(_fd, buffer, length, MSG_DONTWAIT);
+      if(result < 0) return (errno == EAGAIN || errno == EWOULDBLOCK) ? -1 : 0;
+      return result;
+    };
+
+    int read() {
+      uint8_t value;
+      return (read(&value, 1) == 1) ? value : -1;
+    };
+
+
+    /* Write waiting for room in the socket buffer up to PJON_WRITE_TIMEOUT: */
+
+    size_t write(const uint8_t *buffer, size_t length) {
+      size_t written = 0;
+      while(_fd >= 0 && written < length) {
+        int result = send(_fd, buffer + written, length - written, MSG_DONTWAIT | MSG_NOSIGNAL);
+        if(result > 0) written += result;
+        else if(
+          result < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) &&
+          PJON_wait_socket(_fd, POLLOUT, PJON_WRITE_TIMEOUT)
+        ) continue;
+        else break;
+      }
+      return written;
+    };
+
+    size_t write(uint8_t value) {
+      return write(&value, 1);
+    };
+
+    void flush() { }; // Data is sent by the kernel
+
+    void stop() {
+      if(_fd >= 0) close(_fd);
+      _fd = -1;
+    };
+
+
+    /* Wait up to duration_us for data to be read: */
+
+    bool wait(uint32_t duration_us) {
+      return PJON_wait_socket(_fd, POLLIN, duration_us);
+    };
+
+    operator bool() const { return _fd >= 0; };
+
+    int fd() const { return _fd; };
+
+  private:
+    int _fd = -1;
+};
+
+
+class EthernetServer {
+  public:
+    EthernetServer(uint16_t port) : _port(port) { };
+
+    ~EthernetServer() {
+      if(_fd >= 0) close(_fd);
+    };
+
+    void begin() {
+      if(_fd >= 0) return;
+      _fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+      if(_fd < 0) return;
+      if(!PJON_bind(_fd, _port) || listen(_fd, 8)) {
+        close(_fd);
+        _fd = -1;
+      }
+    };
+
+
+    /* Accept a connection, the client returned is not valid if none: */
+
+    EthernetClient available() {
+      if(_fd < 0) return EthernetClient();
+      int fd = accept4(_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+      if(fd < 0) return EthernetClient();
+      int on = 1;
+      setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+      return EthernetClient(fd);
+    };
+
+    int fd() const { return _fd; };
+
+  private:
+    uint16_t _port;
+    int      _fd = -1;
+};
@@ -0,0 +1,157 @@
+
+/* PJON POSIX (Linux, macOS) platform layer
+   Provides on a host the Arduino functions used by PJON (micros, delay,
+   random...) so the protocol can be compiled, run and measured without
+   hardware. It is included by PJON.h if ARDUINO is not defined.
+
+   Define PJON_VIRTUAL_CLOCK before including PJON.h to use a simulated
+   clock: time advances only when a delay is called (strategies simulating
+   transmissions, like VirtualBus, delay for their duration), so simulations
+   are deterministic and not affected by the host load.
+   ____________________________________________________________________________
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License. */
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <type_traits>
+
+typedef bool boolean;
+typedef uint8_t byte;
+
+#define A0 0
+
+/* Binary constants used by PJON (defined by Arduino's binary.h) */
+#define B00000001 1
+#define B00000010 2
+#define B00000100 4
+#define B00001000 8
+#define B00010000 16
+#define B00100000 32
+#define B01000000 64
+#define B10000000 128
+
+/* TIME: */
+
+#if defined(PJON_VIRTUAL_CLOCK)
+
+  /* Simulated time in microseconds */
+  inline uint64_t &PJON_virtual_time() {
+    static uint64_t time = 0;
+    return time;
+  };
+
+  inline uint64_t PJON_micros_64() {
+    return PJON_virtual_time();
+  };
+
+  inline void delayMicroseconds(uint32_t duration) {
+    PJON_virtual_time() += duration;
+  };
+
+#else
+
+  inline uint64_t PJON_micros_64() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000ull + now.tv_nsec / 1000;
+  };
+
+  /* Short delays are busy waits (as on Arduino) to be accurate,
+     longer ones leave the CPU to other processes */
+  inline void delayMicroseconds(uint32_t duration) {
+    uint64_t start = PJON_micros_64();
+    if(duration > 1000) {
+      struct timespec pause;
+      pause.tv_sec = (duration - 500) / 1000000;
+      pause.tv_nsec = ((duration - 500) % 1000000) * 1000;
+      nanosleep(&pause, NULL);
+    }
+    while(PJON_micros_64() - start < duration);
+  };
+
+#endif
+
+inline uint32_t micros() {
+  return (uint32_t)PJON_micros_64();
+};
+
+inline uint32_t millis() {
+  return (uint32_t)(PJON_micros_64() / 1000);
+};
+
+inline void delay(uint32_t duration) {
+  while(duration--) delayMicroseconds(1000);
+};
+
+/* MATH:
+   min and max as defined by Arduino, templates instead of macros so the
+   standard library headers are not affected (they return a value, not a
+   reference to their parameters) */
+
+template<typename A, typename B>
+inline auto min(A a, B b) -> typename std::decay<decltype(a < b ? a : b)>::type {
+  return (a < b) ? a : b;
+};
+
+template<typename A, typename B>
+inline auto max(A a, B b) -> typename std::decay<decltype(a < b ? a : b)>::type {
+  return (a < b) ? b : a;
+};
+
+/* RANDOM:
+   xorshift32 generator, the same sequence is generated on any host
+   for the same seed (the C library rand() is not portable). Each thread
+   has its own state (see PJONGateway.h) */
+
+inline uint32_t &PJON_random_state() {
+  static thread_local uint32_t state = 2463534242ul;
+  return state;
+};
+
+inline void randomSeed(unsigned long seed) {
+  if(seed) PJON_random_state() = (uint32_t)seed; // As Arduino ignores 0
+};
+
+inline long random(long max) {
+  if(max <= 0) return 0;
+  uint32_t &x = PJON_random_state();
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return x % max;
+};
+
+inline long random(long min, long max) {
+  if(min >= max) return min;
+  return min + random(max - min);
+};
+
+/* analogRead is used by PJON only to seed the random generator, with the
+   virtual clock it returns 0 (seed ignored) so simulations are repeatable */
+
+inline int analogRead(uint8_t pin) {
+  #if defined(PJON_VIRTUAL_CLOCK)
+    (void)pin;
+    return 0;
+  #else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_nsec ^ pin) & 1023;
+  #endif
+};
@@ -0,0 +1,244 @@
+/* PJON POSIX serial port layer (Linux)
+   Implements the Stream class of Arduino over termios, so the ThroughSerial
+   strategy runs on a host unchanged, for example with USB RS485 adapters:
+
+     PJON_Serial serial;
+     serial.begin("/dev/ttyUSB0", 115200);
+     bus.strategy.set_serial(&serial);
+
+   - The port is non-blocking, received bytes are read in bulk in a buffer
+     of PJON_SERIAL_BUFFER_LENGTH bytes when it is empty.
+   - Bytes written are queued and written with a single write call by flush
+     (as ThroughSerial does after each packet), when the queue is full or
+     before the next reception. flush then waits with tcdrain until the
+     bytes are transmitted, so the RS485 direction can be switched.
+   - The RTS line is used as RS485 transmission enable (see set_transmit).
+   ____________________________________________________________________________
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License. */
+
+#pragma once
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/select.h>
+#include <termios.h>
+#include <unistd.h>
+
+/* Length of the reception and transmission buffers */
+#ifndef PJON_SERIAL_BUFFER_LENGTH
+  #define PJON_SERIAL_BUFFER_LENGTH 4096
+#endif
+
+/* Maximum duration of a write waiting for room in the output queue */
+#ifndef PJON_SERIAL_WRITE_TIMEOUT
+  #define PJON_SERIAL_WRITE_TIMEOUT 1000000
+#endif
+
+/* The Stream interface of Arduino, with two host extensions used by
+   ThroughSerial: wait (wait for data in the kernel) and set_transmit
+   (RS485 transmission enable) */
+
+class Stream {
+  public:
+    virtual ~Stream() { };
+    virtual int available() = 0;
+    virtual int read() = 0;
+    virtual int peek() = 0;
+    virtual size_t write(const uint8_t *buffer, size_t length) = 0;
+    virtual void flush() { };
+
+    size_t write(uint8_t b) { return write(&b, 1); };
+
+    virtual bool wait(uint32_t duration_us) {
+      (void)duration_us;
+      return available() > 0;
+    };
+
+    virtual void set_transmit(bool state) { (void)state; };
+};
+
+
+class PJON_Serial : public Stream {
+  public:
+    using Stream::write;
+
+    PJON_Serial() { };
+
+    ~PJON_Serial() {
+      end();
+    };
+
+
+    /* Open a serial port (for example "/dev/ttyUSB0") in raw mode 8N1,
+       returns true if successful: */
+
+    bool begin(const char *device, uint32_t baud) {
+      end();
+      int fd = open(device, O_RDWR | O_NOCTTY | O_NONBLOCK | O_CLOEXEC);
+      if(fd < 0) return false;
+      if(begin(fd, baud)) return true;
+      close(fd);
+      return false;
+    };
+
+
+    /* Use a file descriptor already open (for example a pseudo terminal),
+       it is closed by end: */
+
+    bool begin(int fd, uint32_t baud) {
+      end();
+      termios t;
+      speed_t s = speed(baud);
+      if(fd < 0 || s == B0 || tcgetattr(fd, &t)) return false;
+      cfmakeraw(&t);
+      t.c_cflag |= CLOCAL | CREAD;
+      t.c_cflag &= ~(CSTOPB | CRTSCTS);
+      t.c_cc[VMIN] = 0;
+      t.c_cc[VTIME] = 0;
+      cfsetispeed(&t, s);
+      cfsetospeed(&t, s);
+      if(tcsetattr(fd, TCSANOW, &t)) return false;
+      fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+      _fd = fd;
+      return true;
+    };
+
+    void end() {
+      if(_fd < 0) return;
+      send();
+      close(_fd);
+      _fd = -1;
+      _position = _length = _queued = 0;
+    };
+
+
+    /* Reception, bytes are read from the port only when the buffer is
+       empty, so most calls do not need a system call: */
+
+    int available() {
+      send();
+      if(_position == _length && _fd >= 0) {
+        ssize_t result = ::read(_fd, _in, PJON_SERIAL_BUFFER_LENGTH);
+        _position = 0;
+        _length = (result > 0) ? result : 0;
+      }
+      return _length - _position;
+    };
+
+    int read() {
+      if(!available()) return -1;
+      return _in[_position++];
+    };
+
+    int peek() {
+      if(!available()) return -1;
+      return _in[_position];
+    };
+
+
+    /* Transmission, bytes are queued until flush: */
+
+    size_t write(const uint8_t *buffer, size_t length) {
+      if(_fd < 0) return 0;
+      for(size_t written = 0; written < length; ) {
+        if(_queued == PJON_SERIAL_BUFFER_LENGTH) send();
+        size_t count = PJON_SERIAL_BUFFER_LENGTH - _queued;
+        if(count > length - written) count = length - written;
+        memcpy(_out + _queued, buffer + written, count);
+        _queued += count;
+        written += count;
+      }
+      return length;
+    };
+
+
+    /* Write the bytes queued and wait until they are transmitted: */
+
+    void flush() {
+      if(_fd < 0) return;
+      send();
+      tcdrain(_fd);
+    };
+
+
+    /* Wait up to duration_us for incoming data, returns true if available
+       (select is used because poll would round the wait to milliseconds): */
+
+    bool wait(uint32_t duration_us) {
+      if(available()) return true;
+      if(_fd < 0) return false;
+      fd_set set;
+      FD_ZERO(&set);
+      FD_SET(_fd, &set);
+      timeval t = {(time_t)(duration_us / 1000000), (suseconds_t)(duration_us % 1000000)};
+      return select(_fd + 1, &set, NULL, NULL, &t) > 0;
+    };
+
+
+    /* Set the RTS line, used as RS485 transmission enable: */
+
+    void set_transmit(bool state) {
+      int bits = TIOCM_RTS;
+      if(_fd >= 0) ioctl(_fd, state ? TIOCMBIS : TIOCMBIC, &bits);
+    };
+
+    int fd() const {
+      return _fd;
+    };
+
+  private:
+
+    /* Write the bytes queued with a single system call, waiting for room
+       in the output queue if needed */
+
+    void send() {
+      uint16_t sent = 0;
+      while(sent < _queued) {
+        ssize_t result = ::write(_fd, _out + sent, _queued - sent);
+        if(result > 0) sent += result;
+        else if(result < 0 && errno == EINTR) continue;
+        else if(result < 0 && errno == EAGAIN) {
+          pollfd p;
+          p.fd = _fd;
+          p.events = POLLOUT;
+          if(poll(&p, 1, PJON_SERIAL_WRITE_TIMEOUT / 1000) <= 0) break;
+        } else break;
+      }
+      _queued = 0;
+    };
+
+    static speed_t speed(uint32_t baud) {
+      static const struct { uint32_t baud; speed_t speed; } speeds[] = {
+        {1200, B1200}, {2400, B2400}, {4800, B4800}, {9600, B9600},
+        {19200, B19200}, {38400, B38400}, {57600, B57600},
+        {115200, B115200}, {230400, B230400},
+      #if defined(B460800)
+        {460800, B460800}, {500000, B500000}, {921600, B921600},
+        {1000000, B1000000}, {2000000, B2000000},
+      #endif
+      };
+      for(uint8_t i = 0; i < sizeof(speeds) / sizeof(speeds[0]); i++)
+        if(speeds[i].baud == baud) return speeds[i].speed;
+      return B0;
+    };
+
+    int      _fd = -1;
+    uint8_t  _in[PJON_SERIAL_BUFFER_LENGTH];
+    uint8_t  _out[PJON_SERIAL_BUFFER_LENGTH];
+    uint16_t _position = 0;
+    uint16_t _length = 0;
+    uint16_t _queued = 0;
+};
@@ -110,16 +110,26 @@
 #pragma once
 
 //#include <Link.h>
-#ifndef UIPETHERNET_H
-  #include <Ethernet.h>
-#endif  
-
-// Constants
-#define ACK           6
-#define NAK           21
+#if defined(ARDUINO)
+  #ifndef UIPETHERNET_H
+    #include <Ethernet.h>
+  #endif
+#else
+  #include "interfaces/LINUX/PJON_LINUX_Ethernet.h"
+#endif
+
+// Constants (the ones of PJON are used if already defined)
+#ifndef ACK
+  #define ACK           6
+#endif
+#ifndef NAK
+  #define NAK           21
+#endif
 
 // Internal constants
-#define FAIL          0x100
+#ifndef FAIL
+  #define FAIL          0x100
+#endif
 
 #define MAX_REMOTE_NODES 10
 #define DEFAULT_PORT     7000
@@ -149,7 +159,8 @@ private:
   EthernetClient _client_in;     // Accepted incoming connection
   int16_t _current_device = -1;  // The id of the remove device/node that we have connected to
   bool _keep_connection = false, // Keep sockets permanently open instead of reconnecting for each transfer
-       _single_socket = false;   // Do bidirectional transfer on a single socket
+       _single_socket = false,   // Do bidirectional transfer on a single socket
+       _stream_ok = false;       // Segmented transmission in progress without errors
 
   void init();
   int16_t find_remote_node(uint8_t id);
@@ -161,8 +172,22 @@ private:
   void disconnect_out_if_needed(int16_t result);
   bool disconnect_in_if_needed();
   uint16_t send(EthernetClient &client, uint8_t id, const char *packet, uint16_t length);
+  bool send_head(EthernetClient &client, uint8_t id, uint16_t length);
+  uint16_t send_foot(EthernetClient &client, bool ok);
   uint16_t single_socket_transfer(EthernetClient &client, int16_t id, bool master, const char *contents, uint16_t length);
-  bool read_until_header(EthernetClient &client, uint32_t header);
+  uint32_t read_until_header(EthernetClient &client, uint32_t header, uint32_t alternative_header = 0);
+  uint16_t receive_batch(EthernetClient &client);
+
+  // Wait for data to be read from a connection, on a host in the kernel
+  // (with a timeout so the connection state is checked again)
+  void wait_data(EthernetClient &client) {
+#if !defined(ARDUINO)
+    client.wait(100000);
+#endif
+  };
+#if !defined(ARDUINO)
+  PJON_Epoll _epoll;
+#endif
 public:
   EthernetLink() { init(); };
   EthernetLink(uint8_t id) { init(); set_id(id); };
@@ -178,9 +203,10 @@ public:
   // exchanged in both directions on the same socket. If using this, _only one_ of the sides should call
   // start_listening, and that side will be receiver with the other initiator (establishing connections)
   void single_socket(bool single_socket) { _single_socket = single_socket; }
+  bool single_socket() const { return _single_socket; }
   
   // Keep trying to send for a maximum duration
-  int16_t send_with_duration(uint8_t id, const char *packet, uint16_t length, unsigned long duration_us);
+  int16_t send_with_duration(uint8_t id, const char *packet, uint16_t length, uint32_t duration_us);
 
   // In single-socket mode and acting as initiator, connect and check for incoming packets from a specific device
   uint16_t poll_receive(uint8_t remote_id);
@@ -193,8 +219,25 @@ public:
   uint16_t receive();
   uint16_t receive(uint32_t duration_us);
 
+#if !defined(ARDUINO)
+  // Wait in the kernel up to duration_us for incoming connections or data,
+  // returns true if any is available
+  bool wait(uint32_t duration_us);
+#endif
+
   uint16_t send(uint8_t id, const char *packet, uint16_t length, uint32_t timing_us = 0);
 
+  // Deliver a packet written in segments without buffering it (not supported in single_socket mode):
+  // send_begin connects and writes the header, send_segment writes a part of the contents,
+  // send_end writes the footer and returns ACK, NAK or FAIL.
+  bool send_begin(uint8_t id, uint16_t length);
+  bool send_segment(const char *segment, uint16_t length);
+  uint16_t send_end();
+
+  // Deliver multiple packets to the same node in a single transfer (not supported in single_socket mode).
+  // The receiver responds with a bitmap having a bit set for each packet received.
+  uint16_t send_batch(uint8_t id, const char * const *packets, const uint16_t *lengths, uint8_t count, uint8_t *bitmap);
+
   void set_id(uint8_t id) { _local_id = id; };
   void set_error(link_error e) { _error = e; };
   void set_receiver(link_receiver r, void *callback_object) { _receiver = r; _callback_object = callback_object; };
@@ -23,24 +23,34 @@
 #include "EthernetLink.h"
 #include <PJONDefines.h>
 
+/* With batching (MAX_BATCH_PACKETS > 1) more packets can be received at once */
+#if MAX_BATCH_PACKETS > 1
+  #define ETCP_BUFFER_LENGTH (MAX_BATCH_PACKETS * (PACKET_MAX_LENGTH + 2))
+#else
+  #define ETCP_BUFFER_LENGTH (PACKET_MAX_LENGTH + 2)
+#endif
+
 class EthernetTCP {
   public:
     EthernetLink link;
     uint16_t last_send_result = FAIL;
 
-    /* Caching of incoming packet to make it possible to deliver it byte for byte */
+    /* Caching of incoming packets to make it possible to deliver them byte for byte,
+       each packet is stored preceded by its length (2 bytes) */
 
-    uint8_t incoming_packet_buf[PACKET_MAX_LENGTH];
+    uint8_t incoming_packet_buf[ETCP_BUFFER_LENGTH];
     uint16_t incoming_packet_size = 0;
     uint16_t incoming_packet_pos = 0;
+    uint16_t incoming_packet_end = 0; // End of the packet being delivered
     static void static_receiver(uint8_t id, const uint8_t *payload, uint16_t length, void *callback_object) {
       if (callback_object) ((EthernetTCP*)callback_object)->receiver(id, payload, length);
     }
     void receiver(uint8_t id, const uint8_t *payload, uint16_t length) {
-      if (length <= PACKET_MAX_LENGTH) {
-        memcpy(incoming_packet_buf, payload, length);
-        incoming_packet_size = length;
-        incoming_packet_pos = 0;
+      if (length <= PACKET_MAX_LENGTH && incoming_packet_size + length + 2 <= ETCP_BUFFER_LENGTH) {
+        incoming_packet_buf[incoming_packet_size++] = length >> 8;
+        incoming_packet_buf[incoming_packet_size++] = length & 0xFF;
+        memcpy(incoming_packet_buf + incoming_packet_size, payload, length);
+        incoming_packet_size += length;
       }
     }
 
@@ -54,19 +64,66 @@ class EthernetTCP {
       return link.device_id() != 0;
     };
 
+#if !defined(ARDUINO)
+
+    /* Wait for connections or data in the kernel up to duration_us, returns
+       true if data may be available (used by PJON::receive(duration)): */
+
+    bool wait(uint32_t duration_us) {
+      if (incoming_packet_pos < incoming_packet_end || incoming_packet_end < incoming_packet_size)
+        return true;
+      return link.wait(duration_us);
+    };
+#endif
+
 
     uint16_t receive_byte() {
-      // Must receive a new packet, or is there more to serve from the last one?
-      if (incoming_packet_pos >= incoming_packet_size) link.receive();
+      // Must receive new packets, or is there more to serve from the last ones?
+      if (incoming_packet_pos >= incoming_packet_end) {
+        if (incoming_packet_end >= incoming_packet_size) {
+          incoming_packet_size = incoming_packet_pos = incoming_packet_end = 0;
+          link.receive();
+        }
+        if (incoming_packet_pos + 2 <= incoming_packet_size) {
+          incoming_packet_end = incoming_packet_pos + 2 + (
+            incoming_packet_buf[incoming_packet_pos] << 8 | incoming_packet_buf[incoming_packet_pos + 1]
+          );
+          incoming_packet_pos += 2;
+        }
+      }
 
       // Deliver the next byte from the last received packet if any
-      if (incoming_packet_pos < incoming_packet_size) {
+      if (incoming_packet_pos < incoming_packet_end) {
         return incoming_packet_buf[incoming_packet_pos++];
       }
       return FAIL;
     };
 
 
+    /* Deliver the next packet received at once (see PJON_Supports_Frames) */
+
+    uint16_t receive_frame(uint8_t *buffer, uint16_t max) {
+      if (incoming_packet_pos < incoming_packet_end) { // Rest of a packet
+        uint16_t length = incoming_packet_end - incoming_packet_pos;
+        memcpy(buffer, incoming_packet_buf + incoming_packet_pos, min(length, max));
+        incoming_packet_pos = incoming_packet_end;
+        return length;
+      }
+      if (incoming_packet_end >= incoming_packet_size) {
+        incoming_packet_size = incoming_packet_pos = incoming_packet_end = 0;
+        link.receive();
+      }
+      if (incoming_packet_pos + 2 > incoming_packet_size) return FAIL;
+      uint16_t length =
+        incoming_packet_buf[incoming_packet_pos] << 8 | incoming_packet_buf[incoming_packet_pos + 1];
+      incoming_packet_pos += 2;
+      incoming_packet_end = incoming_packet_pos + length;
+      memcpy(buffer, incoming_packet_buf + incoming_packet_pos, min(length, max));
+      incoming_packet_pos = incoming_packet_end;
+      return length;
+    };
+
+
     /* Receive byte response */
 
     uint16_t receive_response() {
@@ -86,4 +143,58 @@ class EthernetTCP {
       if (length > 0)
         last_send_result = link.send((uint8_t)string[0], (const char*)string, length);
     };
+
+
+    /* Segmented transmission, the connection is established when the
+       first segment (starting with the receiver id) is available.
+       Not supported in single socket mode. */
+
+    bool send_string_begin(uint16_t length) {
+      if(link.single_socket() || !length) return false;
+      _stream_length = length;
+      _stream_started = false;
+      return true;
+    };
+
+    void send_string_segment(const uint8_t *string, uint16_t length) {
+      if(!length) return;
+      if(!_stream_started) _stream_started = link.send_begin(string[0], _stream_length);
+      link.send_segment((const char*)string, length);
+    };
+
+    void send_string_end() {
+      last_send_result = link.send_end();
+    };
+
+#if MAX_BATCH_PACKETS > 1
+
+    /* Send a batch of packets directed to the same device in a single transfer: */
+
+    bool send_batch(const PJON_Segment *packets, uint8_t count) {
+      if (link.single_socket()) return false;
+      const char *contents[MAX_BATCH_PACKETS];
+      uint16_t lengths[MAX_BATCH_PACKETS];
+      for (uint8_t i = 0; i < count; i++) {
+        contents[i] = (const char *)packets[i].data;
+        lengths[i] = packets[i].length;
+      }
+      last_send_result = link.send_batch(packets[0].data[0], contents, lengths, count, _batch_bitmap);
+      return true;
+    };
+
+
+    /* Receive the acknowledge bitmap of the last batch: */
+
+    uint16_t receive_batch_response(uint8_t *bitmap, uint8_t count) {
+      if (last_send_result == ACK) memcpy(bitmap, _batch_bitmap, (count + 7) / 8);
+      return last_send_result;
+    };
+#endif
+
+  private:
+#if MAX_BATCH_PACKETS > 1
+    uint8_t  _batch_bitmap[(MAX_BATCH_PACKETS + 7) / 8];
+#endif
+    uint16_t _stream_length = 0;
+    bool     _stream_started = false;
 };
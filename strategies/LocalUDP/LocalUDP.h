@@ -20,44 +20,122 @@
 
 #pragma once
 
-#include <Ethernet.h>
-#include <EthernetUdp.h>
 #include <PJONDefines.h>
+#if defined(ARDUINO)
+  #include <Ethernet.h>
+  #include <EthernetUdp.h>
+#else
+  #include "interfaces/LINUX/PJON_LINUX_Ethernet.h"
+#endif
 
 #define DEFAULT_UDP_PORT 7100
 
 #define RESPONSE_TIMEOUT (uint32_t) 10000
 #define UDP_MAGIC_HEADER 0x0DFAC3D0
 
+/* Batched transmission (MAX_BATCH_PACKETS > 1), a datagram contains:
+   UDP_BATCH_MAGIC_HEADER, packets count (1 byte) and for each packet its
+   length (2 bytes) and the packet itself. The receiver responds with:
+   UDP_BATCH_RESPONSE_HEADER, packets count (1 byte) and a bitmap with a bit
+   set for each acknowledged packet. */
+#define UDP_BATCH_MAGIC_HEADER    0x0DFAC3D1
+#define UDP_BATCH_RESPONSE_HEADER 0x0DFAC3D2
+
+#if MAX_BATCH_PACKETS > 1
+  #define UDP_BUFFER_LENGTH (1 + MAX_BATCH_PACKETS * (PACKET_MAX_LENGTH + 2))
+#else
+  #define UDP_BUFFER_LENGTH PACKET_MAX_LENGTH
+#endif
+
 class LocalUDP {
     bool _udp_initialized = false;
     uint16_t _port = DEFAULT_UDP_PORT;
     const uint32_t _magic_header = UDP_MAGIC_HEADER;
-    const uint8_t _broadcast[4] = { 0xFF, 0xFF, 0xFF, 0xFF };
+    uint8_t _broadcast[4] = { 0xFF, 0xFF, 0xFF, 0xFF };
 
     EthernetUDP udp;
+#if !defined(ARDUINO)
+    PJON_Epoll _epoll;
+#endif
 
     /* Caching of incoming packet to make it possible to deliver it byte for byte */
 
-    uint8_t incoming_packet_buf[PACKET_MAX_LENGTH];
+    uint8_t incoming_packet_buf[UDP_BUFFER_LENGTH];
     uint16_t incoming_packet_size = 0;
     uint16_t incoming_packet_pos = 0;
+    uint16_t incoming_packet_end = 0; // End of the packet being delivered
+
+#if MAX_BATCH_PACKETS > 1
+    /* State of the batch being delivered */
+
+    bool _batch = false;
+    bool _batch_response = false;
+    uint8_t _batch_count = 0;
+    uint8_t _batch_index = 0;
+    uint8_t _batch_bitmap[(MAX_BATCH_PACKETS + 7) / 8];
+    IPAddress _batch_ip;
+
+    /* Move to the next packet of the batch, false if it is over */
+
+    bool next_batch_packet() {
+      if (!_batch) return false;
+      if (_batch_index < _batch_count && incoming_packet_pos + 2 <= incoming_packet_size) {
+        uint16_t length = incoming_packet_buf[incoming_packet_pos] << 8 |
+                          incoming_packet_buf[incoming_packet_pos + 1];
+        incoming_packet_pos += 2;
+        incoming_packet_end = min(incoming_packet_pos + length, incoming_packet_size);
+        _batch_index++;
+        return true;
+      }
+      send_batch_response();
+      _batch = false;
+      return false;
+    }
+
+    /* Send the acknowledge bitmap if any packet of the batch requested it */
+
+    void send_batch_response() {
+      if (!_batch_response) return;
+      uint32_t header = UDP_BATCH_RESPONSE_HEADER;
+      udp.beginPacket(_batch_ip, _port);
+      udp.write((const char*) &header, 4);
+      udp.write((const char*) &_batch_count, 1);
+      udp.write((const char*) _batch_bitmap, (_batch_count + 7) / 8);
+      udp.endPacket();
+      _batch_response = false;
+    }
+#endif
 
     bool receive_telegram() {
       int packetSize = udp.parsePacket();
-      if (packetSize > 4 && packetSize <= PACKET_MAX_LENGTH) {
+      if (packetSize > 4 && packetSize - 4 <= UDP_BUFFER_LENGTH) {
         uint32_t header = 0;
         udp.read((char *) &header, 4);
-        if (header != _magic_header) return false; // Not a LocalUDP packet
+#if MAX_BATCH_PACKETS > 1
+        if (header == UDP_BATCH_MAGIC_HEADER) {
+          udp.read(incoming_packet_buf, UDP_BUFFER_LENGTH);
+          incoming_packet_size = packetSize - 4;
+          incoming_packet_pos = incoming_packet_end = 1;
+          _batch_count = min(incoming_packet_buf[0], MAX_BATCH_PACKETS);
+          _batch_index = 0;
+          _batch_ip = udp.remoteIP();
+          _batch_response = false;
+          memset(_batch_bitmap, 0, sizeof(_batch_bitmap));
+          _batch = true;
+          return next_batch_packet();
+        }
+#endif
+        if (header != _magic_header || packetSize - 4 > PACKET_MAX_LENGTH)
+          return false; // Not a LocalUDP packet
         udp.read(incoming_packet_buf, PACKET_MAX_LENGTH);
-        incoming_packet_size = packetSize;
+        incoming_packet_size = incoming_packet_end = packetSize - 4;
         incoming_packet_pos = 0;
         return true;
       }
       return false;
     }
 
-    void empty_buffer() { incoming_packet_size = incoming_packet_pos = 0; }
+    void empty_buffer() { incoming_packet_size = incoming_packet_pos = incoming_packet_end = 0; }
 
     void check_udp() { if (!_udp_initialized) { udp.begin(_port); _udp_initialized = true; } }
 
@@ -67,6 +145,37 @@ public:
     void set_port(uint16_t port = DEFAULT_UDP_PORT) { _port = port; };
 
 
+    /* Set the address packets are sent to, by default 255.255.255.255. A
+       directed broadcast (for example 192.168.1.255) or a single device can
+       be used if the limited broadcast is not forwarded on the network: */
+
+    void set_broadcast_address(const uint8_t *address) { memcpy(_broadcast, address, 4); };
+
+#if !defined(ARDUINO)
+
+    /* Send the datagrams in batches with a single system call, they are
+       sent when the batch is full or before receiving (see
+       PJON_LINUX_Ethernet.h), so receive has to be called regularly: */
+
+    void set_send_batching(bool state) { udp.set_deferred(state); };
+
+
+    /* Wait for a packet in the kernel up to duration_us, returns true if
+       data may be available (used by PJON::receive(duration)): */
+
+    bool wait(uint32_t duration_us) {
+      check_udp();
+      udp.flush();
+      if (incoming_packet_pos < incoming_packet_end || udp.buffered()) return true;
+#if MAX_BATCH_PACKETS > 1
+      if (_batch) return true;
+#endif
+      int fd = udp.fd();
+      return _epoll.wait(&fd, 1, duration_us);
+    };
+#endif
+
+
     /*** Below are the functions expected by PJON ***/
 
 
@@ -82,16 +191,39 @@ public:
       check_udp();
 
       // Must receive a new packet, or is there more to serve from the last one?
-      if (incoming_packet_pos >= incoming_packet_size) receive_telegram();
+      if (incoming_packet_pos >= incoming_packet_end)
+#if MAX_BATCH_PACKETS > 1
+        if (!next_batch_packet())
+#endif
+          receive_telegram();
 
       // Deliver the next byte from the last received packet if any
-      if (incoming_packet_pos < incoming_packet_size) {
+      if (incoming_packet_pos < incoming_packet_end) {
         return incoming_packet_buf[incoming_packet_pos++];
       }
       return FAIL;
     };
 
 
+    /* Deliver the whole packet received at once (see PJON_Supports_Frames) */
+
+    uint16_t receive_frame(uint8_t *buffer, uint16_t max) {
+      check_udp();
+
+      if (incoming_packet_pos >= incoming_packet_end)
+#if MAX_BATCH_PACKETS > 1
+        if (!next_batch_packet())
+#endif
+          receive_telegram();
+
+      if (incoming_packet_pos >= incoming_packet_end) return FAIL;
+      uint16_t length = incoming_packet_end - incoming_packet_pos;
+      memcpy(buffer, incoming_packet_buf + incoming_packet_pos, min(length, max));
+      incoming_packet_pos = incoming_packet_end;
+      return length;
+    };
+
+
     /* Receive byte response */
 
     uint16_t receive_response() {
@@ -105,6 +237,10 @@ public:
       do {
         result = receive_byte();
         if (result == ACK || result == NAK) return result;
+#if !defined(ARDUINO)
+        uint32_t elapsed = micros() - start;
+        if (result == FAIL && elapsed < RESPONSE_TIMEOUT) wait(RESPONSE_TIMEOUT - elapsed);
+#endif
      } while ((uint32_t)(micros() - start) < RESPONSE_TIMEOUT);
       return result;
     };
@@ -114,6 +250,15 @@ public:
        We have the IP so we can skip broadcasting and reply directly. */
 
     void send_response(uint8_t response) { // Empty, ACK is always sent
+#if MAX_BATCH_PACKETS > 1
+      if (_batch) { // Packets of a batch are acknowledged together
+        if (response == ACK)
+          _batch_bitmap[(_batch_index - 1) / 8] |= 1 << ((_batch_index - 1) % 8);
+        _batch_response = true;
+        if (_batch_index == _batch_count) send_batch_response();
+        return;
+      }
+#endif
       udp.beginPacket(udp.remoteIP(), _port);
       udp.write((const char*) &_magic_header, 4);
       udp.write((const char*) &response, 1);
@@ -131,4 +276,69 @@ public:
         udp.endPacket();
       }
     };
+
+
+    /* Segmented transmission, segments are written in the same datagram: */
+
+    bool send_string_begin(uint16_t length) {
+      udp.beginPacket(_broadcast, _port);
+      udp.write((const char*) &_magic_header, 4);
+      return true;
+    };
+
+    void send_string_segment(const uint8_t *string, uint16_t length) {
+      udp.write(string, length);
+    };
+
+    void send_string_end() {
+      udp.endPacket();
+    };
+
+#if MAX_BATCH_PACKETS > 1
+
+    /* Send a batch of packets in a single datagram: */
+
+    bool send_batch(const PJON_Segment *packets, uint8_t count) {
+      check_udp();
+      uint32_t header = UDP_BATCH_MAGIC_HEADER;
+      udp.beginPacket(_broadcast, _port);
+      udp.write((const char*) &header, 4);
+      udp.write((const char*) &count, 1);
+      for (uint8_t i = 0; i < count; i++) {
+        uint8_t length[2] = { (uint8_t)(packets[i].length >> 8), (uint8_t)packets[i].length };
+        udp.write(length, 2);
+        udp.write(packets[i].data, packets[i].length);
+      }
+      udp.endPacket();
+      return true;
+    };
+
+
+    /* Receive the acknowledge bitmap of a batch: */
+
+    uint16_t receive_batch_response(uint8_t *bitmap, uint8_t count) {
+      empty_buffer();
+      uint32_t start = micros();
+      do {
+        int size = udp.parsePacket();
+        if (size == 5 + (count + 7) / 8) {
+          uint32_t header = 0;
+          uint8_t response_count = 0;
+          udp.read((char *) &header, 4);
+          udp.read((char *) &response_count, 1);
+          if (header == UDP_BATCH_RESPONSE_HEADER && response_count == count) {
+            udp.read(bitmap, (count + 7) / 8);
+            return ACK;
+          }
+        }
+#if !defined(ARDUINO)
+        else if (!size) {
+          uint32_t elapsed = micros() - start;
+          if (elapsed < RESPONSE_TIMEOUT) wait(RESPONSE_TIMEOUT - elapsed);
+        }
+#endif
+      } while ((uint32_t)(micros() - start) < RESPONSE_TIMEOUT);
+      return FAIL;
+    };
+#endif
 };
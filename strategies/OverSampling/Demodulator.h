@@ -0,0 +1,154 @@
+/* OverSampling fixed point demodulator
+   Reads the Padded jittering format (see OverSampling::send_byte) from an
+   input providing the time in microseconds and the pin state:
+
+     struct Input {
+       uint32_t time();  // micros() on Arduino
+       uint8_t  read();  // digitalRead of the input pin
+     };
+
+   Each bit is sampled SAMPLES times at evenly spaced instants and decided
+   by majority, using only integer additions and comparisons (the floating
+   point average used before costs dozens of cycles per sample on AVR).
+   Bit windows are computed from the synchronization edge, not restarted
+   after each bit, so delays of the loop do not accumulate, and the clock
+   is recovered from the edges between bits: an edge confirmed by the
+   following sample moves the windows by half of its phase error. Single
+   sample glitches are ignored.
+
+   Being independent of the hardware it can be validated on a host, see
+   examples/LINUX/Simulation/OverSampling.
+   ____________________________________________________________________________
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License. */
+
+#pragma once
+
+template<
+  typename Input,
+  uint16_t BIT_WIDTH = OS_BIT_WIDTH,
+  uint16_t BIT_SPACER = OS_BIT_SPACER,
+  uint8_t  SAMPLES = OS_SAMPLES,
+  uint16_t ACCEPTANCE = OS_ACCEPTANCE
+>
+class OSDemodulator {
+  public:
+    Input input;
+
+    /* Check if the channel is free: the pin is LOW at the end of a padding
+       bit duration and is not HIGH in most samples of windows bit widths */
+
+    bool channel_free(uint8_t windows = 10) {
+      uint32_t time = input.time();
+      while((uint32_t)(input.time() - time) < BIT_SPACER);
+      if(input.read()) return false;
+      for(uint8_t w = 0; w < windows; w++) {
+        _bit_start = input.time();
+        if(read_samples()) return false;
+      }
+      return true;
+    };
+
+
+    /* Receive a byte if its synchronization pad is detected: a HIGH at
+       least ACCEPTANCE long (as observed, reception may start during it)
+       and, after its falling edge, a LOW bit. A falling edge not confirmed
+       half a sample interval later is a glitch and is ignored. */
+
+    uint16_t receive_byte() {
+      uint32_t time = input.time(), now = time;
+      do {
+        while(input.read()) {
+          now = input.time();
+          if((uint32_t)(now - time) > BIT_SPACER + BIT_WIDTH / 2) return FAIL;
+        }
+        _bit_start = input.time();
+        while((uint32_t)(input.time() - _bit_start) < INTERVAL / 2);
+      } while(input.read());
+      if((uint32_t)(now - time) < ACCEPTANCE) return FAIL;
+      _last = 0;
+      _pending = false;
+      if(read_bit()) return FAIL;
+      return read_byte();
+    };
+
+
+    /* Read the 8 bits of a byte, the least significant first */
+
+    uint8_t read_byte() {
+      uint8_t byte_value = 0;
+      for(uint8_t i = 0; i < 8; i++)
+        byte_value |= read_bit() << i;
+      return byte_value;
+    };
+
+
+    /* Read the next bit, decided by majority of its samples */
+
+    uint8_t read_bit() {
+      uint8_t high = 0;
+      uint16_t offset = INTERVAL / 2;
+      for(uint8_t s = 0; s < SAMPLES; s++, offset += INTERVAL) {
+        while((int32_t)(input.time() - _bit_start) < (int32_t)offset);
+        uint8_t value = input.read() ? 1 : 0;
+        high += value;
+        track_edge(value, s);
+      }
+      _bit_start += BIT_WIDTH;
+      return high > SAMPLES / 2;
+    };
+
+  private:
+    static const uint16_t INTERVAL = BIT_WIDTH / SAMPLES;
+
+
+    /* Sample a window of a bit width without clock recovery */
+
+    uint8_t read_samples() {
+      uint8_t high = 0;
+      uint16_t offset = INTERVAL / 2;
+      for(uint8_t s = 0; s < SAMPLES; s++, offset += INTERVAL) {
+        while((uint32_t)(input.time() - _bit_start) < offset);
+        high += input.read() ? 1 : 0;
+      }
+      return high > SAMPLES / 2;
+    };
+
+
+    /* An edge between the samples s - 1 and s is expected at the start of
+       the bit (s = 0): if it is in the first half of the bit the windows
+       are early, if in the second half they are late. The edge is used
+       only if the following sample confirms it. */
+
+    void track_edge(uint8_t value, uint8_t s) {
+      if(_pending) {
+        _pending = false;
+        if(value != _last) { // Glitch, back to the previous value
+          _last = value;
+          return;
+        }
+        if(_edge <= SAMPLES / 2) _bit_start += (_edge * INTERVAL) / 2;
+        else _bit_start -= ((SAMPLES - _edge) * INTERVAL) / 2;
+      }
+      if(value != _last) {
+        _pending = true;
+        _edge = s;
+      }
+      _last = value;
+    };
+
+    uint32_t _bit_start = 0;
+    uint8_t  _last = 0;
+    uint8_t  _edge = 0;
+    bool     _pending = false;
+};
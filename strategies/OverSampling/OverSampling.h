@@ -36,8 +36,23 @@
 #endif
 
 #include "Timing.h"
+#include "Demodulator.h"
 #include "../../utils/digitalWriteFast.h"
 
+/* Input of the demodulator, the pin is read with digitalReadFast */
+
+struct OSPinInput {
+  uint8_t pin;
+
+  uint32_t time() {
+    return micros();
+  };
+
+  uint8_t read() {
+    return digitalReadFast(pin);
+  };
+};
+
 class OverSampling {
   public:
 
@@ -46,20 +61,9 @@ class OverSampling {
     there is no active transmission */
 
     boolean can_start() {
-      float value = 0.5;
-      unsigned long time = micros();
       pinModeFast(_input_pin, INPUT);
       pullDownFast(_input_pin);
-      while((uint32_t)(micros() - time) < OS_BIT_SPACER)
-        value = digitalReadFast(_input_pin);
-      if(value > 0.5) return false;
-      value = 0.5;
-      time = micros();
-      for(uint8_t i = 0; i < 10; i++) {
-        while((uint32_t)(micros() - time) < OS_BIT_WIDTH)
-          value = (value * 0.999)  + (digitalReadFast(_input_pin) * 0.001);
-        if(value > 0.5) return false;
-      }
+      if(!_demodulator.channel_free(10)) return false;
       delayMicroseconds(random(0, COLLISION_DELAY));
       if(digitalReadFast(_input_pin)) return false;
       return true;
@@ -69,15 +73,7 @@ class OverSampling {
     /* Read a byte from the pin */
 
     uint8_t read_byte() {
-      uint8_t byte_value = B00000000;
-      for(uint8_t i = 0; i < 8; i++) {
-        unsigned long time = micros();
-        float value = 0.5;
-        while((uint32_t)(micros() - time) < OS_BIT_WIDTH)
-          value = ((value * 0.999) + (digitalReadFast(_input_pin) * 0.001));
-        byte_value += (value > 0.5) << i;
-      }
-      return byte_value;
+      return _demodulator.read_byte();
     };
 
 
@@ -101,24 +97,10 @@ class OverSampling {
       if(_output_pin != NOT_ASSIGNED && _output_pin != _input_pin)
         pullDownFast(_output_pin);
 
-      float value = 0.5;
-      unsigned long time = micros();
-      /* Update pin value until the pin stops to be HIGH or passed more time than
-         BIT_SPACER duration */
-      while(((uint32_t)(micros() - time) < OS_BIT_SPACER) && digitalReadFast(_input_pin))
-        value = (value * 0.999)  + (digitalReadFast(_input_pin) * 0.001);
-      /* Save how much time passed */
-      time = micros();
-      /* If pin value is in average more than 0.5, is a 1, and if is more than
-         ACCEPTANCE (a minimum HIGH duration) and what is coming after is a LOW bit
-         probably a byte is coming so try to receive it. */
-      if(value > 0.5) {
-        value = 0.5;
-        while((uint32_t)(micros() - time) < OS_BIT_WIDTH)
-          value = (value * 0.999)  + (digitalReadFast(_input_pin) * 0.001);
-        if(value < 0.5) return read_byte();
-      }
-      return FAIL;
+      /* Wait the falling edge of the first padding bit, if it was HIGH for
+         more than ACCEPTANCE and what is coming after is a LOW bit probably
+         a byte is coming, so the bits are sampled synchronized to the edge */
+      return _demodulator.receive_byte();
     };
 
 
@@ -187,11 +169,29 @@ class OverSampling {
     };
 
 
+    /* Segmented transmission, the packet is transmitted segment by segment: */
+
+    bool send_string_begin(uint16_t length) {
+      pinModeFast(_output_pin, OUTPUT);
+      return true;
+    };
+
+    void send_string_segment(const uint8_t *string, uint16_t length) {
+      for(uint16_t b = 0; b < length; b++)
+        send_byte(string[b]);
+    };
+
+    void send_string_end() {
+      pullDownFast(_output_pin);
+    };
+
+
     /* Set the communicaton pin: */
 
     void set_pin(uint8_t pin) {
       _input_pin = pin;
       _output_pin = pin;
+      _demodulator.input.pin = pin;
     };
 
 
@@ -200,9 +200,11 @@ class OverSampling {
     void set_pins(uint8_t input_pin = NOT_ASSIGNED, uint8_t output_pin = NOT_ASSIGNED) {
       _input_pin = input_pin;
       _output_pin = output_pin;
+      _demodulator.input.pin = input_pin;
     };
 
   private:
     uint8_t _input_pin;
     uint8_t _output_pin;
+    OSDemodulator<OSPinInput> _demodulator;
 };
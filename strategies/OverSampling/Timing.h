@@ -26,6 +26,19 @@
   #define OS_BIT_SPACER 328
 #endif
 
+/* Samples read for each bit (see Demodulator.h), the bit width divided by
+   the samples must be longer than a pin read plus a micros call */
+
+#ifndef OS_SAMPLES
+  #define OS_SAMPLES 8
+#endif
+
+/* Minimum duration of the first padding bit to start the reception */
+
+#ifndef OS_ACCEPTANCE
+  #define OS_ACCEPTANCE (OS_BIT_SPACER / 4)
+#endif
+
 /* The default response timeout setup dedicates the transmission time of 1 byte plus
   1 millisecond to latency and CRC computation. If receiver needs more than
   OS_TIMEOUT to compute CRC and answer back ACK, transmitter will not receive
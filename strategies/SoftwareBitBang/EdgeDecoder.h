@@ -0,0 +1,233 @@
+/* SoftwareBitBang edge timestamp decoder
+   Decodes the Padded jittering format (see SoftwareBitBang::send_byte) from
+   the timestamps of the edges of the signal instead of reading the pin at
+   fixed delays, so the result does not depend on the execution time of the
+   receiver and on the tuning of SWBB_READ_DELAY. Edges are queued calling
+   edge, short enough to be called by an interrupt service routine:
+
+     SWBBEdgeDecoder<> decoder;
+
+     void pin_changed() {
+       decoder.edge(micros(), digitalRead(12));
+     };
+
+     attachInterrupt(digitalPinToInterrupt(12), pin_changed, CHANGE);
+     bus.strategy.set_edge_decoder(&decoder);
+
+   or by a simulated waveform, and are decoded by receive_byte. The bit
+   width of the transmitter is estimated from the duration of the first
+   padding bit (its clock skew scales the padding bit as the bits) and
+   refined at each edge of the byte, weighting each edge by the bits it is
+   distant from the synchronization edge, so bits are counted with the
+   clock of the transmitter. Edges closer than half a bit are a glitch if followed
+   by the opposite edge in the same bit.
+
+   See examples/LINUX/Simulation/SoftwareBitBang for its validation.
+   ____________________________________________________________________________
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License. */
+
+#pragma once
+
+/* Edges queued before being decoded, a byte has at most 10 */
+
+#ifndef SWBB_EDGES
+  #define SWBB_EDGES 32
+#endif
+
+template<
+  uint16_t BIT_WIDTH = SWBB_BIT_WIDTH,
+  uint16_t BIT_SPACER = SWBB_BIT_SPACER,
+  uint16_t ACCEPTANCE = SWBB_ACCEPTANCE,
+  uint8_t  EDGES = SWBB_EDGES
+>
+class SWBBEdgeDecoder {
+  public:
+
+    /* Queue an edge, level is the state of the pin after it */
+
+    void edge(uint32_t time, uint8_t level) {
+      uint8_t next = (_head + 1) % EDGES;
+      if(next == _tail) {
+        _overflow = true;
+        return;
+      }
+      _times[_head] = time;
+      _levels[_head] = level;
+      _head = next;
+    };
+
+
+    /* Decode the edges queued until now (the time the edges are queued
+       with): returns a byte if its last bit is received, FAIL if not */
+
+    uint16_t receive_byte(uint32_t now) {
+      if(_overflow) reset();
+      while(_tail != _head) {
+        uint32_t time = _times[_tail];
+        uint8_t level = _levels[_tail];
+        _tail = (_tail + 1) % EDGES;
+        if(decode_edge(time, level)) return _received;
+      }
+      if(
+        _state == BITS &&
+        (int32_t)(now - (_sync + ((19 * _period) >> 5))) >= 0
+      ) {
+        if(!fill(9)) _state = IDLE;
+        else {
+          complete(_sync + ((9 * _period) >> 4), false);
+          return _received;
+        }
+      }
+      return FAIL;
+    };
+
+
+    /* True if no byte is being received and no edge is queued */
+
+    bool idle() const {
+      return _state == IDLE && _tail == _head;
+    };
+
+
+    /* Bit width of the transmitter estimated in the last byte */
+
+    uint16_t bit_width() const {
+      return (_period + 8) >> 4;
+    };
+
+
+    /* Drop the queued edges and the byte being received */
+
+    void reset() {
+      _tail = _head;
+      _overflow = false;
+      _state = IDLE;
+    };
+
+  private:
+    enum State { IDLE, SPACER, BITS };
+
+
+    /* Decode an edge, returns true if it completes a byte */
+
+    bool decode_edge(uint32_t time, uint8_t level) {
+      if(_state == IDLE) {
+        if(level) start_spacer(time);
+        return false;
+      }
+      if(_state == SPACER) {
+        if(level) start_spacer(time); // Falling edge lost
+        else start_bits(time);
+        return false;
+      }
+      uint32_t elapsed = (time - _sync) << 4;
+      uint16_t k = (elapsed + (_period / 2)) / _period;
+      if(k <= _index) { // Glitch, shorter than half bit
+        _level = level;
+        return false;
+      }
+      if(k <= 9) { // Follow the clock of the transmitter
+        _period = ((_period * _weight) + elapsed) / (_weight + k);
+        _weight += k;
+      } else k = 9;
+      if(!fill(k)) {
+        _state = IDLE;
+        if(level) start_spacer(time);
+        return false;
+      }
+      _level = level;
+      if(k < 9) return false;
+      /* An edge after the last bit: a rising edge starts the next padding
+         bit, a falling edge ends it if the last bit was HIGH */
+      complete(time);
+      if(!level) { // The padding bit started with the last bit
+        start_spacer(_sync + ((9 * _period) >> 4), false);
+        start_bits(time);
+      }
+      return true;
+    };
+
+
+    /* Assign the current level to the bits until k (the padding bit is 0),
+       returns false if the padding bit is HIGH */
+
+    bool fill(uint8_t k) {
+      for(; _index < k; _index++)
+        if(!_index) {
+          if(_level) return false;
+        } else _value |= _level << (_index - 1);
+      return true;
+    };
+
+
+    /* The byte is complete at time, if the pin is HIGH the next padding
+       bit is started (measured if time is the time of its rising edge) */
+
+    void complete(uint32_t time, bool measured = true) {
+      _received = _value;
+      _state = IDLE;
+      if(_level) start_spacer(time, measured);
+    };
+
+    void start_spacer(uint32_t time, bool measured = true) {
+      _state = SPACER;
+      _rise = time;
+      _measured = measured;
+    };
+
+
+    /* Falling edge at the end of the first padding bit: if longer than
+       ACCEPTANCE and not too long estimate the bit width from it, in
+       sixteenths of microsecond not to accumulate rounding errors. If the
+       padding bit started with the last bit of the previous byte its
+       duration is not measured and the previous estimate is kept. */
+
+    void start_bits(uint32_t time) {
+      uint32_t spacer = time - _rise;
+      if(
+        (int32_t)spacer < (int32_t)ACCEPTANCE ||
+        spacer > (uint32_t)BIT_SPACER * 2
+      ) {
+        _state = IDLE;
+        return;
+      }
+      if(_measured) {
+        _period = ((spacer << 4) * BIT_WIDTH) / BIT_SPACER;
+        _weight = BIT_SPACER / BIT_WIDTH;
+      } else if(_weight > 9) _weight = 9;
+      if(!_period) _period = 1;
+      if(!_weight) _weight = 1;
+      _sync = time;
+      _index = 0;
+      _level = 0;
+      _value = 0;
+      _state = BITS;
+    };
+
+    volatile uint32_t _times[EDGES];
+    volatile uint8_t  _levels[EDGES];
+    volatile uint8_t  _head = 0;
+    volatile bool     _overflow = false;
+    uint8_t  _tail = 0;
+    State    _state = IDLE;
+    uint32_t _rise = 0;
+    uint32_t _sync = 0;
+    uint32_t _period = (uint32_t)BIT_WIDTH << 4;
+    uint8_t  _index = 0;
+    uint8_t  _level = 0;
+    uint8_t  _value = 0;
+    uint8_t  _received = 0;
+    uint16_t _weight = 1;
+    bool     _measured = false;
+};
@@ -42,6 +42,7 @@ STANDARD transmission mode performance:
 #endif
 
 #include "Timing.h"
+#include "EdgeDecoder.h"
 #include "../../utils/digitalWriteFast.h"
 
 class SoftwareBitBang {
@@ -111,6 +112,8 @@ class SoftwareBitBang {
       if(_output_pin != _input_pin && _output_pin != NOT_ASSIGNED)
         pullDownFast(_output_pin);
 
+      if(_edge_decoder) return receive_decoded_byte();
+
       uint32_t time = micros();
       /* Do nothing until the pin goes LOW or passed more time than SWBB_BIT_SPACER duration */
       while(digitalReadFast(_input_pin) && (uint32_t)(micros() - time) <= SWBB_BIT_SPACER);
@@ -125,6 +128,21 @@ class SoftwareBitBang {
     };
 
 
+    /* Receive a byte from the edges captured by the edge decoder: wait
+       until a padding bit starts or until the byte being received ends */
+
+    uint16_t receive_decoded_byte() {
+      uint32_t time = micros();
+      uint16_t result;
+      while((result = _edge_decoder->receive_byte(micros())) == FAIL)
+        if((uint32_t)(micros() - time) > (
+          _edge_decoder->idle() ?
+            SWBB_BIT_SPACER : (SWBB_BIT_SPACER * 2) + (SWBB_BIT_WIDTH * 12)
+        )) break;
+      return result;
+    };
+
+
     /* Receive byte response */
 
     uint16_t receive_response() {
@@ -194,6 +212,7 @@ class SoftwareBitBang {
       pinModeFast(_output_pin, OUTPUT);
       send_byte(response);
       pullDownFast(_output_pin);
+      if(_edge_decoder) _edge_decoder->reset(); // Drop the edges sent
     };
 
 
@@ -204,6 +223,25 @@ class SoftwareBitBang {
       for(uint16_t b = 0; b < length; b++)
         send_byte(string[b]);
       pullDownFast(_output_pin);
+      if(_edge_decoder) _edge_decoder->reset();
+    };
+
+
+    /* Segmented transmission, the packet is transmitted segment by segment: */
+
+    bool send_string_begin(uint16_t length) {
+      pinModeFast(_output_pin, OUTPUT);
+      return true;
+    };
+
+    void send_string_segment(const uint8_t *string, uint16_t length) {
+      for(uint16_t b = 0; b < length; b++)
+        send_byte(string[b]);
+    };
+
+    void send_string_end() {
+      pullDownFast(_output_pin);
+      if(_edge_decoder) _edge_decoder->reset();
     };
 
 
@@ -237,7 +275,16 @@ class SoftwareBitBang {
       _output_pin = output_pin;
     };
 
+
+    /* Set the edge decoder fed by an interrupt on the input pin, if set
+       bytes are decoded from the edges captured (see EdgeDecoder.h): */
+
+    void set_edge_decoder(SWBBEdgeDecoder<> *decoder) {
+      _edge_decoder = decoder;
+    };
+
   private:
     uint8_t _input_pin;
     uint8_t _output_pin;
+    SWBBEdgeDecoder<> *_edge_decoder = NULL;
 };
@@ -23,7 +23,11 @@
    See the License for the specific language governing permissions and
    limitations under the License. */
 
-#include <Arduino.h>
+#if defined(ARDUINO)
+  #include <Arduino.h>
+#else
+  #include "interfaces/LINUX/PJON_LINUX_Serial.h"
+#endif
 
 #define THROUGH_SERIAL_MAX_BYTE_TIME        10000  // Wait up to 10 milliseconds for an incoming byte
 #define THROUGH_SERIAL_FREE_TIME_BEFORE_START 500  // 0.5 milliseconds of free channell before sending
@@ -47,15 +51,29 @@ class ThroughSerial {
     /* Try to receive a byte with a maximum waiting time */
 
     uint16_t receive_byte() {
-      uint32_t time = micros();
-      while((uint32_t)(micros() - time) < THROUGH_SERIAL_MAX_BYTE_TIME)
+      uint32_t time = micros(), elapsed;
+      while((elapsed = micros() - time) < THROUGH_SERIAL_MAX_BYTE_TIME) {
         if(serial->available()) {
           _last_reception_time = micros();
           return (uint8_t)serial->read();
         }
+      #if !defined(ARDUINO)
+        serial->wait(THROUGH_SERIAL_MAX_BYTE_TIME - elapsed);
+      #endif
+      }
       return FAIL;
     };
 
+#if !defined(ARDUINO)
+
+    /* Wait for data in the kernel up to duration_us, returns true if data
+       is available (used by PJON::receive(duration)): */
+
+    bool wait(uint32_t duration_us) {
+      return serial->wait(duration_us);
+    };
+#endif
+
 
     /* Receive byte response */
 
@@ -74,29 +92,39 @@ class ThroughSerial {
     /* Send byte response to the packet's transmitter */
 
     void send_response(uint8_t response) {
-      if(_enable_RS485_pin != NOT_ASSIGNED)
-        digitalWriteFast(_enable_RS485_pin, HIGH);
-
+      set_transmission(true);
       send_byte(response);
       serial->flush();
+      set_transmission(false);
+    };
+
+
+    /* Send a string, written at once and flushed (the transmission is
+       complete when flush returns, so the RS485 transceiver can be set back
+       in reception): */
 
-      if(_enable_RS485_pin != NOT_ASSIGNED)
-        digitalWriteFast(_enable_RS485_pin, LOW);
+    void send_string(uint8_t *string, uint16_t length) {
+      set_transmission(true);
+      serial->write(string, length);
+      serial->flush();
+      set_transmission(false);
     };
 
 
-    /* Send a string: */
+    /* Segmented transmission, the packet is transmitted segment by segment: */
 
-    void send_string(uint8_t *string, uint8_t length) {
-      if(_enable_RS485_pin != NOT_ASSIGNED)
-        digitalWriteFast(_enable_RS485_pin, HIGH);
+    bool send_string_begin(uint16_t length) {
+      set_transmission(true);
+      return true;
+    };
 
-      for(uint8_t b = 0; b < length; b++)
-        send_byte(string[b]);
-      serial->flush();
+    void send_string_segment(const uint8_t *string, uint16_t length) {
+      serial->write(string, length);
+    };
 
-      if(_enable_RS485_pin != NOT_ASSIGNED)
-        digitalWriteFast(_enable_RS485_pin, LOW);
+    void send_string_end() {
+      serial->flush();
+      set_transmission(false);
     };
 
 
@@ -107,14 +135,28 @@ class ThroughSerial {
     };
 
 
-    /* Pass the enable transmission pin for RS485 if in use */
+    /* Pass the enable transmission pin for RS485 if in use, on a host the
+       RTS line of the serial port is used (the pin number is ignored) */
 
     void set_enable_RS485_pin(uint8_t pin) {
       _enable_RS485_pin = pin;
+    #if defined(ARDUINO)
       pinModeFast(_enable_RS485_pin, OUTPUT);
+    #else
+      if(serial) serial->set_transmit(false);
+    #endif
     };
 
   private:
+    void set_transmission(bool state) {
+      if(_enable_RS485_pin == NOT_ASSIGNED) return;
+    #if defined(ARDUINO)
+      digitalWriteFast(_enable_RS485_pin, state ? HIGH : LOW);
+    #else
+      serial->set_transmit(state);
+    #endif
+    };
+
     uint32_t _last_reception_time;
     uint8_t  _enable_RS485_pin = NOT_ASSIGNED;
 };
@@ -0,0 +1,301 @@
+
+/* VirtualBus is a Strategy for the PJON framework
+   It simulates in memory a shared medium with configurable bit rate,
+   latency and collision rate, so more PJON instances can communicate within
+   the same process without hardware, to test and measure the protocol on a
+   host (see interfaces/LINUX). Used with PJON_VIRTUAL_CLOCK time advances
+   only by the simulated transmissions and delays, so results are repeatable.
+
+   The simulation is single threaded: while a device waits for a synchronous
+   response or for data to receive the medium calls the poll function of the
+   other devices (usually calling their receive()), so they can receive the
+   packet and respond.
+   ____________________________________________________________________________
+
+   Licensed under the Apache License, Version 2.0 (the "License");
+   you may not use this file except in compliance with the License.
+   You may obtain a copy of the License at
+
+       http://www.apache.org/licenses/LICENSE-2.0
+
+   Unless required by applicable law or agreed to in writing, software
+   distributed under the License is distributed on an "AS IS" BASIS,
+   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+   See the License for the specific language governing permissions and
+   limitations under the License. */
+
+#pragma once
+
+#include <PJONDefines.h>
+
+/* Maximum number of devices attached to a medium */
+#ifndef VB_MAX_DEVICES
+  #define VB_MAX_DEVICES 16
+#endif
+
+/* Reception buffer length of each device, bytes received while it is full
+   are lost */
+#ifndef VB_BUFFER_LENGTH
+  #define VB_BUFFER_LENGTH 1024
+#endif
+
+/* Maximum time waited for a synchronous response */
+#ifndef VB_RESPONSE_TIMEOUT
+  #define VB_RESPONSE_TIMEOUT (uint32_t) 10000
+#endif
+
+class VirtualBus;
+
+/* The shared medium: devices attached receive the frames sent by the others */
+
+class VirtualBusMedium {
+  public:
+    uint32_t bit_rate = 1000000; // Bits per second
+    uint32_t latency = 0;        // Propagation delay in microseconds
+    uint16_t collision_rate = 0; // Frames corrupted by a collision every 10000
+    uint32_t bit_error_rate = 0; // Bits flipped by noise every 1000000
+    uint32_t sensing = 0;        // Microseconds listened by can_start
+
+    /* Traffic statistics */
+    uint32_t frames = 0;
+    uint32_t bytes = 0;
+    uint32_t collisions = 0;
+    uint32_t flipped = 0;        // Bits flipped by noise
+
+    VirtualBusMedium(uint32_t rate = 1000000, uint32_t delay = 0, uint16_t collisions = 0) :
+      bit_rate(rate), latency(delay), collision_rate(collisions) { };
+
+
+    /* Medium used by the devices if not set */
+
+    static VirtualBusMedium &shared() {
+      static VirtualBusMedium medium;
+      return medium;
+    };
+
+
+    /* Seed of the collisions generator (the same seed gives the same collisions) */
+
+    void set_seed(uint32_t seed) {
+      if(seed) _seed = seed;
+    };
+
+
+    /* Duration in microseconds of the transmission of length bytes: */
+
+    uint32_t duration(uint16_t length) const {
+      return ((uint64_t)length * 8 * 1000000 + bit_rate - 1) / bit_rate;
+    };
+
+
+    void attach(VirtualBus *device) {
+      for(uint8_t i = 0; i < _devices_count; i++)
+        if(_devices[i] == device) return;
+      if(_devices_count < VB_MAX_DEVICES) _devices[_devices_count++] = device;
+    };
+
+
+    void detach(VirtualBus *device) {
+      for(uint8_t i = 0; i < _devices_count; i++)
+        if(_devices[i] == device) {
+          _devices[i] = _devices[--_devices_count];
+          return;
+        }
+    };
+
+
+    /* Transmit a frame to all the other devices, the sender is blocked for
+       the duration of the transmission: */
+
+    inline void transmit(VirtualBus *sender, const uint8_t *data, uint16_t length);
+
+
+    /* Let the other devices process the data they received: */
+
+    inline void poll(VirtualBus *waiting);
+
+  private:
+    VirtualBus *_devices[VB_MAX_DEVICES];
+    uint8_t     _devices_count = 0;
+    uint32_t    _seed = 2463534242ul;
+
+    uint32_t next_random() {
+      _seed ^= _seed << 13;
+      _seed ^= _seed >> 17;
+      _seed ^= _seed << 5;
+      return _seed;
+    };
+};
+
+
+class VirtualBus {
+  public:
+    VirtualBus() {
+      set_medium(VirtualBusMedium::shared());
+    };
+
+    ~VirtualBus() {
+      if(_medium) _medium->detach(this);
+    };
+
+
+    /* Set the medium the device is attached to: */
+
+    void set_medium(VirtualBusMedium &medium) {
+      if(_medium) _medium->detach(this);
+      _medium = &medium;
+      _medium->attach(this);
+    };
+
+
+    /* Set the function called to let the device process the data received
+       while another device is waiting for a response, for example:
+       void poll(void *) { bus.receive(); }; */
+
+    void set_poll(void (*poll)(void *), void *object = NULL) {
+      _poll = poll;
+      _poll_object = object;
+    };
+
+
+    /* Check if the channel is free for transmission, so if the device is
+       not receiving a frame (frames still propagating are not sensed). If
+       the medium has a sensing time it is listened for that time plus a
+       random delay up to COLLISION_DELAY, as SoftwareBitBang does */
+
+    boolean can_start() {
+      if(receiving()) return false;
+      if(!_medium->sensing) return true;
+      delayMicroseconds(_medium->sensing + random(0, COLLISION_DELAY));
+      return !receiving();
+    };
+
+
+    /* Receive a byte, waiting for it up to a byte duration */
+
+    uint16_t receive_byte() {
+      if(!available()) {
+        _waiting = true;
+        _medium->poll(this);
+        _waiting = false;
+      }
+      uint32_t byte_duration = _medium->duration(1);
+      if(!available() || (int32_t)(_arrival[_head] - micros()) > (int32_t)byte_duration) {
+        delayMicroseconds(byte_duration);
+        return FAIL;
+      }
+      return read();
+    };
+
+
+    /* Receive byte response */
+
+    uint16_t receive_response() {
+      uint32_t time = micros();
+      _waiting = true;
+      do {
+        if(!available()) _medium->poll(this);
+        if(available()) {
+          _waiting = false;
+          return read();
+        }
+        delayMicroseconds(_medium->duration(1));
+      } while((uint32_t)(micros() - time) < VB_RESPONSE_TIMEOUT);
+      _waiting = false;
+      return FAIL;
+    };
+
+
+    /* Send byte response to the packet's transmitter */
+
+    void send_response(uint8_t response) {
+      _medium->transmit(this, &response, 1);
+    };
+
+
+    /* Send a string: */
+
+    void send_string(uint8_t *string, uint16_t length) {
+      _medium->transmit(this, string, length);
+    };
+
+
+    /* Data reception used by the medium: */
+
+    void deliver(uint8_t value, uint32_t arrival) {
+      if(_length == VB_BUFFER_LENGTH) return;
+      uint16_t tail = (_head + _length++) % VB_BUFFER_LENGTH;
+      _buffer[tail] = value;
+      _arrival[tail] = arrival;
+    };
+
+
+    /* Let the device process the data received, if any: */
+
+    void poll() {
+      if(!_poll || _waiting || _polling || !available()) return;
+      _polling = true;
+      _poll(_poll_object);
+      _polling = false;
+    };
+
+  private:
+    VirtualBusMedium *_medium = NULL;
+    void    (*_poll)(void *) = NULL;
+    void     *_poll_object = NULL;
+    bool      _polling = false;
+    bool      _waiting = false;
+    uint8_t   _buffer[VB_BUFFER_LENGTH];
+    uint32_t  _arrival[VB_BUFFER_LENGTH];
+    uint16_t  _head = 0;
+    uint16_t  _length = 0;
+
+    bool available() const {
+      return _length;
+    };
+
+    /* Check if a byte has already been received */
+    bool receiving() const {
+      return available() && (int32_t)(_arrival[_head] - micros()) <= 0;
+    };
+
+    /* Read the next byte, waiting until it has been received */
+    uint8_t read() {
+      int32_t wait = _arrival[_head] - micros();
+      if(wait > 0) delayMicroseconds(wait);
+      uint8_t value = _buffer[_head];
+      _head = (_head + 1) % VB_BUFFER_LENGTH;
+      _length--;
+      return value;
+    };
+};
+
+
+void VirtualBusMedium::transmit(VirtualBus *sender, const uint8_t *data, uint16_t length) {
+  uint32_t start = micros() + latency;
+  uint32_t corrupted = length;
+  if(collision_rate && next_random() % 10000 < collision_rate) {
+    corrupted = next_random() % length;
+    collisions++;
+  }
+  for(uint16_t i = 0; i < length; i++) {
+    uint8_t value = (i == corrupted) ? ~data[i] : data[i];
+    if(bit_error_rate)
+      for(uint8_t b = 0; b < 8; b++)
+        if(next_random() % 1000000 < bit_error_rate) {
+          value ^= 1 << b;
+          flipped++;
+        }
+    for(uint8_t d = 0; d < _devices_count; d++)
+      if(_devices[d] != sender) _devices[d]->deliver(value, start + duration(i + 1));
+  }
+  frames++;
+  bytes += length;
+  delayMicroseconds(duration(length));
+};
+
+
+void VirtualBusMedium::poll(VirtualBus *waiting) {
+  for(uint8_t d = 0; d < _devices_count; d++)
+    if(_devices[d] != waiting) _devices[d]->poll();
+};
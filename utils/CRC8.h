@@ -10,8 +10,7 @@
     return crc;
   };
 
-  uint8_t compute_crc_8(const uint8_t *input_byte, uint16_t length) {
-    uint8_t crc = 0;
+  uint8_t compute_crc_8(const uint8_t *input_byte, uint16_t length, uint8_t crc = 0) {
     for(uint16_t b = 0; b < length; b++)
       crc = roll_crc_8(input_byte[b], crc);
     return crc;
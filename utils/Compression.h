@@ -0,0 +1,131 @@
+ /* LZ77 compression of the content of the packets (DATA_COMP_BIT), small
+    enough for 8 bits microcontrollers: no tables or heap are used, the
+    compressor searches the matches directly in the COMPRESSION_WINDOW bytes
+    preceding each position and the decompressor only copies bytes.
+
+    The compressed data is a sequence of groups of up to 8 items preceded by
+    a byte of flags (bit n set: item n is a match). A literal is a byte, a
+    match 2 bytes: 12 bits of distance - 1 and 4 bits of length - 3 (from 3
+    to 18 bytes), copied from the bytes already decompressed. Both sides can
+    share a static dictionary, for example the keys and the syntax of the
+    messages exchanged: it is as if it preceded the data, so matches can be
+    found in it also in the first bytes of a short packet.
+
+    Define COMPRESSION_WINDOW before including PJON.h to change the bytes
+    searched (256 by default, at most 4096): more find longer matches in
+    larger dictionaries, the compression time grows with the window. */
+
+#ifndef PJON_Compression_h
+  #define PJON_Compression_h
+
+  #ifndef COMPRESSION_WINDOW
+    #define COMPRESSION_WINDOW 256
+  #endif
+
+  #if COMPRESSION_WINDOW > 4096
+    #error "COMPRESSION_WINDOW must be at most 4096 bytes"
+  #endif
+
+  #define LZ_MIN_MATCH 3
+  #define LZ_MAX_MATCH 18
+
+
+  /* Byte at position of the dictionary followed by the data: */
+
+  inline uint8_t lz_byte(
+    uint32_t position,
+    const uint8_t *data,
+    const uint8_t *dictionary,
+    uint16_t dictionary_length
+  ) {
+    return (position < dictionary_length) ?
+      dictionary[position] : data[position - dictionary_length];
+  };
+
+
+  /* Compress length bytes of source in destination, returns the compressed
+     length or 0 if it is longer than max_length: */
+
+  uint16_t lz_compress(
+    const uint8_t *source,
+    uint16_t length,
+    uint8_t *destination,
+    uint16_t max_length,
+    const uint8_t *dictionary = NULL,
+    uint16_t dictionary_length = 0
+  ) {
+    uint16_t out = 0, flags = 0;
+    uint8_t bit = 8;
+    for(uint16_t i = 0; i < length;) {
+      if(bit == 8) {
+        if(out >= max_length) return 0;
+        flags = out++;
+        destination[flags] = 0;
+        bit = 0;
+      }
+      uint16_t best = 0, distance = 0;
+      uint16_t limit = (length - i < LZ_MAX_MATCH) ? length - i : LZ_MAX_MATCH;
+      uint32_t position = (uint32_t)dictionary_length + i;
+      if(limit >= LZ_MIN_MATCH) {
+        uint32_t c = (position > COMPRESSION_WINDOW) ? position - COMPRESSION_WINDOW : 0;
+        for(; c < position; c++) { // The nearest of the longest matches
+          if(lz_byte(c, source, dictionary, dictionary_length) != source[i]) continue;
+          uint16_t l = 1;
+          while(l < limit && lz_byte(c + l, source, dictionary, dictionary_length) == source[i + l])
+            l++;
+          if(l >= best) {
+            best = l;
+            distance = position - c;
+          }
+        }
+      }
+      if(best >= LZ_MIN_MATCH) {
+        if(out + 2 > max_length) return 0;
+        destination[flags] |= 1 << bit;
+        destination[out++] = (distance - 1) >> 4;
+        destination[out++] = ((distance - 1) << 4) | (best - LZ_MIN_MATCH);
+        i += best;
+      } else {
+        if(out >= max_length) return 0;
+        destination[out++] = source[i++];
+      }
+      bit++;
+    }
+    return out;
+  };
+
+
+  /* Decompress length bytes of source in destination, returns the
+     decompressed length or 0 if source is not valid or the result is
+     longer than max_length: */
+
+  uint16_t lz_decompress(
+    const uint8_t *source,
+    uint16_t length,
+    uint8_t *destination,
+    uint16_t max_length,
+    const uint8_t *dictionary = NULL,
+    uint16_t dictionary_length = 0
+  ) {
+    uint16_t in = 0, out = 0;
+    while(in < length) {
+      uint8_t flags = source[in++];
+      for(uint8_t bit = 0; bit < 8 && in < length; bit++) {
+        if(!(flags & (1 << bit))) {
+          if(out >= max_length) return 0;
+          destination[out++] = source[in++];
+          continue;
+        }
+        if(in + 2 > length) return 0;
+        uint16_t distance = ((source[in] << 4) | (source[in + 1] >> 4)) + 1;
+        uint8_t count = (source[in + 1] & 0x0F) + LZ_MIN_MATCH;
+        in += 2;
+        if(distance > (uint32_t)out + dictionary_length || out + count > max_length) return 0;
+        for(; count; count--, out++)
+          destination[out] = (distance > out) ?
+            dictionary[dictionary_length - (distance - out)] : destination[out - distance];
+      }
+    }
+    return out;
+  };
+#endif
@@ -0,0 +1,129 @@
+ /* Forward error correction of the packets (PARITY_BIT): a shortened
+    Reed-Solomon code over GF(256) with 2 parity bytes for each codeword, so
+    a wrong byte (any number of its bits flipped) is corrected in each
+    codeword. The bytes of a packet are interleaved in the codewords (byte i
+    belongs to codeword i % codewords), so a burst of wrong bytes as long as
+    the number of codewords is corrected as well.
+
+    A packet of length bytes is divided in codewords of at most
+    FEC_BLOCK_LENGTH bytes, the 2 parity bytes of each follow the packet.
+    With a single error per codeword the syndromes S0 = e and S1 = e * a^j
+    give the value and the position j of the error, so no tables are needed:
+    the position is found multiplying S0 by a (the generator, 2) until S1 is
+    reached. If there are more errors in a codeword they may be corrected in
+    the wrong way, the CRC of the packet detects it.
+
+    Define FEC_BLOCK_LENGTH before including PJON.h to change the redundancy
+    (16 by default, from 1 to 253 bytes): longer codewords add fewer parity
+    bytes but correct fewer errors. It must be the same on all devices. */
+
+#ifndef PJON_ErrorCorrection_h
+  #define PJON_ErrorCorrection_h
+
+  #ifndef FEC_BLOCK_LENGTH
+    #define FEC_BLOCK_LENGTH 16
+  #endif
+
+  #if FEC_BLOCK_LENGTH < 1 || FEC_BLOCK_LENGTH > 253
+    #error "FEC_BLOCK_LENGTH must be from 1 to 253 bytes"
+  #endif
+
+
+  /* Multiplication by a in GF(256), polynomial x^8 + x^4 + x^3 + x^2 + 1: */
+
+  inline uint8_t fec_multiply_a(uint8_t value) {
+    return (value << 1) ^ ((value & 0x80) ? 0x1D : 0);
+  };
+
+
+  /* Multiplication in GF(256): */
+
+  uint8_t fec_multiply(uint8_t a, uint8_t b) {
+    uint8_t result = 0;
+    for(; b; b >>= 1, a = fec_multiply_a(a))
+      if(b & 1) result ^= a;
+    return result;
+  };
+
+
+  /* Number of codewords a packet of length bytes is divided in: */
+
+  inline uint16_t fec_codewords(uint16_t length) {
+    return (length + FEC_BLOCK_LENGTH - 1) / FEC_BLOCK_LENGTH;
+  };
+
+
+  /* Number of parity bytes following a packet of length bytes: */
+
+  inline uint16_t fec_parity_length(uint16_t length) {
+    return fec_codewords(length) * 2;
+  };
+
+
+  /* Compute S0 (sum of the bytes) and the sum of the bytes multiplied by
+     a^position of codeword c, the parity bytes have positions 0 and 1 and
+     the bytes of the packet follow. With parity set to 0 they are the two
+     sums the parity bytes are computed from: */
+
+  void fec_syndromes(
+    const uint8_t *data,
+    uint16_t length,
+    const uint8_t *parity,
+    uint16_t c,
+    uint8_t &s0,
+    uint8_t &s1
+  ) {
+    uint16_t codewords = fec_codewords(length);
+    uint16_t last = c + ((length - 1 - c) / codewords) * codewords;
+    s0 = 0;
+    s1 = 0;
+    for(uint16_t i = last + codewords; i > c; ) { // Horner, last byte first
+      i -= codewords;
+      s0 ^= data[i];
+      s1 = fec_multiply_a(s1) ^ data[i];
+    }
+    s0 ^= parity[c * 2] ^ parity[c * 2 + 1];
+    s1 = fec_multiply_a(fec_multiply_a(s1) ^ parity[c * 2 + 1]) ^ parity[c * 2];
+  };
+
+
+  /* Write the fec_parity_length(length) parity bytes of data in parity: */
+
+  void fec_encode(const uint8_t *data, uint16_t length, uint8_t *parity) {
+    uint16_t codewords = fec_codewords(length);
+    for(uint16_t c = 0; c < codewords; c++) {
+      uint8_t s0, s1;
+      parity[c * 2] = 0;
+      parity[c * 2 + 1] = 0;
+      fec_syndromes(data, length, parity, c, s0, s1);
+      /* p0 + p1 = s0 and p0 + p1 * a = s1 zero the syndromes, so
+         p1 = (s0 + s1) / (1 + a), 0xF4 is the inverse of 1 + a */
+      parity[c * 2 + 1] = fec_multiply(s0 ^ s1, 0xF4);
+      parity[c * 2] = s0 ^ parity[c * 2 + 1];
+    }
+  };
+
+
+  /* Correct data and its parity bytes, returns the number of bytes
+     corrected or -1 if a codeword has errors that can not be corrected: */
+
+  int16_t fec_decode(uint8_t *data, uint16_t length, uint8_t *parity) {
+    uint16_t codewords = fec_codewords(length);
+    int16_t corrected = 0;
+    for(uint16_t c = 0; c < codewords; c++) {
+      uint8_t s0, s1;
+      fec_syndromes(data, length, parity, c, s0, s1);
+      if(!s0 && !s1) continue;
+      if(!s0 || !s1) return -1;
+      uint16_t size = (length - 1 - c) / codewords + 3; // Positions in the codeword
+      uint16_t position = 0;
+      for(uint8_t x = s0; position < size && x != s1; position++)
+        x = fec_multiply_a(x);
+      if(position == size) return -1;
+      if(position < 2) parity[c * 2 + position] ^= s0;
+      else data[c + (position - 2) * codewords] ^= s0;
+      corrected++;
+    }
+    return corrected;
+  };
+#endif
@@ -0,0 +1,168 @@
+
+ /* Packet pool: the contents of the packets in the send list are allocated
+    from a fixed budget of bytes (see PACKET_POOL_LENGTH in PJONDefines.h),
+    so many short packets and a few long ones share the same memory instead
+    of reserving PACKET_MAX_LENGTH bytes for each.
+
+    Buddy allocator: the pool is divided in blocks of BLOCK << order bytes
+    (the size classes), a packet gets the smallest block fitting it. Larger
+    blocks are split in halves (buddies) when necessary and freed blocks are
+    merged with their buddy if it is free, so memory is never compacted and
+    packets are never moved. The free blocks of each order are kept in a
+    doubly linked list stored in the blocks themselves, allocation and free
+    take a number of steps proportional to the number of orders.
+
+    The pool uses a byte of metadata for each BLOCK bytes, BLOCK must be at
+    least 4 bytes. LENGTH is rounded down to a multiple of BLOCK. */
+
+#ifndef PJON_PacketPool_h
+  #define PJON_PacketPool_h
+
+  #define PJON_POOL_NONE 0xFFFF
+  #define PJON_POOL_FREE 0x80
+
+  template<uint32_t LENGTH, uint16_t BLOCK>
+  class PJON_Packet_Pool {
+    public:
+      PJON_Packet_Pool() {
+        clear();
+      };
+
+
+      /* Return a block of at least length bytes, NULL if none is free: */
+
+      char *allocate(uint16_t length) {
+        if(!length) length = 1;
+        uint8_t order = 0;
+        while(((uint32_t)BLOCK << order) < length)
+          if(++order > _max_order) return NULL;
+        uint8_t o = order;
+        while(o <= _max_order && _free[o] == PJON_POOL_NONE) o++;
+        if(o > _max_order) return NULL;
+        uint16_t unit = _free[o];
+        unlink(unit, o);
+        while(o > order) { // Split keeping the first half, freeing the buddy
+          o--;
+          link(unit + (1 << o), o);
+        }
+        _blocks[unit] = order;
+        _used += (uint32_t)BLOCK << order;
+        _requested += length;
+        return (char *)(_pool + (uint32_t)unit * BLOCK);
+      };
+
+
+      /* Reduce to new_length bytes a block allocated with length bytes, its
+         halves no more needed are freed and it keeps its address: */
+
+      void shrink(const char *block, uint16_t length, uint16_t new_length) {
+        if(!block || new_length >= length) return;
+        if(!new_length) new_length = 1;
+        uint16_t unit = ((const uint8_t *)block - _pool) / BLOCK;
+        uint8_t order = _blocks[unit];
+        while(order && ((uint32_t)BLOCK << (order - 1)) >= new_length) {
+          order--;
+          link(unit + (1 << order), order);
+          _used -= (uint32_t)BLOCK << order;
+        }
+        _blocks[unit] = order;
+        _requested -= length - new_length;
+      };
+
+
+      /* Return a block to the pool merging it with its free buddies, the
+         length has to be the last one passed to allocate or shrink: */
+
+      void free(const char *block, uint16_t length) {
+        if(!block) return;
+        uint16_t unit = ((const uint8_t *)block - _pool) / BLOCK;
+        uint8_t order = _blocks[unit];
+        _used -= (uint32_t)BLOCK << order;
+        _requested -= length ? length : 1;
+        while(order < _max_order) {
+          uint32_t buddy = unit ^ (1 << order);
+          if(buddy + (1 << order) > UNITS || _blocks[buddy] != (PJON_POOL_FREE | order))
+            break;
+          unlink(buddy, order);
+          if(buddy < unit) unit = buddy;
+          order++;
+        }
+        link(unit, order);
+      };
+
+
+      /* Free all blocks: */
+
+      void clear() {
+        _used = 0;
+        _requested = 0;
+        for(uint8_t o = 0; o <= 16; o++) _free[o] = PJON_POOL_NONE;
+        _max_order = 0;
+        while(_max_order < 16 && ((uint32_t)2 << _max_order) <= UNITS) _max_order++;
+        // Cover the pool with the largest aligned blocks fitting in it
+        uint32_t unit = 0;
+        while(unit < UNITS) {
+          uint8_t order = _max_order;
+          while((unit & ((1ul << order) - 1)) || unit + (1ul << order) > UNITS) order--;
+          link(unit, order);
+          unit += 1ul << order;
+        }
+      };
+
+
+      /* Memory utilization: */
+
+      uint32_t length() const { return UNITS * BLOCK; };          // Pool length
+      uint32_t used() const { return _used; };                    // Bytes of allocated blocks
+      uint32_t requested() const { return _requested; };          // Bytes requested
+      uint32_t metadata() const { return UNITS + sizeof(_free); }; // Bytes of metadata
+
+      /* Length of the largest block that can be allocated: */
+
+      uint32_t largest_free() const {
+        for(int8_t o = _max_order; o >= 0; o--)
+          if(_free[o] != PJON_POOL_NONE) return (uint32_t)BLOCK << o;
+        return 0;
+      };
+
+    private:
+      static const uint16_t UNITS = LENGTH / BLOCK;
+
+      /* Free list links are stored in the first 4 bytes of free blocks */
+
+      uint16_t get_link(uint16_t unit, uint8_t position) const {
+        const uint8_t *block = _pool + (uint32_t)unit * BLOCK + position;
+        return block[0] << 8 | block[1];
+      };
+
+      void set_link(uint16_t unit, uint8_t position, uint16_t value) {
+        uint8_t *block = _pool + (uint32_t)unit * BLOCK + position;
+        block[0] = value >> 8;
+        block[1] = value;
+      };
+
+      void link(uint16_t unit, uint8_t order) {
+        _blocks[unit] = PJON_POOL_FREE | order;
+        set_link(unit, 0, _free[order]);
+        set_link(unit, 2, PJON_POOL_NONE);
+        if(_free[order] != PJON_POOL_NONE) set_link(_free[order], 2, unit);
+        _free[order] = unit;
+      };
+
+      void unlink(uint16_t unit, uint8_t order) {
+        uint16_t next = get_link(unit, 0);
+        uint16_t previous = get_link(unit, 2);
+        if(previous == PJON_POOL_NONE) _free[order] = next;
+        else set_link(previous, 0, next);
+        if(next != PJON_POOL_NONE) set_link(next, 2, previous);
+        _blocks[unit] = 0;
+      };
+
+      uint8_t  _pool[UNITS * BLOCK];
+      uint8_t  _blocks[UNITS];  // Order of the block starting at each unit
+      uint16_t _free[17];       // First free block of each order
+      uint8_t  _max_order;
+      uint32_t _used;
+      uint32_t _requested;
+  };
+#endif
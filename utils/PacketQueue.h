@@ -0,0 +1,122 @@
+
+ /* Lock-free bounded queues used to pass packets between threads on a host
+    (see PJONGateway.h), they require C++11 atomics so are not included by
+    PJON.h. Items are written and read in place: a producer claims an item,
+    fills it and publishes it, the consumer reads the front item and pops
+    it, so packets are copied once.
+
+    PJON_SPSC_Queue: one producer thread and one consumer thread, each side
+    only writes its own index.
+
+    PJON_MPSC_Queue: more producer threads and one consumer thread, producers
+    claim items with a compare and swap on the tail, each item has a
+    sequence number telling if it is free, being written or published.
+
+    LENGTH must be a power of 2. */
+
+#ifndef PJON_PacketQueue_h
+  #define PJON_PacketQueue_h
+  #include <atomic>
+
+  template<typename T, uint16_t LENGTH>
+  class PJON_SPSC_Queue {
+    public:
+      PJON_SPSC_Queue() : _head(0), _tail(0) { };
+
+
+      /* Producer: return the item to be written, NULL if the queue is full,
+         then publish it: */
+
+      T *claim() {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        if(tail - _head.load(std::memory_order_acquire) == LENGTH) return NULL;
+        return &_items[tail & (LENGTH - 1)];
+      };
+
+      void publish() {
+        _tail.store(_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+      };
+
+
+      /* Consumer: return the oldest item, NULL if empty, then pop it: */
+
+      T *front() {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        if(head == _tail.load(std::memory_order_acquire)) return NULL;
+        return &_items[head & (LENGTH - 1)];
+      };
+
+      void pop() {
+        _head.store(_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+      };
+
+
+      uint16_t count() const {
+        return _tail.load(std::memory_order_acquire) - _head.load(std::memory_order_acquire);
+      };
+
+    private:
+      static_assert(!(LENGTH & (LENGTH - 1)), "LENGTH must be a power of 2");
+      alignas(64) std::atomic<uint32_t> _head; // Written by the consumer
+      alignas(64) std::atomic<uint32_t> _tail; // Written by the producer
+      T _items[LENGTH];
+  };
+
+
+  template<typename T, uint16_t LENGTH>
+  class PJON_MPSC_Queue {
+    public:
+      PJON_MPSC_Queue() : _head(0), _tail(0) {
+        for(uint32_t i = 0; i < LENGTH; i++)
+          _cells[i].sequence.store(i, std::memory_order_relaxed);
+      };
+
+
+      /* Producer: return the item to be written, NULL if the queue is full,
+         then publish it passing the ticket received: */
+
+      T *claim(uint32_t &ticket) {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        while(true) {
+          Cell &cell = _cells[tail & (LENGTH - 1)];
+          int32_t state = cell.sequence.load(std::memory_order_acquire) - tail;
+          if(state < 0) return NULL; // Full
+          if(!state) {
+            if(_tail.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed)) {
+              ticket = tail;
+              return &cell.item;
+            }
+          } else tail = _tail.load(std::memory_order_relaxed); // Claimed by another producer
+        }
+      };
+
+      void publish(uint32_t ticket) {
+        _cells[ticket & (LENGTH - 1)].sequence.store(ticket + 1, std::memory_order_release);
+      };
+
+
+      /* Consumer: return the oldest item, NULL if empty or not published
+         yet, then pop it: */
+
+      T *front() {
+        Cell &cell = _cells[_head & (LENGTH - 1)];
+        if(cell.sequence.load(std::memory_order_acquire) != _head + 1) return NULL;
+        return &cell.item;
+      };
+
+      void pop() {
+        _cells[_head & (LENGTH - 1)].sequence.store(_head + LENGTH, std::memory_order_release);
+        _head++;
+      };
+
+    private:
+      static_assert(!(LENGTH & (LENGTH - 1)), "LENGTH must be a power of 2");
+      struct Cell {
+        std::atomic<uint32_t> sequence;
+        T item;
+      };
+      alignas(64) uint32_t _head;              // Only used by the consumer
+      alignas(64) std::atomic<uint32_t> _tail; // Shared by producers
+      alignas(64) Cell _cells[LENGTH];
+  };
+#endif